@@ -76,15 +76,17 @@ namespace ukb {
 	}
 
 
+	// In place, so that l keeps its memory for the next line
+
 	void trim_spaces(std::string &l) {
 
-		std::string res("");
-		std::string::size_type start = l.find_first_not_of(" \t\r");
 		std::string::size_type end = l.find_last_not_of(" \t\r");
-		if (start != std::string::npos) {
-			res = l.substr(start, end - start + 1);
+		if (end == std::string::npos) {
+			l.clear();
+			return;
 		}
-		l.swap(res);
+		l.erase(end + 1);
+		l.erase(0, l.find_first_not_of(" \t\r"));
 	}
 
 	std::istream & read_line_noblank(std::istream & is, std::string & line, size_t & l_n) {
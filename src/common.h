@@ -16,6 +16,7 @@
 #include <iosfwd>
 //#include <algorithm>
 #include <numeric>
+#include <cstring>
 
 #include <boost/graph/graphviz.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -30,6 +31,7 @@
 
 #include <boost/graph/properties.hpp>
 #include <boost/tuple/tuple.hpp> // for "tie"
+#include <boost/cstdint.hpp>
 
 // Stuff for generating random numbers
 
@@ -266,6 +268,38 @@ namespace ukb {
 
 	int g_randTarget(int Target);
 
+	/////////////////////////////////////////////////////////////////////
+	// bfloat16
+	//
+	// The 16 upper bits of an IEEE float: same exponent range, but only 8
+	// bits of precision. Used for storing weights and ranks in half the
+	// space. Values are converted to float for any arithmetic, and rounded
+	// to nearest (even) when stored.
+
+	class bfloat16 {
+	public:
+		bfloat16() : m_bits(0) {}
+		bfloat16(float f) : m_bits(from_float(f)) {}
+
+		operator float() const {
+			boost::uint32_t u = static_cast<boost::uint32_t>(m_bits) << 16;
+			float f;
+			std::memcpy(&f, &u, sizeof(f));
+			return f;
+		}
+
+	private:
+		static boost::uint16_t from_float(float f) {
+			boost::uint32_t u;
+			std::memcpy(&u, &f, sizeof(u));
+			if ((u & 0x7fffffffu) > 0x7f800000u) return static_cast<boost::uint16_t>((u >> 16) | 0x40); // NaN
+			u += 0x7fffu + ((u >> 16) & 1u);
+			return static_cast<boost::uint16_t>(u >> 16);
+		}
+
+		boost::uint16_t m_bits;
+	};
+
 	////////////////////////////////////////////////////////////////////
 	// Remove isolated vertices of a graph
 
@@ -6,6 +6,8 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <cstdio>
+#include <cmath>
 
 // Boost libraries
 
@@ -42,7 +44,7 @@ void query (const string & str) {
 		for(;it != end; ++it) {
 			cout << "  ";
 			cout << kb.get_vertex_name(kb.edge_target(*it));
-			cout << ":" << g[*it].weight << "\n";
+			cout << ":" << get(kb.weight_map(), *it) << "\n";
 		}
 	}
 }
@@ -73,7 +75,7 @@ void set_source_rels(const string & str,
 
 void print_iquery_v(KbGraph & g, Kb_vertex_t u, float w = 0, int sp = 0) {
 
-	string hw(g[u].name);
+	string hw(Kb::instance().get_vertex_name(u));
 
 	for (int i = 0; i < sp; ++i)
 		cout << "  ";
@@ -139,13 +141,13 @@ void show_neighbours(string & str) {
 			graph_traits<Kb::boost_graph_t>::out_edge_iterator it , end;
 			tie(it, end) = out_edges(u, g);
 			for(;it != end; ++it) {
-				print_iquery_v(g, target(*it, g), g[*it].weight, 2);
+				print_iquery_v(g, target(*it, g), get(kb.weight_map(), *it), 2);
 			}
 		} else {
-			graph_traits<Kb::boost_graph_t>::in_edge_iterator iit , iend;
-			tie(iit, iend) = in_edges(u, g);
-			for(;iit != iend; ++iit) {
-				print_iquery_v(g, source(*iit, g), g[*iit].weight, 2);
+			vector<Kb_edge_t> E;
+			kb.in_edges(u, E);
+			for(size_t i = 0; i < E.size(); ++i) {
+				print_iquery_v(g, source(E[i], g), get(kb.weight_map(), E[i]), 2);
 			}
 		}
 	} else {
@@ -225,6 +227,79 @@ void sPath(const string & sPathV) {
 	}
 }
 
+// Write the KB to a temporary file and rename it, so that the KB file can
+// be replaced while it is mapped, by this process (see --convert) or by
+// others.
+
+void write_binfile_renaming(const string & fname_out) {
+	string tmp_out = fname_out + ".tmp";
+	Kb::instance().write_to_binfile(tmp_out);
+	if (std::rename(tmp_out.c_str(), fname_out.c_str()))
+		throw std::runtime_error("Error: can not rename " + tmp_out + " to " + fname_out);
+}
+
+// Compute the PPVs of the vertices listed in synsets_fname (one name per
+// line) and store them, truncated to their topk values, in fname_out
+
+void build_ppv_cache(const string & synsets_fname, size_t topk, bool bf16, const string & fname_out) {
+
+	Kb & kb = Kb::instance();
+	ifstream fi(synsets_fname.c_str(), ifstream::in);
+	if (!fi) {
+		cerr << "Error: can't open " << synsets_fname << "\n";
+		exit(-1);
+	}
+	vector<Kb_vertex_t> U;
+	set<Kb_vertex_t> S;
+	string line;
+	size_t l_n = 0;
+	while(read_line_noblank(fi, line, l_n)) {
+		trim_spaces(line);
+		bool aux;
+		Kb_vertex_t u;
+		tie(u, aux) = kb.get_vertex_by_name(line);
+		if (!aux) {
+			if (glVars::debug::warning)
+				cerr << "[W] " << line << " not in KB\n";
+			continue;
+		}
+		if (S.insert(u).second) U.push_back(u);
+	}
+
+	size_t N = kb.size();
+	size_t K = glVars::prank::batch_size ? glVars::prank::batch_size : 1;
+	float d = glVars::prank::damping;
+	PpvCache::writer w(fname_out, N, kb.graph_checksum(glVars::prank::use_weight), topk, d, glVars::prank::use_weight, bf16);
+	vector<vector<float> > pvs, ranks;
+	vector<float> ranks_next;
+	for(size_t i = 0, m = U.size(); i < m; i += K) {
+		size_t k_n = std::min(K, m - i);
+		pvs.assign(k_n, vector<float>(N, 0.0f));
+		for(size_t k = 0; k < k_n; ++k)
+			pvs[k][U[i + k]] = 1.0f;
+		kb.pageRank_ppv_batch(pvs, k_n, ranks);
+		// One more iteration x' = T(x) gives the stored PPV, and the bound
+		// |x' - x*| <= d / (1 - d) * |x' - x| of its distance to the exact
+		// one (T is a contraction of factor d in L1 norm)
+		int iterations = glVars::prank::num_iterations;
+		float threshold = glVars::prank::threshold;
+		glVars::prank::num_iterations = 1;
+		glVars::prank::threshold = 0.0f;
+		for(size_t k = 0; k < k_n; ++k) {
+			kb.pageRank_ppv(pvs[k], ranks_next, ranks[k]);
+			float diff = 0.0f;
+			for(size_t j = 0; j < N; ++j) diff += fabs(ranks_next[j] - ranks[k][j]);
+			w.add(U[i + k], ranks_next, d / (1.0f - d) * diff);
+		}
+		glVars::prank::num_iterations = iterations;
+		glVars::prank::threshold = threshold;
+		if (glVars::verbose)
+			cerr << "\r" << i + k_n << "/" << m << " PPVs" << flush;
+	}
+	if (glVars::verbose) cerr << endl;
+	w.close();
+}
+
 int main(int argc, char *argv[]) {
 
 	srand(3);
@@ -238,6 +313,14 @@ int main(int argc, char *argv[]) {
 	bool opt_iquery = false;
 	bool opt_dump = false;
 	bool opt_textdump = false;
+	bool opt_convert = false;
+	bool opt_external = false;
+	string ppv_cache_synsets;
+	size_t ppv_topk = 1000;
+	bool opt_ppv_bf16 = false;
+	size_t opt_fingerprints = 0;
+	float fp_damping = 0.85;
+	bool opt_fp_weight = false;
 
 	// subgraph options
 	string subg_init;
@@ -247,6 +330,9 @@ int main(int argc, char *argv[]) {
 	string kb_file;
 	string query_vertex;
 	string sPathV;
+	string shm_create;
+	string shm_remove;
+	string delta_file;
 
 	glVars::kb::v1_kb = false; // Use v2 format
 	glVars::kb::filter_src = false; // by default, don't filter relations by src
@@ -265,7 +351,10 @@ int main(int argc, char *argv[]) {
 		"compile_kb -o output.bin [-f \"src1, src2\"] kb_file.txt kb_file.txt ... -> Create a KB image reading relations textfiles.\n"
 		"compile_kb -t kb_file.bin > graph.txt   -> Dump text file of graph.\n"
 		"compile_kb -i kb_file.bin -> Get info of a previously compiled KB.\n"
+		"compile_kb --convert --mmap -o output.bin kb_file.bin -> Convert a compiled KB to the memory-mapped format.\n"
+		"compile_kb --apply_delta delta.txt kb_file.bin -> Add, remove or reweight relations of a compiled KB.\n"
 		"compile_kb -q concept-id kb_file.bin -> Query a node on a previously compiled KB.\n"
+		"compile_kb --shm_create name kb_file.bin -> Place a compiled KB in shared memory.\n"
 		"Options:";
 
 	using namespace boost::program_options;
@@ -287,6 +376,16 @@ int main(int argc, char *argv[]) {
 		("minput", "Do not die when dealing with malformed input.")
 		("nopos", "Don't filter words by Part of Speech when reading dict.")
 		("note", value<string>(), "Add a comment to the graph.")
+		("bf16_weights", "Store edge weights as 16 bit bfloat16 numbers.")
+		("mmap", "Write the graph in the aligned format, which is memory-mapped when loading.")
+		("convert", "Read a compiled KB (in any format) and write it again. See --mmap and --bf16_weights.")
+		("apply_delta", value<string>(), "Apply a file of relations to a compiled KB, and write the result to the -o file name (default is the KB file itself). Relation lines are prefixed by + (add, the default), - (remove) or = (set weight). See --mmap and --bf16_weights.")
+		("parse_threads", value<size_t>(), "Number of threads for parsing the relations file. Default is 1.")
+		("mem_budget", value<size_t>(), "Compile the relations out of memory, within about arg MB. Vertex names are kept in memory, edges are sorted through temporary files next to the output file, and relations are parsed on one thread. Can not be used with --reorder, --mmap or --fingerprints.")
+		("reorder", value<string>(), "Relabel vertices for locality: degree, rcm (reverse Cuthill-McKee), bfs or rabbit (community order).")
+		("fingerprints", value<size_t>(), "Also write the given number of random walk fingerprints per vertex, for ukb_wsd --prank_mc. The file name is the output name plus \".fp\". The error of --prank_mc falls as 1/sqrt(arg), and the file takes 4 * arg bytes per vertex.")
+		("fp_damping", value<float>(), "Damping factor of the fingerprint random walks. Default is 0.85.")
+		("fp_weight", "Random walks for fingerprints follow edge weights.")
 		;
 
 	options_description po_desc_query("Options for querying over binary graphs");
@@ -301,6 +400,21 @@ int main(int argc, char *argv[]) {
 		("dict_file,D", value<string>(), "Dictionary text file. Use only when querying (--quey or --iquery) or when creating serialized dict (--serialize_dict).")
 		;
 
+	options_description po_desc_ppvc("Options for precomputing PPVs of binary graphs");
+	po_desc_ppvc.add_options()
+		("ppv_cache", value<string>(), "Compute and store the PPVs of the concepts listed in this file (one per line), for ukb_wsd --ppv_cache. The output is the -o file name, or the KB name plus \".ppvc\".")
+		("ppv_topk", value<size_t>(), "Number of values kept of each PPV. Default is 1000.")
+		("ppv_bf16", "Store PPV values as 16 bit bfloat16 numbers.")
+		("prank_weight,w", "Use weights in pageRank calculation.")
+		("prank_damping", value<float>(), "Set damping factor in PageRank equation. Default is 0.85.")
+		;
+
+	options_description po_desc_shm("Options for sharing binary graphs");
+	po_desc_shm.add_options()
+		("shm_create", value<string>(), "Place the KB in POSIX shared-memory segment arg, for the --kb_shm option of ukb_wsd, ukb_ppv and ukb_walkandprint. PageRank coefficients are computed with --prank_weight, if given.")
+		("shm_remove", value<string>(), "Remove POSIX shared-memory segment arg.")
+		;
+
 	options_description po_desc_dump("Options for dumping binary graphs");
 	po_desc_dump.add_options()
 		("text,t", "Write Kb binfile in text format.")
@@ -312,7 +426,7 @@ int main(int argc, char *argv[]) {
 		("input-file",value<string>(), "Input files.")
 		;
 	options_description po_visible(desc_header);
-	po_visible.add(po_desc).add(po_desc_create).add(po_desc_query).add(po_desc_dump);
+	po_visible.add(po_desc).add(po_desc_create).add(po_desc_query).add(po_desc_ppvc).add(po_desc_shm).add(po_desc_dump);
 
 	options_description po_desc_all("All options");
 	po_desc_all.add(po_visible).add(po_hidden);
@@ -422,12 +536,117 @@ int main(int argc, char *argv[]) {
 		if (vm.count("output")) {
 			fullname_out = vm["output"].as<string>();
 		}
+
+		if (vm.count("ppv_cache")) {
+			ppv_cache_synsets = vm["ppv_cache"].as<string>();
+		}
+
+		if (vm.count("ppv_topk")) {
+			ppv_topk = vm["ppv_topk"].as<size_t>();
+		}
+
+		if (vm.count("ppv_bf16")) {
+			opt_ppv_bf16 = true;
+		}
+
+		if (vm.count("bf16_weights")) {
+			glVars::kb::bf16_weights = true;
+		}
+
+		if (vm.count("mmap")) {
+			glVars::kb::mmap_format = true;
+		}
+
+		if (vm.count("convert")) {
+			opt_convert = true;
+		}
+
+		if (vm.count("apply_delta")) {
+			delta_file = vm["apply_delta"].as<string>();
+		}
+
+		if (vm.count("shm_create")) {
+			shm_create = vm["shm_create"].as<string>();
+		}
+
+		if (vm.count("shm_remove")) {
+			shm_remove = vm["shm_remove"].as<string>();
+		}
+
+		if (vm.count("parse_threads")) {
+			size_t nt = vm["parse_threads"].as<size_t>();
+			if (nt == 0) {
+				cerr << "Error: invalid parse_threads value of zero\n";
+				exit(-1);
+			}
+			glVars::kb::parse_threads = nt;
+		}
+
+		if (vm.count("mem_budget")) {
+			size_t mb = vm["mem_budget"].as<size_t>();
+			if (mb == 0) {
+				cerr << "Error: invalid mem_budget value of zero\n";
+				exit(-1);
+			}
+			glVars::kb::mem_budget = mb << 20;
+			opt_external = true;
+		}
+
+		if (vm.count("reorder")) {
+			string ro = vm["reorder"].as<string>();
+			if (ro == "degree") glVars::kb::reorder = glVars::reorder_degree;
+			else if (ro == "rcm") glVars::kb::reorder = glVars::reorder_rcm;
+			else if (ro == "bfs") glVars::kb::reorder = glVars::reorder_bfs;
+			else if (ro == "rabbit") glVars::kb::reorder = glVars::reorder_rabbit;
+			else {
+				cerr << "Error: invalid reorder value " << ro << "\n";
+				exit(-1);
+			}
+		}
+
+		if (vm.count("prank_weight")) {
+			glVars::prank::use_weight = true;
+		}
+
+		if (vm.count("prank_damping")) {
+			float dp = vm["prank_damping"].as<float>();
+			if (dp <= 0.0 || dp > 1.0) {
+				cerr << "Error: invalid prank_damping value " << dp << "\n";
+				exit(-1);
+			}
+			glVars::prank::damping = dp;
+		}
+
+		if (vm.count("fingerprints")) {
+			opt_fingerprints = vm["fingerprints"].as<size_t>();
+		}
+
+		if (vm.count("fp_damping")) {
+			float dp = vm["fp_damping"].as<float>();
+			if (dp <= 0.0 || dp >= 1.0) {
+				cerr << "Error: invalid fp_damping value " << dp << "\n";
+				exit(-1);
+			}
+			fp_damping = dp;
+		}
+
+		if (vm.count("fp_weight")) {
+			opt_fp_weight = true;
+		}
 	}
 	catch(std::exception& e) {
 		cerr << e.what() << "\n";
 		exit(-1);
 	}
 
+	if (shm_remove.size()) {
+		if (!Kb::remove_shared(shm_remove)) {
+			cerr << "Error: can not remove shared memory " << shm_remove << "\n";
+			exit(-1);
+		}
+		return 0;
+	}
+
 	if (!kb_file.size()) {
 		cerr << po_visible << "\n";
 		cerr << "Error: no input files\n" << endl;
@@ -437,6 +656,7 @@ int main(int argc, char *argv[]) {
 	if (opt_info) {
 		Kb::create_from_binfile(kb_file);
 		Kb::instance().display_info(cout);
+		if (glVars::verbose) Kb::instance().write_load_stats(cerr);
 		return 0;
 	}
 
@@ -484,6 +704,18 @@ int main(int argc, char *argv[]) {
 		return 0;
 	}
 
+	if (ppv_cache_synsets.size()) {
+		string fname_out = vm.count("output") ? fullname_out : kb_file + ".ppvc";
+		try {
+			Kb::create_from_binfile(kb_file);
+			build_ppv_cache(ppv_cache_synsets, ppv_topk, opt_ppv_bf16, fname_out);
+		} catch(std::exception& e) {
+			cerr << e.what() << "\n";
+			exit(-1);
+		}
+		return 0;
+	}
+
 	if(subg_init.size()) {
 		Kb::create_from_binfile(kb_file);
 		subg(subg_init, subgN);
@@ -496,6 +728,51 @@ int main(int argc, char *argv[]) {
 		return 0;
 	}
 
+	if (shm_create.size()) {
+		try {
+			Kb::create_from_binfile(kb_file);
+			if (glVars::verbose)
+				cerr << "Writing shared memory: " << shm_create << endl;
+			Kb::instance().write_to_shared(shm_create);
+		} catch(std::exception& e) {
+			cerr << e.what() << "\n";
+			exit(-1);
+		}
+		return 0;
+	}
+
+	if (delta_file.size()) {
+		string fname_out = vm.count("output") ? fullname_out : kb_file;
+		try {
+			Kb::create_from_binfile(kb_file);
+			size_t n = Kb::instance().apply_delta(delta_file, src_allowed);
+			Kb::instance().add_comment(cmdline);
+			if (glVars::verbose)
+				cerr << "Changed " << n << " edges\nWriting binary file: "<< fname_out << endl;
+			write_binfile_renaming(fname_out);
+		} catch(std::exception& e) {
+			cerr << e.what() << "\n";
+			exit(-1);
+		}
+		if (glVars::verbose)
+			cerr << "Wrote " << num_vertices(Kb::instance().graph()) << " vertices and " << num_edges(Kb::instance().graph()) << " edges" << endl;
+		return 0;
+	}
+
+	if (opt_convert) {
+		try {
+			Kb::create_from_binfile(kb_file);
+			Kb::instance().add_comment(cmdline);
+			if (glVars::verbose)
+				cerr << "Writing binary file: "<< fullname_out<< endl;
+			write_binfile_renaming(fullname_out);
+		} catch(std::exception& e) {
+			cerr << e.what() << "\n";
+			exit(-1);
+		}
+		return 0;
+	}
+
 	if (glVars::verbose) {
 		show_global_variables(cerr);
 	}
@@ -517,6 +794,28 @@ int main(int argc, char *argv[]) {
 		exit(0);
 	}
 
+	if (opt_external) {
+		if (opt_fingerprints) {
+			cerr << "Error: --fingerprints needs the graph in memory, and can not be used with --mem_budget\n";
+			exit(-1);
+		}
+		try {
+			std::pair<size_t, size_t> n;
+			if (kb_file == "-") {
+				cmdline += " <STDIN>";
+				n = Kb::compile_from_txt(std::cin, src_allowed, fullname_out, vector<string>(1, cmdline));
+			} else {
+				n = Kb::compile_from_txt(kb_file, src_allowed, fullname_out, vector<string>(1, cmdline));
+			}
+			if (glVars::verbose)
+				cerr << "Wrote " << n.first << " vertices and " << n.second << " edges" << endl;
+		} catch(std::exception& e) {
+			cerr << e.what() << "\n";
+			exit(-1);
+		}
+		return 0;
+	}
+
 	try {
 		// If first input file is "-", open std::cin
 		if (kb_file == "-") {
@@ -538,6 +837,14 @@ int main(int argc, char *argv[]) {
 	if (glVars::verbose)
 		cerr << "Wrote " << num_vertices(Kb::instance().graph()) << " vertices and " << num_edges(Kb::instance().graph()) << " edges" << endl;
 
+	if (opt_fingerprints) {
+		string fp_out = fullname_out + ".fp";
+		if (glVars::verbose)
+			cerr << "Writing fingerprints: " << fp_out << endl;
+		Kb::instance().build_fingerprints(opt_fingerprints, fp_damping, opt_fp_weight);
+		Kb::instance().write_fingerprints(fp_out);
+	}
+
 	return 0;
 }
 
@@ -3,10 +3,11 @@
 #include "globalVars.h"
 #include "kbGraph.h"
 #include "wdict.h"
+#include "textScan.h"
 
-// Tokenizer
-#include <boost/tokenizer.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include<boost/tuple/tuple.hpp> // for "tie"
 
@@ -69,6 +70,12 @@ namespace ukb {
 		std::swap(m_disamb, o.m_disamb);
 	}
 
+	// Contexts are read by many threads at once in server mode (see
+	// sServer), and glVars::rnd::urng is not thread-safe. The dictionary
+	// shuffle draws from it while holding this mutex.
+
+	static boost::mutex urng_mutex;
+
 	size_t CWord::link_dict_concepts(const string & lemma, const string & pos) {
 
 		size_t new_c = 0;
@@ -87,6 +94,7 @@ namespace ukb {
 
 		if(glVars::dict::use_shuffle) {
 			// Shuffle index vector
+			boost::lock_guard<boost::mutex> lock(urng_mutex);
 			boost::random_number_generator<boost::mt19937, long int> rand_dist(glVars::rnd::urng);
 			std::random_shuffle(sidxV.begin(), sidxV.end(), rand_dist);
 		}
@@ -338,9 +346,9 @@ namespace ukb {
 		if (m_id.empty()) throw std::runtime_error(string("empty id"));
 		vector<string> ctx;
 		vector<CWord> V;
-		char_separator<char> sep(" \t");
-		tokenizer<char_separator<char> > tok_ctx(ctx_str, sep);
-		copy(tok_ctx.begin(), tok_ctx.end(), back_inserter(ctx));
+		text_fields tok_ctx(ctx_str, " \t");
+		text_ref word;
+		while(tok_ctx.next(word)) ctx.push_back(word.str());
 		if (ctx.size() == 0) return;
 		try {
 			push_ctx(ctx);
@@ -362,36 +370,42 @@ namespace ukb {
 
 	};
 
-	ctw_parse_t parse_ctw(const string & word) {
+	// Parse word into res, reusing its strings
 
-		ctw_parse_t res;
+	void parse_ctw(const string & word, ctw_parse_t & res) {
 
-		char_separator<char> wsep("#", "", keep_empty_tokens);
-		tokenizer<char_separator<char> > wtok(word, wsep);
-		tokenizer<char_separator<char> >::iterator it = wtok.begin();
-		tokenizer<char_separator<char> >::iterator end = wtok.end();
-		if (it == end) return res; // empty line
-		vector<string> fields;
-		copy(it, end, back_inserter(fields));
-		size_t m = fields.size();
+		res.lemma.clear();
+		res.pos.clear();
+		res.id.clear();
+		res.dist = 0;
+		res.w = 1.0;
+
+		text_fields wtok(word, "#", true);
+		text_ref fields[5];
+		size_t m = 0;
+		text_ref field;
+		while(wtok.next(field)) {
+			if (m == 5) {
+				m++;
+				break;
+			}
+			fields[m++] = field;
+		}
+		if (!m) return; // empty line
 		if (m != 4 && m != 5) {
 			throw std::logic_error(word + " : too few fields.");
 		}
-		res.lemma = fields[0];
-		res.pos = fields[1];
-		res.id = fields[2];
-		try {
-			res.dist = lexical_cast<int>(fields[3]);
-			if (m == 5)
-				res.w = lexical_cast<float>(fields[4]);
-		} catch (boost::bad_lexical_cast &) {
+		fields[0].assign_to(res.lemma);
+		fields[1].assign_to(res.pos);
+		fields[2].assign_to(res.id);
+		if (!parse_int(fields[3], res.dist) ||
+			(m == 5 && !parse_float(fields[4], res.w))) {
 			throw std::logic_error(word + " : Parsing error.");
 		}
 
 		if (res.w < 0.0) {
 			throw std::logic_error(word + " : Negative weight.");
 		}
-		return res;
 	}
 
 
@@ -433,6 +447,7 @@ namespace ukb {
 		bool last_is_nopv = false;
 		CWord last_nopv;
 		map<string, float> nopv_concepts;
+		ctw_parse_t ctwp;
 		vector<string>::const_iterator end = ctx.end();
 		for(vector<string>::const_iterator it = ctx.begin();
 			it != end or last_is_nopv; ++it) {
@@ -446,7 +461,7 @@ namespace ukb {
 					}
 					break;
 				}
-				ctw_parse_t ctwp = parse_ctw(*it);
+				parse_ctw(*it, ctwp);
 				if (ctwp.lemma.size() == 0) {
 					throw std::logic_error(*it + " has no lemma.");
 				}
@@ -518,9 +533,9 @@ namespace ukb {
 
 		cw_end--;
 		for(; cw_it != cw_end; ++cw_it) {
-			o << cs_.m_vuniq[cw_it->idx].write(o, cw_it->id, cw_it->t) << " ";
+			cs_.m_vuniq[cw_it->idx].write(o, cw_it->id, cw_it->t) << " ";
 		}
-		o << cs_.m_vuniq[cw_end->idx].write(o, cw_end->id, cw_end->t) << " ";
+		cs_.m_vuniq[cw_end->idx].write(o, cw_end->id, cw_end->t) << " ";
 		return o;
 	}
 
@@ -634,6 +649,50 @@ namespace ukb {
 	}
 
 
+	// Sparse variant of pv_from_cs_onlyC
+
+	int pv_from_cs_onlyC(const CSentence & cs,
+						 Kb_sparse_vector & pv,
+						 CSentence::const_iterator exclude_word_it) {
+
+		Kb & kb = ukb::Kb::instance();
+
+		pv.clear(kb.size());
+
+		int inserted_i = 0;
+
+		// put pv to the synsets of words
+		for(vector<CWord>::const_iterator it = cs.ubegin(), end = cs.uend();
+			it != end; ++it) {
+			if (it == exclude_word_it) continue;
+			const CWord & cw = *it;
+			float cw_w = cw.get_weight() * cs.weigth_factor();
+			if (cw.type() == CWord::cw_concept) {
+				pv.push_back(cw.V_vector().at(0).first, cw_w);
+				inserted_i++;
+			} else {
+				float factor = cw_w * cw.get_linkw_factor();
+				const vector<pair<Kb_vertex_t, float> > & V = cw.V_vector();
+				for(vector<pair<Kb_vertex_t, float> >::const_iterator v_it = V.begin(), v_end = V.end();
+					v_it != v_end; ++v_it) {
+					inserted_i++;
+					pv.push_back(v_it->first, v_it->second * factor);
+				}
+			}
+		}
+		pv.sort_merge();
+		return inserted_i;
+	}
+
+	// Whether PPVs are better computed as sparse vectors, that is, when using
+	// the nibble or Monte-Carlo approximations. Static ranks can not be
+	// subtracted from sparse PPVs, though.
+
+	bool use_sparse_ppr() {
+		return (glVars::prank::impl == glVars::nibble || glVars::prank::impl == glVars::mc)
+			&& !glVars::csentence::disamb_minus_static;
+	}
+
 	// Given a CSentence apply Personalized PageRank and obtain obtain it's
 	// Personalized PageRank Vector (PPV)
 	//
@@ -645,6 +704,26 @@ namespace ukb {
 		return calculate_kb_ppr_by_word(cs, cs.uend(), ranks);
 	}
 
+	bool calculate_kb_ppr(const CSentence & cs,
+						  vector<float> & ranks,
+						  PrankWorkspace & ws) {
+
+		return calculate_kb_ppr_by_word(cs, cs.uend(), ranks, ws);
+	}
+
+	// Subtract ranks from the static ranks (see
+	// glVars::csentence::disamb_minus_static)
+
+	static void minus_static_ranks(const Kb & kb, vector<float> & ranks) {
+
+		if (!glVars::csentence::disamb_minus_static) return;
+		const vector<float> & staticV = kb.static_prank();
+		for(size_t i = 0, n = staticV.size();
+			i != n; ++i) {
+			ranks[i] = staticV[i] - ranks[i];
+		}
+	}
+
 	// given a word (pointed by tgtw_it),
 	// 1. put a ppv in the synsets of the rest of words.
 	// 2. Pagerank
@@ -662,17 +741,174 @@ namespace ukb {
 		// Execute PageRank
 		if (aux) {
 			kb.pageRank_ppv(pv, ranks);
-			if (glVars::csentence::disamb_minus_static) {
-				const vector<float> & staticV = kb.static_prank();
-				for(size_t i = 0, n = staticV.size();
-					i != n; ++i) {
-					ranks[i] = staticV[i] - ranks[i];
-				}
-			}
+			minus_static_ranks(kb, ranks);
 		}
 		return aux;
 	}
 
+	// Thread-safe version. The personalization vector is ws.pv.
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  vector<float> & ranks,
+								  PrankWorkspace & ws) {
+
+		const Kb & kb = ukb::Kb::instance();
+		int aux = pv_from_cs_onlyC(cs, ws.pv, tgtw_it);
+		// Execute PageRank
+		if (aux) {
+			kb.pageRank_ppv(ws.pv, ranks, ws);
+			minus_static_ranks(kb, ranks);
+		}
+		return aux;
+	}
+
+	// Sparse versions of calculate_kb_ppr and calculate_kb_ppr_by_word (see
+	// Kb::pageRank_ppv_sparse)
+	//
+	// Note: glVars::csentence::disamb_minus_static is not applied
+
+	bool calculate_kb_ppr(const CSentence & cs,
+						  Kb_sparse_vector & ranks) {
+
+		return calculate_kb_ppr_by_word(cs, cs.uend(), ranks);
+	}
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  Kb_sparse_vector & ranks) {
+
+		Kb & kb = ukb::Kb::instance();
+		Kb_sparse_vector pv;
+		int aux = pv_from_cs_onlyC(cs, pv, tgtw_it);
+		// Execute PageRank
+		if (aux) {
+			kb.pageRank_ppv_sparse(pv, ranks);
+		}
+		return aux;
+	}
+
+	bool calculate_kb_ppr(const CSentence & cs,
+						  Kb_sparse_vector & ranks,
+						  PrankWorkspace & ws) {
+
+		return calculate_kb_ppr_by_word(cs, cs.uend(), ranks, ws);
+	}
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  Kb_sparse_vector & ranks,
+								  PrankWorkspace & ws) {
+
+		const Kb & kb = ukb::Kb::instance();
+		int aux = pv_from_cs_onlyC(cs, ws.sparse_pv, tgtw_it);
+		// Execute PageRank
+		if (aux) {
+			kb.pageRank_ppv_sparse(ws.sparse_pv, ranks, ws);
+		}
+		return aux;
+	}
+
+	// Batched versions of calculate_kb_ppr and calculate_kb_ppr_by_word. All
+	// non-empty personalization vectors are computed at once (see
+	// Kb::pageRank_ppv_batch). ok[i] is false if the i-th personalization
+	// vector is empty, and then ranks[i] is undefined.
+	//
+	// The personalization vectors are built in pvs, and ranks is grown to
+	// ok.size() vectors, but never shrunk, so that vectors are reused among
+	// batches. If ws is NULL, the workspace of the Kb is used.
+
+	// Compute the PPVs of the first K vectors of pvs (the non-empty ones, in
+	// order), and move them to the elements of ranks whose ok is true.
+
+	static void kb_ppr_batch(const vector<vector<float> > & pvs,
+							 size_t K,
+							 const vector<bool> & ok,
+							 vector<vector<float> > & ranks,
+							 PrankWorkspace *ws) {
+
+		Kb & kb = ukb::Kb::instance();
+		size_t m = ok.size();
+		if (ranks.size() < m) ranks.resize(m);
+		if (ws)
+			static_cast<const Kb &>(kb).pageRank_ppv_batch(pvs, K, ranks, *ws);
+		else
+			kb.pageRank_ppv_batch(pvs, K, ranks);
+
+		// ranks[j] is the PPV of the j-th non-empty vector. Move them
+		// backwards, so that no PPV is overwritten before it is moved.
+		for(size_t i = m; i--; ) {
+			if (!ok[i]) continue;
+			if (i != --K) ranks[i].swap(ranks[K]);
+			minus_static_ranks(kb, ranks[i]);
+		}
+	}
+
+	static void kb_ppr_batch_cs(const vector<const CSentence *> & css,
+								vector<vector<float> > & pvs,
+								vector<vector<float> > & ranks,
+								vector<bool> & ok,
+								PrankWorkspace *ws) {
+
+		size_t m = css.size();
+		if (pvs.size() < m) pvs.resize(m);
+		ok.assign(m, false);
+		size_t K = 0;
+		for(size_t i = 0; i != m; ++i) {
+			ok[i] = pv_from_cs_onlyC(*css[i], pvs[K], css[i]->uend()) != 0;
+			if (ok[i]) ++K;
+		}
+		kb_ppr_batch(pvs, K, ok, ranks, ws);
+	}
+
+	static void kb_ppr_batch_by_word(const CSentence & cs,
+									 const vector<CSentence::const_iterator> & tgtws,
+									 vector<vector<float> > & pvs,
+									 vector<vector<float> > & ranks,
+									 vector<bool> & ok,
+									 PrankWorkspace *ws) {
+
+		size_t m = tgtws.size();
+		if (pvs.size() < m) pvs.resize(m);
+		ok.assign(m, false);
+		size_t K = 0;
+		for(size_t i = 0; i != m; ++i) {
+			ok[i] = pv_from_cs_onlyC(cs, pvs[K], tgtws[i]) != 0;
+			if (ok[i]) ++K;
+		}
+		kb_ppr_batch(pvs, K, ok, ranks, ws);
+	}
+
+	void calculate_kb_ppr_batch(const vector<const CSentence *> & css,
+								vector<vector<float> > & ranks,
+								vector<bool> & ok) {
+		vector<vector<float> > pvs;
+		kb_ppr_batch_cs(css, pvs, ranks, ok, 0);
+	}
+
+	void calculate_kb_ppr_batch(const vector<const CSentence *> & css,
+								vector<vector<float> > & ranks,
+								vector<bool> & ok,
+								PrankWorkspace & ws) {
+		kb_ppr_batch_cs(css, ws.ppvs, ranks, ok, &ws);
+	}
+
+	void calculate_kb_ppr_by_word_batch(const CSentence & cs,
+										const vector<CSentence::const_iterator> & tgtws,
+										vector<vector<float> > & ranks,
+										vector<bool> & ok) {
+		vector<vector<float> > pvs;
+		kb_ppr_batch_by_word(cs, tgtws, pvs, ranks, ok, 0);
+	}
+
+	void calculate_kb_ppr_by_word_batch(const CSentence & cs,
+										const vector<CSentence::const_iterator> & tgtws,
+										vector<vector<float> > & ranks,
+										vector<bool> & ok,
+										PrankWorkspace & ws) {
+		kb_ppr_batch_by_word(cs, tgtws, ws.ppvs, ranks, ok, &ws);
+	}
+
 	//
 	// Given a previously disambiguated CSentence (all synsets of words
 	// have a rank), calculate a kb prgaRank where PPV is formed by
@@ -737,4 +973,19 @@ namespace ukb {
 		}
 		return true;
 	}
+
+	bool disamb_csentence_kb(CSentence & cs,
+							 const Kb_sparse_vector & ranks) {
+
+		if (!cs.has_tgtwords()) return false; // no target words
+
+		vector<CWord>::iterator cw_it = cs.ubegin();
+		vector<CWord>::iterator cw_end = cs.uend();
+		for(; cw_it != cw_end; ++cw_it) {
+			if (!cw_it->is_tgtword()) continue;
+			cw_it->rank_synsets<const Kb_sparse_vector &>(ranks, false);
+			cw_it->disamb_cword();
+		}
+		return true;
+	}
 }
@@ -218,6 +218,68 @@ namespace ukb {
 								  CSentence::const_iterator tgtw_it,
 								  std::vector<float> & ranks);
 
+	// Thread-safe versions of the above (see the const
+	// Kb::pageRank_ppv). Many threads can call them at once, each one with
+	// its own workspace.
+
+	bool calculate_kb_ppr(const CSentence & cs,
+						  std::vector<float> & res,
+						  PrankWorkspace & ws);
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  std::vector<float> & ranks,
+								  PrankWorkspace & ws);
+
+	// Sparse versions of the above (see Kb::pageRank_ppv_sparse). Static
+	// ranks are never subtracted.
+
+	bool calculate_kb_ppr(const CSentence & cs,
+						  Kb_sparse_vector & res);
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  Kb_sparse_vector & ranks);
+
+	bool calculate_kb_ppr(const CSentence & cs,
+						  Kb_sparse_vector & res,
+						  PrankWorkspace & ws);
+
+	bool calculate_kb_ppr_by_word(const CSentence & cs,
+								  CSentence::const_iterator tgtw_it,
+								  Kb_sparse_vector & ranks,
+								  PrankWorkspace & ws);
+
+	// Whether the sparse versions should be used (PageRank nibble without
+	// static rank subtraction)
+
+	bool use_sparse_ppr();
+
+	// Batched versions of the above. ok[i] is false if the PPV of the i-th
+	// element could not be computed, and then ranks[i] is undefined. ranks
+	// is grown if needed, but never shrunk, so that callers which keep it
+	// among batches reuse its vectors (see PrankWorkspace::ranks).
+
+	void calculate_kb_ppr_batch(const std::vector<const CSentence *> & css,
+								std::vector<std::vector<float> > & ranks,
+								std::vector<bool> & ok);
+
+	void calculate_kb_ppr_by_word_batch(const CSentence & cs,
+										const std::vector<CSentence::const_iterator> & tgtws,
+										std::vector<std::vector<float> > & ranks,
+										std::vector<bool> & ok);
+
+	void calculate_kb_ppr_batch(const std::vector<const CSentence *> & css,
+								std::vector<std::vector<float> > & ranks,
+								std::vector<bool> & ok,
+								PrankWorkspace & ws);
+
+	void calculate_kb_ppr_by_word_batch(const CSentence & cs,
+										const std::vector<CSentence::const_iterator> & tgtws,
+										std::vector<std::vector<float> > & ranks,
+										std::vector<bool> & ok,
+										PrankWorkspace & ws);
+
 	int calculate_kb_ppr_by_word_and_disamb(CSentence & cs);
 
 	bool calculate_kb_ppv_csentence(CSentence & cs, std::vector<float> & res);
@@ -225,6 +287,9 @@ namespace ukb {
 	bool disamb_csentence_kb(CSentence & cs,
 							 const std::vector<float> & ranks);
 
+	bool disamb_csentence_kb(CSentence & cs,
+							 const Kb_sparse_vector & ranks);
+
 
 	// Functions for calculating initial PV given a CSentence
 
@@ -232,5 +297,9 @@ namespace ukb {
 						 std::vector<float> & pv,
 						 CSentence::const_iterator exclude_word_it);
 
+	int pv_from_cs_onlyC(const CSentence & cs,
+						 Kb_sparse_vector & pv,
+						 CSentence::const_iterator exclude_word_it);
+
 }
 #endif
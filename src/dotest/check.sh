@@ -0,0 +1,112 @@
+# Functions for checking the outputs of a script against reference outputs.
+# Sourced by the scripts under scripts/; check_status is their exit status.
+
+check_failures=0
+
+# same_output name fileA fileB
+# The outputs must be equal, but for the "!!" control lines.
+
+function same_output {
+	if diff -q <(egrep -v "^!!" $2) <(egrep -v "^!!" $3) > /dev/null ; then
+		echo "ok   $1"
+	else
+		echo "FAIL $1: $2 and $3 differ"
+		check_failures=$((check_failures + 1))
+	fi
+}
+
+# same_senses name fileA fileB
+# The outputs must rank the same senses in the same order, whatever their
+# weights.
+
+function same_senses {
+	if diff -q <(egrep -v "^!!" $2 | sed -e 's|/[-0-9.e]*||g') \
+			   <(egrep -v "^!!" $3 | sed -e 's|/[-0-9.e]*||g') > /dev/null ; then
+		echo "ok   $1"
+	else
+		echo "FAIL $1: $2 and $3 rank different senses"
+		check_failures=$((check_failures + 1))
+	fi
+}
+
+# close_ppv name tolerance fileA fileB
+# The L1 distance between two PPV files (vertex, rank) must be at most
+# tolerance.
+
+function close_ppv {
+	local d=$(awk -F '\t' 'FNR == NR { r[$1] = $2; next }
+		{ d = $2 - r[$1]; s += (d < 0 ? -d : d); delete r[$1] }
+		END { for (v in r) s += (r[v] < 0 ? -r[v] : r[v]); printf "%g", s }' $3 $4)
+	if [ -n "$d" ] && awk "BEGIN { exit !($d <= $2) }" ; then
+		echo "ok   $1 (L1 $d)"
+	else
+		echo "FAIL $1: L1 distance $d between $3 and $4 above $2"
+		check_failures=$((check_failures + 1))
+	fi
+}
+
+# fails name command...
+# The command must fail, writing an error message.
+
+function fails {
+	local name=$1
+	shift
+	if "$@" > /dev/null 2> /tmp/ukb_dotest_err.$$ ; then
+		echo "FAIL $name: command succeeded"
+		check_failures=$((check_failures + 1))
+	elif [ ! -s /tmp/ukb_dotest_err.$$ ] ; then
+		echo "FAIL $name: no error message"
+		check_failures=$((check_failures + 1))
+	else
+		echo "ok   $name ($(head -1 /tmp/ukb_dotest_err.$$))"
+	fi
+	rm -f /tmp/ukb_dotest_err.$$
+}
+
+# fails_with name pattern command...
+# The command must fail, writing an error message that matches pattern.
+
+function fails_with {
+	local name=$1
+	local pattern=$2
+	shift 2
+	if "$@" > /dev/null 2> /tmp/ukb_dotest_err.$$ ; then
+		echo "FAIL $name: command succeeded"
+		check_failures=$((check_failures + 1))
+	elif ! egrep -q "$pattern" /tmp/ukb_dotest_err.$$ ; then
+		echo "FAIL $name: error message does not match \"$pattern\": $(head -1 /tmp/ukb_dotest_err.$$)"
+		check_failures=$((check_failures + 1))
+	else
+		echo "ok   $name ($(egrep "$pattern" /tmp/ukb_dotest_err.$$ | head -1))"
+	fi
+	rm -f /tmp/ukb_dotest_err.$$
+}
+
+# no_files name file...
+# None of the files (usually a glob) may exist.
+
+function no_files {
+	local name=$1
+	shift
+	local f
+	for f in "$@"; do
+		if [ -e "$f" ] ; then
+			echo "FAIL $name: $f exists"
+			check_failures=$((check_failures + 1))
+			return
+		fi
+	done
+	echo "ok   $name"
+}
+
+# flip_byte file offset
+# Complement the byte at offset of file.
+
+function flip_byte {
+	local b=$(od -An -tu1 -j $2 -N1 $1)
+	printf "\\$(printf %o $((255 - b)))" | dd of=$1 bs=1 seek=$2 conv=notrunc 2> /dev/null
+}
+
+function check_status {
+	return $((check_failures > 0))
+}
@@ -1,7 +1,9 @@
 #!/bin/bash
 
+status=0
 for scr in scripts/*.sh; do
 	echo $scr
 	j=$(basename ${scr})
-	(cd scripts; bash ./${j})
-done
\ No newline at end of file
+	(cd scripts; bash ./${j}) || status=1
+done
+exit $status
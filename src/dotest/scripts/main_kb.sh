@@ -0,0 +1,120 @@
+#!/bin/bash
+
+. ../check.sh
+
+if [ $# -gt 0 ] ; then
+    ver=$1
+else
+    ver=$(../../compile_kb --version)
+fi
+
+echo $ver
+rootdir=../results/v${ver}
+dir=${rootdir}/main_kb
+install -d $dir
+dict=../input/dict.txt
+ctx=../input/ctx.txt
+graphSrc=../input/test_graph.txt
+
+# The test graph, with weights and some directed relations (so that there
+# are dangling vertices and in-edges without a reverse). KBs compiled or
+# loaded in other ways must give the same results as this one.
+graphW=$dir/test_graph_w.txt
+awk '{ if (NR % 7 == 0) sub(/d:0/, "d:1"); print $0 " w:" (NR % 5 + 1) / 3 }' ${graphSrc} > $graphW
+gbin=$dir/graph_w.bin
+../../compile_kb -o $gbin $graphW
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_w.txt
+
+# The specialized kernels (weighted, with dangling vertices) give the same
+# results one vector at a time, batched, and on several threads
+../../ukb_wsd --nodict_weight --all --ppr -w --prank_batch 1 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_w_nobatch.txt
+../../ukb_wsd --nodict_weight --all --ppr -w --prank_threads 4 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_w_threads.txt
+same_output "weighted kernel, prank_batch 1" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_nobatch.txt
+same_output "weighted kernel, prank_threads 4" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_threads.txt
+
+# Symmetric rows and the overlay of in-edges without a reverse survive both
+# binfile formats, and conversions between them
+../../compile_kb --mmap -o $dir/graph_w_mm.bin $graphW
+../../compile_kb --convert -o $dir/graph_w_mm2stream.bin $dir/graph_w_mm.bin
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_mm.bin ${ctx} > $dir/wsd_ppr_w_mm.txt
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_mm2stream.bin ${ctx} > $dir/wsd_ppr_w_mm2stream.txt
+same_output "mmap binfile" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_mm.txt
+same_output "mmap binfile converted to stream" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_mm2stream.txt
+
+# A corrupted section of an mmap binfile is rejected
+cp $dir/graph_w_mm.bin $dir/graph_w_mm_bad.bin
+flip_byte $dir/graph_w_mm_bad.bin $(($(stat -c %s $dir/graph_w_mm_bad.bin) / 2))
+fails_with "mmap binfile checksum" "Checksum mismatch" ../../ukb_wsd --ppr -D ${dict} -K $dir/graph_w_mm_bad.bin ${ctx}
+
+# A KB in shared memory, with weighted PageRank coefficients (used in
+# place with -w, and recomputed without it). Once removed, it can not be
+# attached.
+shm=ukb_dotest_kb_$$
+../../compile_kb -w --shm_create $shm $gbin
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_now.txt
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} --kb_shm $shm ${ctx} > $dir/wsd_ppr_w_shm.txt
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} --kb_shm $shm ${ctx} > $dir/wsd_ppr_now_shm.txt
+../../compile_kb --shm_remove $shm
+same_output "kb_shm" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_shm.txt
+same_output "kb_shm, coefficients recomputed" $dir/wsd_ppr_now.txt $dir/wsd_ppr_now_shm.txt
+fails_with "kb_shm after shm_remove" "can not open shared memory" ../../ukb_wsd --ppr -D ${dict} --kb_shm $shm ${ctx}
+
+# A delta which removes, reweights and adds relations (one of them to a
+# new vertex) gives the same KB as compiling the edited source. Removing a
+# relation which is not in the KB is an error.
+printf -- "-u:00002684-n\tv:03967942-n\n=u:00002684-n\tv:08408115-n w:7\n+u:00002684-n\tv:14841267-n d:0 w:2\nu:13913849-n\tv:99999999-n d:0 w:3\n" > $dir/delta.txt
+{ sed -e '2d' -e '3s/w:[0-9.]*/w:7/' $graphW; printf "u:00002684-n\tv:14841267-n d:0 w:2\nu:13913849-n\tv:99999999-n d:0 w:3\n"; } > $dir/test_graph_w_delta.txt
+../../compile_kb -o $dir/graph_w_delta_ref.bin $dir/test_graph_w_delta.txt
+../../compile_kb --apply_delta $dir/delta.txt -o $dir/graph_w_delta.bin $gbin
+../../compile_kb --mmap --apply_delta $dir/delta.txt -o $dir/graph_w_mm_delta.bin $dir/graph_w_mm.bin
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_delta_ref.bin ${ctx} > $dir/wsd_ppr_w_delta_ref.txt
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_delta.bin ${ctx} > $dir/wsd_ppr_w_delta.txt
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_mm_delta.bin ${ctx} > $dir/wsd_ppr_w_mm_delta.txt
+same_output "apply_delta" $dir/wsd_ppr_w_delta_ref.txt $dir/wsd_ppr_w_delta.txt
+same_output "apply_delta on mmap binfile" $dir/wsd_ppr_w_delta_ref.txt $dir/wsd_ppr_w_mm_delta.txt
+printf -- "-u:00002684-n\tv:14841267-n\n" > $dir/delta_bad.txt
+fails_with "apply_delta of a missing relation" "No relation between 00002684-n and 14841267-n" \
+	../../compile_kb --apply_delta $dir/delta_bad.txt -o $dir/graph_w_delta_bad.bin $gbin
+
+# Relations parsed on several threads
+../../compile_kb --parse_threads 4 -o $dir/graph_w_pt.bin $graphW
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_pt.bin ${ctx} > $dir/wsd_ppr_w_pt.txt
+same_output "parse_threads 4" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_pt.txt
+
+# Malformed relation lines are reported, with their line number, by the
+# in-memory, multi-threaded and external-memory parsers alike. With
+# --minput they are skipped.
+i=0
+while IFS='|' read -r bad msg; do
+	i=$((i + 1))
+	{ head -50 ${graphSrc}; echo "$bad"; tail -n +51 ${graphSrc}; } > $dir/test_graph_bad$i.txt
+	for opt in "" "--parse_threads 4" "--mem_budget 1"; do
+		fails_with "malformed relation $i${opt:+, $opt}" "$msg.* in line 51" \
+			../../compile_kb $opt -o $dir/graph_bad.bin $dir/test_graph_bad$i.txt
+	done
+done <<LINES
+u:00002684-n v03967942-n|Malformed line: u:00002684-n v03967942-n
+u:00002684-n v:03967942-n x:1|Unknown value x:1
+u:00002684-n v:03967942-n w:abc|bad lexical cast
+u:00002684-n d:0|No target vertex
+u:00002684-n v:03967942-n d:maybe|bad lexical cast
+LINES
+../../compile_kb -o $dir/graph.bin ${graphSrc}
+../../compile_kb --minput -o $dir/graph_minput.bin $dir/test_graph_bad1.txt
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $dir/graph.bin ${ctx} > $dir/wsd_ppr.txt
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $dir/graph_minput.bin ${ctx} > $dir/wsd_ppr_minput.txt
+same_output "minput skips malformed relations" $dir/wsd_ppr.txt $dir/wsd_ppr_minput.txt
+
+# External-memory compilation gives the same KB, and removes its temporary
+# files, also when it fails
+../../compile_kb --mem_budget 1 -o $dir/graph_w_mb.bin $graphW
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w_mb.bin ${ctx} > $dir/wsd_ppr_w_mb.txt
+same_output "mem_budget 1" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w_mb.txt
+no_files "mem_budget temporary files" $dir/graph_w_mb.bin.tmp* $dir/graph_bad.bin.tmp*
+
+# bfloat16 weights
+../../compile_kb --bf16_weights -o $dir/graph_w16.bin $graphW
+../../ukb_wsd --nodict_weight --all --ppr -w -D ${dict} -K $dir/graph_w16.bin ${ctx} > $dir/wsd_ppr_w16.txt
+same_senses "bf16_weights" $dir/wsd_ppr_w.txt $dir/wsd_ppr_w16.txt
+
+check_status
@@ -1,5 +1,7 @@
 #!/bin/bash
 
+. ../check.sh
+
 if [ $# -gt 0 ] ; then
     ver=$1
 else
@@ -22,8 +24,62 @@ graphSrc=../input/test_graph.txt
 ../../ukb_ppv --nodict_weight --variants --prefix pos_C_ -C -O $dir -D ${dict} -K $gbin ${ctx}
 ../../ukb_ppv --nodict_weight --variants --prefix pos_G_ -G -O $dir -D ${dict} -K $gbin ${ctx}
 
+# Pulling the ranks from bfloat16 copies keeps the PPVs within 1% of the
+# float ones.
+../../ukb_ppv --nodict_weight --variants --prefix bf16_ --prank_bf16 -O $dir -D ${dict} -K $gbin ${ctx}
+for ppv_fi in ${dir}/pos_ctx??.ppv; do
+	j=$(basename $ppv_fi | sed -e "s/^pos_//")
+	close_ppv "prank_bf16 $j" 0.01 $ppv_fi ${dir}/bf16_$j
+done
+
+# Monte-Carlo PPVs are estimates, with an L1 error of about 0.3 for 1024
+# fingerprints per vertex.
+../../compile_kb --fingerprints 1024 -o $rootdir/graph_ppv_fp.bin ${graphSrc}
+../../ukb_ppv --nodict_weight --variants --prefix mc_ --prank_mc -O $dir -D ${dict} -K $rootdir/graph_ppv_fp.bin ${ctx}
+for ppv_fi in ${dir}/pos_ctx??.ppv; do
+	j=$(basename $ppv_fi | sed -e "s/^pos_//")
+	close_ppv "prank_mc $j" 0.4 $ppv_fi ${dir}/mc_$j
+done
+
+# PPVs composed from the PPV cache are within their L1 error bound (about
+# 0.13 on the test KB, reported by -v) of the computed ones. Without
+# truncation (all 5000 vertices kept) only solver errors remain.
+../../compile_kb --ppv_cache ../input/ppv_synsets.txt -o $rootdir/graph_ppv.ppvc $gbin
+../../compile_kb --ppv_cache ../input/ppv_synsets.txt --ppv_topk 5000 -o $rootdir/graph_ppv_full.ppvc $gbin
+../../ukb_ppv --nodict_weight --variants --prefix ppvc_ --ppv_cache $rootdir/graph_ppv.ppvc -O $dir -D ${dict} -K $gbin ${ctx}
+../../ukb_ppv --nodict_weight --variants --prefix ppvc_full_ --ppv_cache $rootdir/graph_ppv_full.ppvc -O $dir -D ${dict} -K $gbin ${ctx}
+for ppv_fi in ${dir}/pos_ctx??.ppv; do
+	j=$(basename $ppv_fi | sed -e "s/^pos_//")
+	close_ppv "ppv_cache $j" 0.15 $ppv_fi ${dir}/ppvc_$j
+	close_ppv "ppv_cache (no truncation) $j" 0.01 $ppv_fi ${dir}/ppvc_full_$j
+done
+
+# A PPV cache is rejected if it was computed over another KB with as many
+# vertices, over the KB before a delta was applied to it, or with other
+# PageRank parameters, and if any of its entries is out of bounds.
+sed -e '1s/v:04024396-n/v:03717447-n/' ${graphSrc} > $rootdir/test_graph_ppvc2.txt
+../../compile_kb -o $rootdir/graph_ppvc2.bin $rootdir/test_graph_ppvc2.txt
+fails_with "ppv_cache of another KB" "does not match the KB" \
+	../../ukb_ppv --nodict_weight --prefix rej_ --ppv_cache $rootdir/graph_ppv.ppvc -O $dir -D ${dict} -K $rootdir/graph_ppvc2.bin ${ctx}
+head -1 ${graphSrc} | awk '{print "-" $1 "\t" $2}' > $rootdir/delta_ppvc.txt
+../../compile_kb --apply_delta $rootdir/delta_ppvc.txt -o $rootdir/graph_ppvc_delta.bin $gbin
+fails_with "ppv_cache after apply_delta" "does not match the KB" \
+	../../ukb_ppv --nodict_weight --prefix rej_ --ppv_cache $rootdir/graph_ppv.ppvc -O $dir -D ${dict} -K $rootdir/graph_ppvc_delta.bin ${ctx}
+fails_with "ppv_cache with another damping" "computed with damping 0.85 and" \
+	../../ukb_ppv --nodict_weight --prefix rej_ --prank_damping 0.8 --ppv_cache $rootdir/graph_ppv.ppvc -O $dir -D ${dict} -K $gbin ${ctx}
+fails_with "ppv_cache with edge weights" "and no edge weights" \
+	../../ukb_ppv --nodict_weight --prefix rej_ -w --ppv_cache $rootdir/graph_ppv.ppvc -O $dir -D ${dict} -K $gbin ${ctx}
+# the number of values of the first entry, right after the 64 byte header
+cp $rootdir/graph_ppv.ppvc $rootdir/graph_ppv_bad.ppvc
+flip_byte $rootdir/graph_ppv_bad.ppvc 71
+fails_with "ppv_cache with a corrupt entry" "is corrupt \(entry 0\)" \
+	../../ukb_ppv --nodict_weight --prefix rej_ --ppv_cache $rootdir/graph_ppv_bad.ppvc -O $dir -D ${dict} -K $gbin ${ctx}
+no_files "rejected ppv_cache" ${dir}/rej_*
+
 rm -f ${dir}/*_sorted.ppv >& /dev/null
 for ppv_fi in ${dir}/*.ppv; do
 	j=$(basename $ppv_fi \\\.ppv)
 	sort -k 2 -g -r ${ppv_fi} > ${dir}/${j}_sorted.ppv
 done
+
+check_status
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Concurrent disambiguation: the sessions of an ukb_wsd daemon run at once,
+# each one with its own PageRank workspace over the same Kb. Several clients
+# must get the output of a standalone ukb_wsd.
+
+. ../check.sh
+
+if [ $# -gt 0 ] ; then
+    ver=$1
+else
+    ver=$(../../compile_kb --version)
+fi
+
+echo $ver
+rootdir=../results/v${ver}
+dir=${rootdir}/main_server
+install -d $dir
+gbin=$rootdir/graph.bin
+dict=../input/dict.txt
+ctx=../input/ctx.txt
+graphSrc=../input/test_graph.txt
+clients=4
+rounds=20
+port=$((20000 + $$ % 10000))
+../../compile_kb -o $gbin ${graphSrc}
+
+for ctx_i in $(seq $rounds); do cat $ctx; done > $dir/ctx_rounds.txt
+for method in ppr ppr_w2w; do
+	../../ukb_wsd --nodict_weight --all --${method} -D ${dict} -K $gbin ${ctx} > $dir/wsd_${method}.txt
+	for ctx_i in $(seq $rounds); do egrep -v "^!!" $dir/wsd_${method}.txt; done > $dir/wsd_${method}_rounds.txt
+	../../ukb_wsd --daemon --port $port --nodict_weight --all --${method} -D ${dict} -K $gbin > /dev/null
+	for client_i in $(seq $clients); do
+		../../ukb_wsd --client --port $port $dir/ctx_rounds.txt > $dir/wsd_${method}_client${client_i}.txt &
+	done
+	wait
+	../../ukb_wsd --shutdown --port $port 2> /dev/null
+	for client_i in $(seq $clients); do
+		same_output "daemon --${method} client ${client_i}" $dir/wsd_${method}_rounds.txt $dir/wsd_${method}_client${client_i}.txt
+	done
+	port=$((port + 1))
+done
+rm -f $dir/*_rounds.txt
+
+check_status
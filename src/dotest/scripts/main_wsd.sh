@@ -1,5 +1,7 @@
 #!/bin/bash
 
+. ../check.sh
+
 if [ $# -gt 0 ] ; then
     ver=$1
 else
@@ -18,9 +20,63 @@ graphSrc=../input/test_graph.txt
 ../../compile_kb -o $gbin ${graphSrc}
 ../../ukb_wsd --nodict_weight --all --ppr_w2w -D ${dict} -K $gbin ${ctx} > $dir/wsd_w2w.txt
 ../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_threads 4 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_threads.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_batch 1 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_nobatch.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_bf16 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_bf16.txt
+same_senses "prank_bf16" $dir/wsd_ppr.txt $dir/wsd_ppr_bf16.txt
+../../ukb_wsd --nodict_weight --all --ppr_w2w --prank_nibble -D ${dict} -K $gbin ${ctx} > $dir/wsd_w2w_nibble.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_adaptive -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_adaptive.txt
+# Gauss-Seidel and SOR converge to the same ranks, up to the threshold
+../../ukb_wsd --nodict_weight --all --ppr --prank_gs -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_gs.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_sor 1.2 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_sor.txt
+same_senses "prank_gs" $dir/wsd_ppr.txt $dir/wsd_ppr_gs.txt
+same_senses "prank_sor" $dir/wsd_ppr.txt $dir/wsd_ppr_sor.txt
+# Warm starts and Aitken extrapolation change the iterates, not the ranks
+../../ukb_wsd --nodict_weight --all --ppr --prank_init prev -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_init_prev.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_init static -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_init_static.txt
+../../ukb_wsd --nodict_weight --all --ppr --prank_aitken 5 -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_aitken.txt
+same_senses "prank_init prev" $dir/wsd_ppr.txt $dir/wsd_ppr_init_prev.txt
+same_senses "prank_init static" $dir/wsd_ppr.txt $dir/wsd_ppr_init_static.txt
+same_senses "prank_aitken" $dir/wsd_ppr.txt $dir/wsd_ppr_aitken.txt
+../../compile_kb --fingerprints 256 -o $rootdir/graph_fp.bin ${graphSrc}
+../../ukb_wsd --nodict_weight --all --ppr_w2w --prank_mc -D ${dict} -K $rootdir/graph_fp.bin ${ctx} > $dir/wsd_w2w_mc.txt
+# Fingerprints of another KB with as many vertices are rejected, and a KB
+# in shared memory needs an explicit fingerprint file.
+sed -e '1s/v:04024396-n/v:03717447-n/' ${graphSrc} > $rootdir/test_graph_fp2.txt
+../../compile_kb --fingerprints 16 -o $rootdir/graph_fp2.bin $rootdir/test_graph_fp2.txt
+fails "prank_mc with fingerprints of another KB" ../../ukb_wsd --nodict_weight --ppr_w2w --prank_mc --fp_file $rootdir/graph_fp2.bin.fp -D ${dict} -K $rootdir/graph_fp.bin ${ctx}
+../../compile_kb --shm_create ukb_dotest_fp $gbin
+fails "prank_mc on kb_shm without fp_file" ../../ukb_wsd --nodict_weight --ppr_w2w --prank_mc --kb_shm ukb_dotest_fp -D ${dict} ${ctx}
+../../compile_kb --shm_remove ukb_dotest_fp
+
+# ukb_wsd and ukb_ppv reject invalid PageRank options alike, with the same
+# exit code
+for prog in ukb_wsd ukb_ppv; do
+	fails_with "$prog, invalid prank_damping" "invalid prank_damping value 2" ../../$prog --prank_damping 2 -D ${dict} -K $gbin ${ctx}
+	fails_with "$prog, invalid prank_aitken" "prank_aitken must be at least 3" ../../$prog --prank_aitken 1 -D ${dict} -K $gbin ${ctx}
+	../../$prog --prank_batch 0 -D ${dict} -K $gbin ${ctx} >& /dev/null
+	rc=$?
+	if [ $rc != 255 ] ; then
+		echo "FAIL $prog, exit code of invalid prank_batch: $rc"
+		check_failures=$((check_failures + 1))
+	fi
+done
+../../compile_kb --ppv_cache ../input/ppv_synsets.txt -o $rootdir/graph.ppvc $gbin
+../../ukb_wsd --nodict_weight --all --ppr --ppv_cache $rootdir/graph.ppvc -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_ppvc.txt
+../../compile_kb --reorder rabbit -o $rootdir/graph_rabbit.bin ${graphSrc}
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $rootdir/graph_rabbit.bin ${ctx} > $dir/wsd_ppr_rabbit.txt
+../../compile_kb --convert --mmap -o $rootdir/graph_mm.bin $gbin
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $rootdir/graph_mm.bin ${ctx} > $dir/wsd_ppr_mmap.txt
+same_output "mmap binfile" $dir/wsd_ppr.txt $dir/wsd_ppr_mmap.txt
+# A mapped binfile can be rewritten in place
+../../compile_kb --convert --mmap -o $rootdir/graph_mm.bin $rootdir/graph_mm.bin
+../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $rootdir/graph_mm.bin ${ctx} > $dir/wsd_ppr_mmap2.txt
+same_output "mmap binfile converted in place" $dir/wsd_ppr.txt $dir/wsd_ppr_mmap2.txt
 ../../ukb_wsd --nodict_weight --all --ppr -D ${dict} -K $gbin ${ctx_dos} > $dir/wsd_dos_ppr.txt
 ../../ukb_wsd --dict_weight --all --ppr -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_dictweight.txt
 ../../ukb_wsd --dict_weight --all --ppr_w2w -D ${dict} -K $gbin ${ctx} > $dir/wsd_w2w_dictweight.txt
 ../../ukb_wsd --dict_weight --all --ppr_w2w --nopos -D ${dict} -K $gbin ${ctx} > $dir/wsd_w2w_nopos_dictweight.txt
 ../../ukb_wsd --dict_weight --all --ppr --nopos -D ${dict} -K $gbin ${ctx} > $dir/wsd_ppr_nopos_dictweight.txt
 ../../ukb_wsd --nodict_weight --all --static -D ${dict} -K $gbin ${ctx} > $dir/wsd_static.txt
+
+check_status
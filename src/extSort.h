@@ -0,0 +1,202 @@
+// -*-C++-*-
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+
+#include <boost/lexical_cast.hpp>
+
+// External sort of records (plain structs), for more records than fit in
+// memory.
+//
+// Records are pushed into a buffer. When the buffer is full, it is sorted
+// and written to a temporary file (a run). finish merges the runs (in
+// several passes, if there are too many to merge at once), and next then
+// returns the records in order. If no run was written, the records are
+// sorted and returned from memory.
+//
+// The buffer, and the blocks read from the runs when merging, take at most
+// the memory given (see set_memory). Runs are named prefix.N, and are
+// removed once merged, or when the sorter is destroyed. Records which
+// compare equal come in unspecified order.
+
+namespace ukb {
+
+	template<typename T, typename Less = std::less<T> >
+	class ExtSorter {
+
+	public:
+
+		ExtSorter(const std::string & prefix, size_t mem_bytes, Less lt = Less())
+			: m_prefix(prefix), m_mem(0), m_lt(lt), m_n(0), m_run_id(0), m_pos(0) {
+			set_memory(mem_bytes);
+		}
+
+		~ExtSorter() {
+			close_readers();
+			for(size_t i = 0; i != m_runs.size(); ++i)
+				std::remove(m_runs[i].c_str());
+		}
+
+		// Memory for the buffer and the merge blocks, from now on
+
+		void set_memory(size_t mem_bytes) {
+			m_mem = std::max(mem_bytes, min_block * 2);
+		}
+
+		void push(const T & x) {
+			// reserved once, so that it never reallocates (pages are only
+			// used as they are written)
+			if (m_buf.capacity() == 0) m_buf.reserve(m_mem / sizeof(T) + 1);
+			if (m_buf.size() * sizeof(T) >= m_mem) spill();
+			m_buf.push_back(x);
+			++m_n;
+		}
+
+		// Write the buffer as a run now (to make room for others)
+
+		void spill() {
+			if (m_buf.empty()) return;
+			std::sort(m_buf.begin(), m_buf.end(), m_lt);
+			std::string fname(new_run());
+			std::ofstream fo(fname.c_str(), std::ofstream::binary|std::ofstream::out);
+			fo.write(reinterpret_cast<const char *>(&m_buf[0]), m_buf.size() * sizeof(T));
+			if (!fo) throw std::runtime_error("[E] can not write temporary file " + fname);
+			m_buf.clear();
+		}
+
+		// No more records. Prepare to read them in order, within the
+		// memory given now.
+
+		void finish() {
+			if (m_runs.empty() && memory() <= m_mem) {
+				std::sort(m_buf.begin(), m_buf.end(), m_lt);
+				m_pos = 0;
+				return;
+			}
+			spill();
+			std::vector<T>().swap(m_buf);
+			size_t fan_in = std::max(size_t(2), m_mem / min_block);
+			while(m_runs.size() > fan_in) {
+				// merge the oldest runs into a new one. Until it is written,
+				// both are in m_runs, so they are removed if this throws.
+				std::vector<std::string> in(m_runs.begin(), m_runs.begin() + fan_in);
+				open_readers(in);
+				std::string fname(new_run());
+				std::ofstream fo(fname.c_str(), std::ofstream::binary|std::ofstream::out);
+				T x;
+				while(merge_next(x))
+					fo.write(reinterpret_cast<const char *>(&x), sizeof(T));
+				fo.close();
+				if (!fo) throw std::runtime_error("[E] can not write temporary file " + fname);
+				close_readers();
+				m_runs.erase(m_runs.begin(), m_runs.begin() + fan_in);
+				for(size_t i = 0; i != in.size(); ++i)
+					std::remove(in[i].c_str());
+			}
+			open_readers(m_runs);
+		}
+
+		// Next record in order, if any
+
+		bool next(T & x) {
+			if (!m_readers.empty()) return merge_next(x);
+			if (m_pos == m_buf.size()) return false;
+			x = m_buf[m_pos++];
+			return true;
+		}
+
+		size_t size() const { return m_n; }          // records pushed
+		size_t runs() const { return m_run_id; }     // runs written (merges included)
+		size_t memory() const { return m_buf.size() * sizeof(T); }
+
+	private:
+
+		static const size_t min_block = 1 << 16;
+
+		struct reader {
+			std::ifstream is;
+			std::vector<T> block;
+			size_t pos;
+		};
+
+		// heap of (record, reader), with the least record on top
+		typedef std::pair<T, size_t> head_t;
+
+		struct head_greater {
+			Less lt;
+			head_greater(Less l) : lt(l) {}
+			bool operator()(const head_t & a, const head_t & b) const {
+				if (lt(b.first, a.first)) return true;
+				if (lt(a.first, b.first)) return false;
+				return a.second > b.second;
+			}
+		};
+
+		std::string new_run() {
+			m_runs.push_back(m_prefix + "." + boost::lexical_cast<std::string>(m_run_id++));
+			return m_runs.back();
+		}
+
+		bool fill(reader & r) {
+			r.is.read(reinterpret_cast<char *>(&r.block[0]), r.block.size() * sizeof(T));
+			size_t n = r.is.gcount() / sizeof(T);
+			r.pos = 0;
+			if (n != r.block.size()) r.block.resize(n);
+			return n != 0;
+		}
+
+		void open_readers(const std::vector<std::string> & runs) {
+			size_t block_n = std::max(size_t(1), m_mem / runs.size() / sizeof(T));
+			for(size_t i = 0; i != runs.size(); ++i) {
+				reader *r = new reader;
+				m_readers.push_back(r);
+				r->is.open(runs[i].c_str(), std::ifstream::binary|std::ifstream::in);
+				if (!r->is) throw std::runtime_error("[E] can not read temporary file " + runs[i]);
+				r->block.resize(block_n);
+				if (fill(*r)) m_heap.push_back(head_t(r->block[0], i));
+			}
+			std::make_heap(m_heap.begin(), m_heap.end(), head_greater(m_lt));
+		}
+
+		void close_readers() {
+			for(size_t i = 0; i != m_readers.size(); ++i)
+				delete m_readers[i];
+			m_readers.clear();
+			m_heap.clear();
+		}
+
+		bool merge_next(T & x) {
+			if (m_heap.empty()) return false;
+			std::pop_heap(m_heap.begin(), m_heap.end(), head_greater(m_lt));
+			x = m_heap.back().first;
+			size_t i = m_heap.back().second;
+			m_heap.pop_back();
+			reader & r = *m_readers[i];
+			if (++r.pos != r.block.size() || fill(r)) {
+				m_heap.push_back(head_t(r.block[r.pos], i));
+				std::push_heap(m_heap.begin(), m_heap.end(), head_greater(m_lt));
+			}
+			return true;
+		}
+
+		std::string m_prefix;
+		size_t m_mem;
+		Less m_lt;
+		size_t m_n;
+		size_t m_run_id;
+		std::vector<std::string> m_runs;  // runs not merged yet
+		std::vector<T> m_buf;
+		size_t m_pos;
+		std::vector<reader *> m_readers;
+		std::vector<head_t> m_heap;
+	};
+}
+#endif
@@ -64,6 +64,15 @@ namespace ukb {
 			float damping = 0.85; // damping factor
 			PrankImpl impl = pm; // default is power method
 			float nibble_epsilon = 0.0000005;
+			float sor_omega = 1.0;
+			float adaptive_tol = 0.0;
+			PrankInit init = init_uniform;
+			size_t aitken_period = 0;
+			size_t num_threads = 1;
+			size_t batch_size = 8;
+			bool bf16_ranks = false;
+			std::string fp_fname;
+			std::string ppv_cache_fname;
 		}
 
 		namespace input {
@@ -83,10 +92,16 @@ namespace ukb {
 
 		namespace kb {
 			std::string fname;
+			std::string shm_name;
 			bool keep_reltypes = false;
 			bool keep_directed = true;
 			bool v1_kb = true;
 			bool filter_src = true;
+			bool bf16_weights = false;
+			bool mmap_format = false;
+			KbReorder reorder = reorder_none;
+			size_t parse_threads = 1;
+			size_t mem_budget = size_t(1) << 30;
 		}
 
 		namespace dGraph {
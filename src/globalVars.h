@@ -41,7 +41,24 @@ namespace ukb {
 
 		enum PrankImpl {
 			pm,          // power method, default
-			nibble       // PageRank-Nibble approximation
+			nibble,      // PageRank-Nibble approximation
+			gs,          // Gauss-Seidel (optionally SOR)
+			mc,          // Monte-Carlo approximation from random walk fingerprints
+			adaptive     // power method which freezes converged vertices
+		};
+
+		enum PrankInit {
+			init_uniform, // start iterating from the uniform vector, default
+			init_prev,    // start from the previous PPV (warm start)
+			init_static   // start from the static PageRank vector (warm start)
+		};
+
+		enum KbReorder {
+			reorder_none,   // keep vertices in input order, default
+			reorder_degree, // by decreasing degree
+			reorder_rcm,    // reverse Cuthill-McKee
+			reorder_bfs,    // breadth-first order
+			reorder_rabbit  // community order (Rabbit Order)
 		};
 
 		extern std::vector<std::string> rel_source;
@@ -74,6 +91,15 @@ namespace ukb {
 			extern float damping;
 			extern PrankImpl impl; // default is power method
 			extern float nibble_epsilon;
+			extern float sor_omega; // relaxation factor for Gauss-Seidel (1.0 means no relaxation)
+			extern float adaptive_tol; // adaptive PageRank freezes vertices changing less than this (0 means threshold / N)
+			extern PrankInit init; // initial vector of iterations
+			extern size_t aitken_period; // apply Aitken extrapolation every aitken_period iterations (0 means never)
+			extern size_t num_threads; // threads used by the power method
+			extern size_t batch_size;  // how many PPVs are computed at once
+			extern bool bf16_ranks;    // pull batched ranks from a bfloat16 copy
+			extern std::string fp_fname; // fingerprint file for the mc method (default is KB binfile + ".fp")
+			extern std::string ppv_cache_fname; // file of precomputed PPVs (see PpvCache)
 		}
 
 		// Input
@@ -97,10 +123,16 @@ namespace ukb {
 
 		namespace kb {
 			extern std::string fname; // Name of the compiled graph
+			extern std::string shm_name; // Shared-memory segment of the graph, used instead of fname (see Kb::attach_shared)
 			extern bool keep_reltypes; // Wether edges locally keep the relation types
 			extern bool v1_kb; // Wether input has v1 format
 			extern bool filter_src; // Wether input relations should be filtered by relation source
 			extern bool keep_directed; // Wether we will allow directed edges (default true)
+			extern bool bf16_weights; // Wether edge weights are written as bfloat16 in binfiles
+			extern bool mmap_format; // Wether binfiles are written in the aligned, memory-mapped format
+			extern KbReorder reorder; // How to relabel vertices when compiling the graph
+			extern size_t parse_threads; // Threads used for parsing text relation files (see Kb::read_from_txt)
+			extern size_t mem_budget; // Memory (bytes) for compiling text relation files out of memory (see Kb::compile_from_txt)
 		}
 
 		namespace dGraph {
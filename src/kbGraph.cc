@@ -2,22 +2,41 @@
 #include "common.h"
 #include "globalVars.h"
 #include "prank.h"
+#include "textScan.h"
+#include "extSort.h"
 
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <cstdio>
 #include <vector>
 #include <list>
 #include <string>
 #include <map>
+#include <queue>
 #include <iterator>
 #include <algorithm>
 #include <ostream>
+#include <sstream>
+#include <limits>
+#include <cstring>
+#include <cmath>
 
 // Tokenizer
 #include <boost/tokenizer.hpp>
 #include <boost/lexical_cast.hpp>
 
+// Memory-mapped binfiles
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+// Binfile checksums and load profile
+#include <boost/crc.hpp>
+#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 // Stuff for generating random numbers
 
 #include <boost/random/linear_congruential.hpp>
@@ -46,6 +65,11 @@
 
 #include <boost/graph/strong_components.hpp>
 
+// boost graph of mapped KBs (see Kb::boost_graph)
+
+#include <boost/bind.hpp>
+#include <boost/thread/once.hpp>
+
 
 namespace ukb {
 
@@ -61,6 +85,11 @@ namespace ukb {
 
 	Kb* Kb::p_instance = 0;
 
+	static const size_t magic_id_mm = 0x261023; // aligned format (see read_from_mapfile)
+	static const size_t magic_id_mm_v3 = 0x261022; // same, without section checksums
+	static const size_t magic_id_mm_v2 = 0x261021; // same as v3, with a backward CSR instead of symmetric in-edges
+	static const size_t magic_id_mm_v1 = 0x261020; // same as v2, with 64 bit indices and no index_bits
+
 	Kb *Kb::create() {
 
 		static Kb theKb;
@@ -98,15 +127,41 @@ namespace ukb {
 		if (!fname.size())
 			throw std::runtime_error(string("[E] loading KB: no KB name"));
 
-		ifstream fi(fname.c_str(), ifstream::binary|ifstream::in);
+		// Read through a large buffer. The default one (a few KB) means
+		// a system call for every few vertex names.
+		vector<char> buf(4 << 20);
+		ifstream fi;
+		fi.rdbuf()->pubsetbuf(&buf[0], buf.size());
+		fi.open(fname.c_str(), ifstream::binary|ifstream::in);
 		if (!fi)
 			throw std::runtime_error(string("[E] loading KB: can not open ") + fname);
 
-		tenp->read_from_stream(fi);
+		size_t id = 0;
+		read_atom_from_stream(fi, id);
+		if (id == magic_id_mm || id == magic_id_mm_v3 || id == magic_id_mm_v2 || id == magic_id_mm_v1) {
+			fi.close();
+			tenp->read_from_mapfile(fname);
+		} else {
+			fi.seekg(0);
+			tenp->read_from_stream(fi);
+		}
 		p_instance = tenp;
 	}
 
 
+	// Build the CSR graph of pre, checking that it fits in Kb_index_t
+
+	static KbGraph *new_kb_graph(const precsr_t & pre) {
+
+		size_t max_n = std::numeric_limits<Kb_index_t>::max();
+		if (pre.m_vsize >= max_n || pre.E.size() >= max_n)
+			throw runtime_error("[E] KB too large for " + lexical_cast<string>(sizeof(Kb_index_t) * 8) +
+								" bit indices (build with -DUKB_KB_INDEX64)");
+		return new KbGraph(boost::edges_are_unsorted_multi_pass,
+						   pre.E.begin(), pre.E.end(),
+						   pre.m_vsize);
+	}
+
 	void Kb::create_from_kbgraph16(Kb16 & kbg) {
 		if (p_instance) return;
 		Kb *tenp = create();
@@ -121,29 +176,24 @@ namespace ukb {
 			precsr16.insert_edge(ustr, vstr, get(edge_weight, oldg, *eit), get(edge_rtype, oldg, *eit));
 		}
 
-		KbGraph *new_g = new KbGraph(boost::edges_are_unsorted_multi_pass,
-									 precsr16.E.begin(), precsr16.E.end(),
-									 precsr16.eProp.begin(),
-									 precsr16.m_vsize);
+		tenp->m_g.reset(new_kb_graph(precsr16));
+		tenp->init_edge_props(precsr16);
+		tenp->init_in_edges();
 
-		tenp->m_g.reset(new_g);
-
-		BGL_FORALL_VERTICES(v, *(tenp->m_g), Kb::boost_graph_t) {
-			(*(tenp->m_g))[v].name = precsr16.vProp[v].name;
-		}
 
 		tenp->m_vertexN = num_vertices(*(tenp->m_g));
 		tenp->m_edgeN = num_edges(*(tenp->m_g));
 		// relation sources
 		std::set<std::string>(kbg.relsSource).swap(tenp->m_relsSource);
-		// vertex map
-		tenp->m_synsetMap.swap(precsr16.m_vMap);
+		// vertex names and map
+		tenp->init_name_index(precsr16.vProp);
 		// relation types
 		tenp->m_rtypes.m_strtypes.swap(kbg.rtypes);
 		// Notes
 		tenp->m_notes = kbg.notes;
 		tenp->m_notes.push_back("--");
 		tenp->m_notes.push_back("converted_to_2.0");
+		tenp->init_prank();
 
 		p_instance = tenp;
 	}
@@ -163,48 +213,35 @@ namespace ukb {
 	////////////////////////////////////////////////////////////////////////////////
 	// bfs
 
-	struct kb_bfs_init:public base_visitor<kb_bfs_init> {
-	public:
-		kb_bfs_init(Kb_vertex_t *v):m_v(v) { }
-		typedef on_initialize_vertex event_filter;
-		inline void operator()(Kb_vertex_t u, const KbGraph & g)
-		{
-			m_v[u] = u;
-		}
-		Kb_vertex_t *m_v;
-	};
-
-	struct kb_bfs_pred:public base_visitor<kb_bfs_pred> {
-	public:
-		kb_bfs_pred(Kb_vertex_t *v):m_v(v) { }
-		typedef on_tree_edge event_filter;
-		inline void operator()(Kb_edge_t e, const KbGraph & g) {
-			m_v[target(e, g)] = source(e, g);
-		}
-		Kb_vertex_t *m_v;
-	};
-
-
 	// Note:
 	//
 	// after bfs, if (parents[v] == v) and (v != u), then u and v are not
 	// connected in the graph.
+	//
+	// The search follows the forward CSR in place (the same tree as
+	// breadth_first_search over the boost graph), so it does not need the
+	// boost graph of mapped KBs.
 
 	bool Kb::bfs(Kb_vertex_t src,
 				 std::vector<Kb_vertex_t> & parents) const {
 
-		size_t m = num_vertices(*m_g);
-		if(parents.size() == m) {
-			std::fill(parents.begin(), parents.end(), Kb_vertex_t());
-		} else {
-			vector<Kb_vertex_t>(m).swap(parents);  // reset parents
+		size_t m = m_vertexN;
+		if(parents.size() != m) vector<Kb_vertex_t>(m).swap(parents);
+		for(size_t v = 0; v != m; ++v) parents[v] = v;
+
+		vector<char> seen(m, 0);
+		vector<Kb_vertex_t> Q(1, src);
+		seen[src] = 1;
+		for(size_t head = 0; head != Q.size(); ++head) {
+			Kb_vertex_t u = Q[head];
+			for(Kb_index_t i = m_rowstart[u], i_end = m_rowstart[u + 1]; i != i_end; ++i) {
+				Kb_vertex_t v = m_column[i];
+				if (seen[v]) continue;
+				seen[v] = 1;
+				parents[v] = u;
+				Q.push_back(v);
+			}
 		}
-
-		breadth_first_search(*m_g,
-							 src,
-							 boost::visitor(boost::make_bfs_visitor
-											(boost::make_list(kb_bfs_init(&parents[0]),
-															  kb_bfs_pred(&parents[0])))));
 		return true;
 	}
 
@@ -212,26 +249,25 @@ namespace ukb {
 	bool Kb::dijkstra (Kb_vertex_t src,
 					   std::vector<Kb_vertex_t> & parents) const {
 
-		size_t m = num_vertices(*m_g);
+		const KbGraph & g = boost_graph();
+		size_t m = m_vertexN;
 		if(parents.size() == m) {
 			std::fill(parents.begin(), parents.end(), Kb_vertex_t());
 		} else {
 			vector<Kb_vertex_t>(m).swap(parents);  // reset parents
 		}
 
-		// Hack to remove const-ness
-		Kb & me = const_cast<Kb &>(*this);
 		vector<float> w;
 		vector<float> dist(m);
-		property_map<Kb::boost_graph_t, boost::vertex_index_t>::type indexmap = get(vertex_index, *m_g);
-		property_map<Kb::boost_graph_t, float edge_prop_t::*>::type wmap = get(&edge_prop_t::weight, *(me.m_g));
+		property_map<Kb::boost_graph_t, boost::vertex_index_t>::type indexmap = get(vertex_index, g);
+		Kb_weight_map_t wmap = weight_map();
 
-		dijkstra_shortest_paths(*m_g,
+		dijkstra_shortest_paths(g,
 								src,
 								predecessor_map(make_iterator_property_map(parents.begin(),
-																		   get(vertex_index, *m_g))).
+																		   get(vertex_index, g))).
 								distance_map(make_iterator_property_map(dist.begin(),
-																		get(vertex_index, *m_g))).
+																		get(vertex_index, g))).
 								weight_map(wmap).
 								vertex_index_map(indexmap));
 
@@ -336,7 +372,7 @@ namespace ukb {
 		bfs_subg_visitor vis(sg, u, limit);
 
 		try {
-			breadth_first_search(*m_g, u, boost::visitor(vis));
+			breadth_first_search(boost_graph(), u, boost::visitor(vis));
 		} catch (bfs_subg_terminate & ) {}
 
 		size_t N = sg.V.size();
@@ -344,11 +380,11 @@ namespace ukb {
 		vector<vector<string> >(N).swap(E);
 
 		for(size_t i=0; i < N; ++i) {
-			V[i] = (*m_g)[sg.V[i]].name;
+			V[i] = get_vertex_name(sg.V[i]);
 			size_t m = sg.E[i].size();
 			vector<string> l(m);
 			for(size_t j=0; j < m; ++j) {
-				l[j] =  (*m_g)[sg.E[i].at(j)].name;
+				l[j] =  get_vertex_name(sg.E[i].at(j));
 			}
 			E[i].swap(l);
 		}
@@ -389,78 +425,280 @@ namespace ukb {
 	// strings <-> vertex_id
 
 	pair<Kb_vertex_t, bool> Kb::get_vertex_by_name(const std::string & str) const {
-		map<string, Kb_vertex_t>::const_iterator it;
-
-		it = m_synsetMap.find(str);
-		if (it != m_synsetMap.end()) return make_pair(it->second, true);
+		pair<size_t, bool> r = m_names.find(str);
+		if (r.second) return make_pair(Kb_vertex_t(r.first), true);
 		return make_pair(Kb_vertex_t(), false);
 	}
 
+	// Build the name index from the names of the vertices
+
+	void Kb::init_name_index(const vector<vertex_prop_t> & vProp) {
+
+		NameIndex idx;
+		size_t chars_n = 0;
+		for(size_t i = 0, m = vProp.size(); i != m; ++i)
+			chars_n += vProp[i].name.size();
+		idx.reserve(vProp.size(), chars_n);
+		for(size_t i = 0, m = vProp.size(); i != m; ++i)
+			idx.push_back(vProp[i].name);
+		idx.build_table();
+		m_names.swap(idx);
+	}
+
+	// Lay out the edge properties of pre in the order of the forward CSR.
+	// The graph places the edges of each source vertex in input order
+	// (stable histogram sort), and so does this.
+
+	void Kb::init_edge_props(const precsr_t & pre) {
+
+		size_t n = pre.E.size();
+		vector<size_t> pos(m_g->m_forward.m_rowstart.begin(), m_g->m_forward.m_rowstart.end() - 1);
+		vector<float> eweight(n);
+		vector<etype_t::value_type> etype(n);
+		for(size_t i = 0; i != n; ++i) {
+			size_t j = pos[pre.E[i].first]++;
+			eweight[j] = pre.eProp[i].weight;
+			etype[j] = pre.eProp[i].etype;
+		}
+		m_eweight.swap(eweight);
+		m_etype.swap(etype);
+	}
+
 	void Kb::edge_add_reltype(Kb_edge_t e, const string & rel) {
-		m_rtypes.add_type(rel, (*m_g)[e].etype);
+		m_rtypes.add_type(rel, m_etype.own()[e.idx]);
 	}
 
 	std::vector<std::string> Kb::edge_reltypes(Kb_edge_t e) const {
-		return m_rtypes.tvector((*m_g)[e].etype);
+		return m_rtypes.tvector(m_etype[e.idx]);
 	}
 
 	float Kb::get_edge_weight(Kb_edge_t e) const {
 		if (!glVars::prank::use_weight) return 1.0f;
-		return (*m_g)[e].weight;
+		return m_eweight[e.idx];
 	}
 
 	void Kb::set_edge_weight(Kb_edge_t e, float w) {
-		(*m_g)[e].weight = w;
+		m_eweight.own()[e.idx] = w;
+		MappedArray<float>().swap(m_in_coefs); // transition coefs are stale (see refresh_prank)
+		vector<float>().swap(m_static_ppv);
+	}
+
+	Kb_weight_map_t Kb::weight_map() const {
+		return Kb_weight_map_t(m_eweight.begin(), property_map<KbGraph, boost::edge_index_t>::const_type());
 	}
 
 	std::pair<Kb_out_edge_iter_t, Kb_out_edge_iter_t> Kb::out_neighbors(Kb_vertex_t u) {
-		return out_edges(u, *m_g);
+		return std::make_pair(Kb_out_edge_iter_t(Kb_edge_t(u, m_rowstart[u])),
+							  Kb_out_edge_iter_t(Kb_edge_t(u, m_rowstart[u + 1])));
 	}
 
-	std::pair<Kb_in_edge_iter_t, Kb_in_edge_iter_t> Kb::in_neighbors(Kb_vertex_t u) {
-		return in_edges(u, *m_g);
+	void Kb::in_edges(Kb_vertex_t v, vector<Kb_edge_t> & E) const {
+
+		const MappedArray<Kb_index_t> & rowstart = m_rowstart;
+		const MappedArray<Kb_vertex_t> & column = m_column;
+		E.clear();
+		for(Kb_index_t i = rowstart[v], i_end = m_sym_end[v]; i != i_end; ++i) {
+			// the reverse of v->u is among the symmetric out-edges of u
+			Kb_vertex_t u = column[i];
+			Kb_index_t j = rowstart[u];
+			while(column[j] != v) ++j;
+			E.push_back(Kb_edge_t(u, j));
+		}
+		for(Kb_index_t i = m_ovl_rowstart[v], i_end = m_ovl_rowstart[v + 1]; i != i_end; ++i) {
+			E.push_back(Kb_edge_t(m_ovl_column[i], m_ovl_edge[i]));
+		}
 	}
 
+	size_t Kb::in_degree(Kb_vertex_t v) const {
+		return (m_sym_end[v] - m_rowstart[v]) +
+			(m_ovl_rowstart[v + 1] - m_ovl_rowstart[v]);
+	}
 
 	////////////////////////////////////////////////////////////////////////////////
-	// Query and retrieval
-
-	// filter_mode
-	//   0 -> no filter
-	//   1 -> only words
-	//   2 -> only concepts
-
+	// In-edges
+	//
+	// An edge u->v is symmetric if its reverse v->u is in the graph as well.
+	// The in-edge u->v of v is then read from the forward row of v, as the
+	// out-edge v->u, and it is not stored again. Every in-edge without a
+	// reverse goes to the overlay, a CSR of its own with the source and the
+	// edge index of each in-edge.
+	//
+	// init_in_edges moves the symmetric out-edges of every vertex to the
+	// front of its forward row, keeping their order, and permutes the edge
+	// properties along. KBs of undirected relations only have symmetric
+	// edges: their forward rows do not change, and the overlay is empty.
+
+	void Kb::init_in_edges() {
+
+		KbGraph & g = boost_graph();
+		const vector<Kb_index_t> & rowstart = g.m_forward.m_rowstart;
+		vector<Kb_vertex_t> & column = g.m_forward.m_column;
+		size_t V = num_vertices(g);
+		size_t E = column.size();
+
+		// in-edges of every vertex, by source (counting sort over targets)
+		vector<Kb_index_t> in_row(V + 1, 0);
+		for(size_t i = 0; i != E; ++i) ++in_row[column[i] + 1];
+		for(size_t v = 0; v != V; ++v) in_row[v + 1] += in_row[v];
+		vector<Kb_vertex_t> in_src(E);
+		vector<Kb_index_t> in_edge(E);
+		{
+			vector<Kb_index_t> pos(in_row.begin(), in_row.end() - 1);
+			for(size_t u = 0; u != V; ++u) {
+				for(Kb_index_t i = rowstart[u]; i != rowstart[u + 1]; ++i) {
+					Kb_index_t k = pos[column[i]]++;
+					in_src[k] = u;
+					in_edge[k] = i;
+				}
+			}
+		}
 
-	void vname_filter(const map<string, Kb_vertex_t> & theMap,
-					  const vector<float> & ranks,
-					  const KbGraph & g,
-					  vector<float> & outranks,
-					  vector<string> & vnames) {
+		// Match the out-edges v->u of every vertex with its in-edges u->v,
+		// both sorted by u. Repeated edges are matched in index order.
+		vector<char> sym(E, 0);
+		vector<Kb_index_t> ovl_rowstart(V + 1, 0);
+		vector<Kb_vertex_t> ovl_column;
+		vector<Kb_index_t> ovl_edge;
+		vector<std::pair<Kb_vertex_t, Kb_index_t> > out;
+		for(size_t v = 0; v != V; ++v) {
+			out.clear();
+			for(Kb_index_t i = rowstart[v]; i != rowstart[v + 1]; ++i)
+				out.push_back(std::make_pair(column[i], i));
+			std::sort(out.begin(), out.end());
+			vector<std::pair<Kb_vertex_t, Kb_index_t> >::const_iterator it = out.begin();
+			for(Kb_index_t k = in_row[v]; k != in_row[v + 1]; ++k) {
+				while(it != out.end() && it->first < in_src[k]) ++it;
+				if (it != out.end() && it->first == in_src[k]) {
+					sym[it->second] = 1;
+					++it;
+				} else {
+					ovl_column.push_back(in_src[k]);
+					ovl_edge.push_back(in_edge[k]);
+				}
+			}
+			ovl_rowstart[v + 1] = ovl_column.size();
+		}
+		vector<Kb_vertex_t>().swap(in_src);
+		vector<Kb_index_t>().swap(in_edge);
+
+		// Symmetric out-edges first. new_pos[i] is the new index of edge i.
+		vector<Kb_index_t> sym_end(V);
+		vector<Kb_index_t> new_pos(E);
+		for(size_t v = 0; v != V; ++v) {
+			Kb_index_t j = rowstart[v];
+			for(Kb_index_t i = rowstart[v]; i != rowstart[v + 1]; ++i)
+				if (sym[i]) new_pos[i] = j++;
+			sym_end[v] = j;
+			for(Kb_index_t i = rowstart[v]; i != rowstart[v + 1]; ++i)
+				if (!sym[i]) new_pos[i] = j++;
+		}
+		vector<Kb_vertex_t> new_column(E);
+		vector<float> eweight(E);
+		vector<etype_t::value_type> etype(E);
+		for(size_t i = 0; i != E; ++i) {
+			new_column[new_pos[i]] = column[i];
+			eweight[new_pos[i]] = m_eweight[i];
+			etype[new_pos[i]] = m_etype[i];
+		}
+		for(size_t k = 0, k_end = ovl_edge.size(); k != k_end; ++k)
+			ovl_edge[k] = new_pos[ovl_edge[k]];
+
+		column.swap(new_column);
+		map_csr();
+		m_eweight.swap(eweight);
+		m_etype.swap(etype);
+		m_sym_end.swap(sym_end);
+		m_ovl_rowstart.swap(ovl_rowstart);
+		m_ovl_column.swap(ovl_column);
+		m_ovl_edge.swap(ovl_edge);
+	}
 
-		size_t v_m = theMap.size();
+	// rev[i] is the index of the reverse of every symmetric edge i
 
-		vector<Kb_vertex_t> V(v_m);
-		// empty output vectors
-		vector<float>(v_m).swap(outranks);
-		vector<string>(v_m).swap(vnames);
+	void Kb::sym_reverse(vector<Kb_index_t> & rev) const {
 
-		map<string, Kb_vertex_t>::const_iterator m_it = theMap.begin();
-		map<string, Kb_vertex_t>::const_iterator m_end = theMap.end();
-		size_t v_i = 0;
+		const MappedArray<Kb_index_t> & rowstart = m_rowstart;
+		const MappedArray<Kb_vertex_t> & column = m_column;
 
-		// Fill vertices index vector
-		for(; m_it != m_end; ++m_it, ++v_i) {
-			V[v_i] = m_it->second;
+		// symmetric in-edges u->v of every vertex, by source
+		vector<Kb_index_t> in_row(m_vertexN + 1, 0);
+		for(size_t u = 0; u != m_vertexN; ++u)
+			for(Kb_index_t i = rowstart[u]; i != m_sym_end[u]; ++i)
+				++in_row[column[i] + 1];
+		for(size_t v = 0; v != m_vertexN; ++v) in_row[v + 1] += in_row[v];
+		vector<Kb_index_t> in_edge(in_row[m_vertexN]);
+		{
+			vector<Kb_index_t> pos(in_row.begin(), in_row.end() - 1);
+			for(size_t u = 0; u != m_vertexN; ++u)
+				for(Kb_index_t i = rowstart[u]; i != m_sym_end[u]; ++i)
+					in_edge[pos[column[i]]++] = i;
 		}
-		// Sort to guarantee uniqueness
-		sort(V);
 
-		for(v_i = 0; v_i < v_m; ++v_i) {
-			outranks[v_i] = ranks[V[v_i]];
-			vnames[v_i] = g[V[v_i]].name;
+		// the symmetric out-edges v->u of v, sorted by u, are the reverse
+		// of those in-edges, one by one
+		vector<Kb_index_t>(m_edgeN, 0).swap(rev);
+		vector<std::pair<Kb_vertex_t, Kb_index_t> > out;
+		for(size_t v = 0; v != m_vertexN; ++v) {
+			out.clear();
+			for(Kb_index_t i = rowstart[v]; i != m_sym_end[v]; ++i)
+				out.push_back(std::make_pair(column[i], i));
+			std::sort(out.begin(), out.end());
+			Kb_index_t k = in_row[v];
+			for(size_t j = 0, j_end = out.size(); j != j_end; ++j, ++k)
+				rev[out[j].second] = in_edge[k];
 		}
 	}
 
+	template<typename T>
+	static const T *vector_data(const vector<T> & v) {
+		return v.empty() ? 0 : &v[0];
+	}
+
+	// Point the forward CSR to the arrays of the boost graph. Called
+	// whenever they change.
+
+	void Kb::map_csr() {
+		m_rowstart.map(vector_data(m_g->m_forward.m_rowstart), m_g->m_forward.m_rowstart.size());
+		m_column.map(vector_data(m_g->m_forward.m_column), m_g->m_forward.m_column.size());
+	}
+
+	// The boost graph of a mapped KB is copied from the forward CSR once,
+	// even if many threads ask for it at the same time. Only the boost
+	// graph algorithms (dijkstra, strong components, subgraphs and the
+	// dfs of disambiguation graphs) and the writers need it.
+
+	static boost::once_flag kb_graph_once = BOOST_ONCE_INIT;
+
+	KbGraph & Kb::boost_graph() const {
+		boost::call_once(kb_graph_once, boost::bind(&Kb::build_boost_graph, this));
+		return *m_g;
+	}
+
+	void Kb::build_boost_graph() const {
+		if (m_g.get()) return;
+		std::auto_ptr<KbGraph> g(new KbGraph());
+		g->m_forward.m_rowstart.assign(m_rowstart.begin(), m_rowstart.end());
+		g->m_forward.m_column.assign(m_column.begin(), m_column.end());
+		m_g = g;
+	}
+
+	prank::in_csr<Kb_index_t, Kb_vertex_t> Kb::prank_in_csr() const {
+		return prank::in_csr<Kb_index_t, Kb_vertex_t>(m_vertexN,
+													  m_rowstart.data(), m_sym_end.data(),
+													  m_column.data(), m_in_coefs.data(),
+													  m_ovl_rowstart.data(), m_ovl_column.data(),
+													  m_ovl_coefs.data());
+	}
+
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Query and retrieval
+
+	// filter_mode
+	//   0 -> no filter
+	//   1 -> only words
+	//   2 -> only concepts
+
 
 	void Kb::filter_ranks_vnames(const vector<float> & ranks,
 								 vector<float> & outranks,
@@ -475,23 +713,35 @@ namespace ukb {
 		vnames.resize(v_m);
 		for(v_i = 0; v_i < v_m; ++v_i) {
 			outranks[v_i] = ranks[v_i];
-			vnames[v_i] = (*m_g)[v_i].name;
+			vnames[v_i] = get_vertex_name(v_i);
 		}
 	}
 
 	////////////////////////////////////////////////////////////////////////////////
 	// Get static pageRank vector
 
+	// It depends on the PageRank options, so it is computed by
+	// init_static_prank once they are set, before any concurrent use of the
+	// Kb. Reading it afterwards needs no locking.
+
 	const std::vector<float> & Kb::static_prank() const {
-		if (m_static_ppv.size()) return m_static_ppv;
 
-		// Hack to remove const-ness
-		Kb & me = const_cast<Kb &>(*this);
+		if (m_static_ppv.size() != m_vertexN)
+			throw std::logic_error("static_prank: the static PageRank vector is not computed (see Kb::init_static_prank)");
+		return m_static_ppv;
+	}
+
+	void Kb::init_static_prank() {
+
+		refresh_prank();
+		if (m_static_ppv.size() != m_vertexN) compute_static_prank();
+	}
+
+	void Kb::compute_static_prank() {
 
-		if (m_vertexN == 0) return m_static_ppv; // empty graph
+		PrankWorkspace ws;
 		vector<float> pv(m_vertexN, 1.0/static_cast<float>(m_vertexN));
-		me.pageRank_ppv(pv, me.m_static_ppv);
-		return m_static_ppv;
+		pageRank_ppv_init(pv, m_static_ppv, 0, ws);
 	}
 
 	////////////////////////////////////////////////////////////////////////////////
@@ -499,7 +749,7 @@ namespace ukb {
 
 	Kb_vertex_t Kb::get_random_vertex() const {
 
-		int r = g_randTarget(num_vertices(*m_g));
+		int r = g_randTarget(m_vertexN);
 
 		return r;
 	}
@@ -534,54 +784,59 @@ namespace ukb {
 
 	};
 
-	bool parse_line(const string & line, rel_parse & out) {
-
-		rel_parse res;
-
-		char_separator<char> sep(" \t");
-		tokenizer<char_separator<char> > tok(line, sep);
-		tokenizer<char_separator<char> >::iterator it = tok.begin();
-		tokenizer<char_separator<char> >::iterator end = tok.end();
-		if (it == end) return false; // empty line
-		for(;it != end; ++it) {
-
-			string str = *it;
-			if (str.length() < 3 || str[1] != ':') {
-				throw runtime_error("parse_line error. Malformed line: " + line);
+	// Fill out with the fields of line, reusing its strings. Return false if
+	// line is empty.
+
+	bool parse_line(text_ref line, rel_parse & out) {
+
+		out.u.clear();
+		out.v.clear();
+		out.rtype.clear();
+		out.irtype.clear();
+		out.src.clear();
+		out.w = 0.0;
+		out.directed = false;
+
+		text_fields fields(line, " \t");
+		text_ref str;
+		if (!fields.next(str)) return false; // empty line
+		do {
+			if (str.size() < 3 || str[1] != ':') {
+				throw runtime_error("parse_line error. Malformed line: " + line.str());
 			}
 			char f = str[0];
-			string val = str.substr(2);
-			if(!val.size()) continue;
+			text_ref val = str.substr(2);
+			if(val.empty()) continue;
 			switch (f) {
 			case 'u':
-				res.u = val;
+				val.assign_to(out.u);
 				break;
 			case 'v':
-				res.v = val;
+				val.assign_to(out.v);
 				break;
 			case 't':
-				res.rtype = val;
+				val.assign_to(out.rtype);
 				break;
 			case 'i':
-				res.irtype = val;
+				val.assign_to(out.irtype);
 				break;
 			case 's':
-				res.src = val;
+				val.assign_to(out.src);
 				break;
 			case 'w':
-				res.w = lexical_cast<float>(val);
+				if (!parse_float(val, out.w)) throw bad_lexical_cast();
 				break;
 			case 'd':
-				res.directed = glVars::kb::keep_directed && lexical_cast<bool>(val);
+				if (glVars::kb::keep_directed && !parse_bool(val, out.directed))
+					throw bad_lexical_cast();
 				break;
 			default:
-				throw runtime_error("parse_line error. Unknown value " + str);
+				throw runtime_error("parse_line error. Unknown value " + str.str());
 				break;
 			}
-		}
-		if (!res.u.size()) throw runtime_error("parse_line error. No source vertex.");
-		if (!res.v.size()) throw runtime_error("parse_line error. No target vertex.");
-		out = res;
+		} while(fields.next(str));
+		if (!out.u.size()) throw runtime_error("parse_line error. No source vertex.");
+		if (!out.v.size()) throw runtime_error("parse_line error. No target vertex.");
 		return true;
 	}
 
@@ -592,12 +847,11 @@ namespace ukb {
 		precsr_t csr_pre;
 
 		set<string>::const_iterator srel_end = src_allowed.end();
+		rel_parse f;
 		while(kbFile) {
-			vector<string> fields;
 			read_line_noblank(kbFile, line, line_number);
 			if(!kbFile) continue;
 			if (line[0] == '#') continue;
-			rel_parse f;
 			try {
 				if (!parse_line(line, f)) continue;
 
@@ -618,7 +872,7 @@ namespace ukb {
 				// empty f.rtype unless glVars::kb::keep_reltypes
 
 				if (!glVars::kb::keep_reltypes)
-					string().swap(f.rtype);
+					f.rtype.clear();
 
 				csr_pre.insert_edge(f.u, f.v, w, f.rtype);
 
@@ -635,26 +889,285 @@ namespace ukb {
 				}
 			}
 		}
+		init_graph(csr_pre);
+	}
 
-		KbGraph *new_g = new KbGraph(boost::edges_are_unsorted_multi_pass,
-									 csr_pre.E.begin(), csr_pre.E.end(),
-									 csr_pre.eProp.begin(),
-									 csr_pre.m_vsize);
+	// Create the graph from the relations of csr_pre
 
-		m_g.reset(new_g);
+	void Kb::init_graph(precsr_t & csr_pre) {
+
+		// Relabel vertices for locality. Names and the vertex map follow the
+		// new ids, so the permutation is invisible outside the graph.
+
+		if (glVars::kb::reorder != glVars::reorder_none) {
+			vector<size_t> perm;
+			vertex_order(csr_pre, glVars::kb::reorder, perm);
+			csr_pre.relabel(perm);
+		}
+
+		m_g.reset(new_kb_graph(csr_pre));
+		init_edge_props(csr_pre);
+		init_in_edges();
 		// add_edges(csr_pre.E.begin(), csr_pre.E.end(),
 		//		  // csr_pre.eProp.begin(),
 		//		  // csr_pre.eProp.end(),
 		//		  g);
 
-		BGL_FORALL_VERTICES(v, *m_g, Kb::boost_graph_t) {
-			(*m_g)[v].name = csr_pre.vProp[v].name;
-		}
-
 		m_vertexN = num_vertices(*m_g);
 		m_edgeN = num_edges(*m_g);
-		// Init vertex map
-		m_synsetMap.swap(csr_pre.m_vMap);
+		// Init vertex names and map
+		init_name_index(csr_pre.vProp);
+		init_prank();
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Parallel parsing of text relation files (see glVars::kb::parse_threads)
+	//
+	// The file is memory-mapped and split into one byte range (chunk) per
+	// thread, ending at line boundaries. Each thread parses the lines of
+	// its chunk, numbering vertex names and relation types by their first
+	// appearance in the chunk. Chunks are then merged in file order: first
+	// the names and relation types (serially, as the ids depend on the
+	// order of appearance), then the edges, sharded by source vertex among
+	// the threads. Every edge keeps the position of its first appearance
+	// in the file, and the shards are merged back by position. So vertex
+	// ids, relation type bits, and edges are the same as when reading the
+	// file line by line, and so is the graph.
+
+	struct txt_rel {
+		Kb_vertex_t u;          // chunk vertex ids
+		Kb_vertex_t v;
+		float w;
+		int rtype;              // chunk relation type, or -1
+		bool both;              // also v->u (undirected relation)
+	};
+
+	struct txt_chunk {
+		const char *begin;
+		const char *end;
+		vector<txt_rel> rels;
+		vector<string> names;                           // vertex names, by chunk id
+		vector<string> rtypes;                          // relation types, by chunk id
+		set<string> srcs;                               // relation sources
+		size_t lines;                                   // lines of the chunk
+		vector<std::pair<size_t, string> > warnings;    // skipped lines (if glVars::input::swallow)
+		string error;                                   // first error (otherwise)
+		size_t error_line;
+
+		txt_chunk() : begin(0), end(0), lines(0), error_line(0) {}
+	};
+
+	static void txt_parse_chunk(txt_chunk & c, const set<string> & src_allowed) {
+
+		boost::unordered_map<string, Kb_vertex_t> vmap;
+		std::map<string, int> tmap;
+		rel_parse f;
+		const char *p = c.begin;
+		while(p != c.end) {
+			const char *nl = static_cast<const char *>(memchr(p, '\n', c.end - p));
+			text_ref line = trim_blanks(text_ref(p, nl ? nl : c.end));
+			p = nl ? nl + 1 : c.end;
+			++c.lines;
+			if (line.empty() || line[0] == '#') continue;
+			try {
+				if (!parse_line(line, f)) continue;
+				if (glVars::kb::filter_src) {
+					if (src_allowed.find(f.src) == src_allowed.end()) continue; // Skip this relation
+				}
+				if (f.u == f.v) continue; // no self-loops
+				if (f.src.size()) c.srcs.insert(f.src);
+
+				txt_rel r;
+				const string *names[2] = { &f.u, &f.v };
+				Kb_vertex_t *ids[2] = { &r.u, &r.v };
+				for(int k = 0; k != 2; ++k) {
+					std::pair<boost::unordered_map<string, Kb_vertex_t>::iterator, bool> ins =
+						vmap.insert(std::make_pair(*names[k], Kb_vertex_t(c.names.size())));
+					if (ins.second) c.names.push_back(*names[k]);
+					*ids[k] = ins.first->second;
+				}
+				r.w = f.w ? f.w : 1.0;
+				r.rtype = -1;
+				if (glVars::kb::keep_reltypes && f.rtype.size()) {
+					std::map<string, int>::iterator it =
+						tmap.insert(std::make_pair(f.rtype, int(c.rtypes.size()))).first;
+					if (size_t(it->second) == c.rtypes.size()) c.rtypes.push_back(f.rtype);
+					r.rtype = it->second;
+				}
+				r.both = !f.directed || !glVars::kb::keep_directed;
+				c.rels.push_back(r);
+			} catch (std::exception & e) {
+				if(!glVars::input::swallow) {
+					c.error = e.what();
+					c.error_line = c.lines;
+					return;
+				}
+				if (glVars::debug::warning)
+					c.warnings.push_back(std::make_pair(c.lines, string(e.what())));
+			}
+		}
+	}
+
+	// Edges of the vertices of one shard, in order of first appearance
+
+	struct txt_shard {
+		vector<std::pair<size_t, size_t> > E;
+		vector<edge_prop_t> eProp;
+		vector<size_t> pos;                             // first appearance of every edge
+	};
+
+	struct txt_merge {
+		const vector<txt_chunk> & chunks;
+		const vector<vector<Kb_vertex_t> > & vid;       // global ids of chunk vertices
+		const vector<vector<etype_t::value_type> > & tid; // global bits of chunk relation types
+		const vector<size_t> & rel_base;                // relations before every chunk
+		vector<txt_shard> & shards;
+
+		txt_merge(const vector<txt_chunk> & c, const vector<vector<Kb_vertex_t> > & v,
+				  const vector<vector<etype_t::value_type> > & t, const vector<size_t> & b,
+				  vector<txt_shard> & s)
+			: chunks(c), vid(v), tid(t), rel_base(b), shards(s) {}
+
+		// Same as precsr_t::insert_edge, for the edges with source in shard s
+
+		void shard_edges(size_t s) {
+
+			typedef std::pair<size_t, size_t> vpair;
+			boost::unordered_map<vpair, size_t> emap;
+			txt_shard & sh = shards[s];
+			size_t S = shards.size();
+			for(size_t c = 0; c != chunks.size(); ++c) {
+				const vector<txt_rel> & rels = chunks[c].rels;
+				const vector<Kb_vertex_t> & ids = vid[c];
+				for(size_t i = 0; i != rels.size(); ++i) {
+					const txt_rel & r = rels[i];
+					etype_t::value_type et = r.rtype < 0 ? 0 : tid[c][r.rtype];
+					for(int k = 0; k != (r.both ? 2 : 1); ++k) {
+						vpair e = k ? vpair(ids[r.v], ids[r.u]) : vpair(ids[r.u], ids[r.v]);
+						if (e.first % S != s) continue;
+						std::pair<boost::unordered_map<vpair, size_t>::iterator, bool> ins =
+							emap.insert(std::make_pair(e, sh.E.size()));
+						if (ins.second) {
+							sh.E.push_back(e);
+							sh.eProp.push_back(edge_prop_t());
+							sh.pos.push_back(2 * (rel_base[c] + i) + k);
+						}
+						edge_prop_t & ep = sh.eProp[ins.first->second];
+						ep.etype |= et;
+						ep.weight = r.w;
+					}
+				}
+			}
+		}
+	};
+
+	struct txt_parser {
+		vector<txt_chunk> & chunks;
+		const set<string> & src_allowed;
+
+		txt_parser(vector<txt_chunk> & c, const set<string> & s) : chunks(c), src_allowed(s) {}
+		void operator()(size_t t) { txt_parse_chunk(chunks[t], src_allowed); }
+	};
+
+	// Run f(0), ..., f(n - 1) on n threads (the calling one included)
+
+	static void txt_run(size_t n, const boost::function<void (size_t)> & f) {
+		boost::thread_group workers;
+		for(size_t t = 1; t < n; ++t)
+			workers.create_thread(boost::bind(f, t));
+		f(0);
+		workers.join_all();
+	}
+
+	void Kb::read_from_txt_mt(const string & synsFileName,
+							  const set<string> & src_allowed, size_t T) {
+
+		using namespace boost::interprocess;
+
+		file_mapping file(synsFileName.c_str(), read_only);
+		mapped_region region(file, read_only);
+		region.advise(mapped_region::advice_sequential);
+		const char *base = static_cast<const char *>(region.get_address());
+		size_t size = region.get_size();
+
+		// chunks
+		vector<txt_chunk> chunks(T);
+		for(size_t t = 0; t != T; ++t) {
+			const char *b = base + size / T * t;
+			if (t) {
+				const char *nl = static_cast<const char *>(memchr(b, '\n', base + size - b));
+				b = nl ? nl + 1 : base + size;
+				if (b < chunks[t - 1].begin) b = chunks[t - 1].begin;
+			}
+			chunks[t].begin = b;
+			if (t) chunks[t - 1].end = b;
+		}
+		chunks[T - 1].end = base + size;
+		txt_run(T, txt_parser(chunks, src_allowed));
+
+		// errors and warnings, in file order
+		size_t line_base = 0;
+		for(size_t t = 0; t != T; ++t) {
+			const txt_chunk & c = chunks[t];
+			for(size_t i = 0; i != c.warnings.size(); ++i)
+				cerr << c.warnings[i].second << " in line " << line_base + c.warnings[i].first << " (Skipping)\n";
+			if (!c.error.empty())
+				throw std::runtime_error(c.error + " in line " + lexical_cast<string>(line_base + c.error_line));
+			line_base += c.lines;
+		}
+
+		// vertices, relation types and sources
+		precsr_t csr_pre;
+		vector<vector<Kb_vertex_t> > vid(T);
+		vector<vector<etype_t::value_type> > tid(T);
+		vector<size_t> rel_base(T + 1, 0);
+		size_t max_n = std::numeric_limits<Kb_index_t>::max();
+		for(size_t t = 0; t != T; ++t) {
+			txt_chunk & c = chunks[t];
+			vid[t].resize(c.names.size());
+			for(size_t i = 0; i != c.names.size(); ++i) {
+				size_t u = csr_pre.insert_vertex(c.names[i]);
+				if (u >= max_n)
+					throw runtime_error("[E] KB too large for " + lexical_cast<string>(sizeof(Kb_index_t) * 8) +
+										" bit indices (build with -DUKB_KB_INDEX64)");
+				vid[t][i] = u;
+			}
+			vector<string>().swap(c.names);
+			tid[t].resize(c.rtypes.size(), 0);
+			for(size_t i = 0; i != c.rtypes.size(); ++i)
+				csr_pre.m_rtypes.add_type(c.rtypes[i], tid[t][i]);
+			for(set<string>::const_iterator it = c.srcs.begin(); it != c.srcs.end(); ++it)
+				this->add_relSource(*it);
+			rel_base[t + 1] = rel_base[t] + c.rels.size();
+		}
+
+		// edges
+		vector<txt_shard> shards(T);
+		txt_merge merge(chunks, vid, tid, rel_base, shards);
+		txt_run(T, boost::bind(&txt_merge::shard_edges, &merge, _1));
+		vector<txt_chunk>().swap(chunks);
+
+		size_t E = 0;
+		for(size_t s = 0; s != T; ++s) E += shards[s].E.size();
+		csr_pre.E.reserve(E);
+		csr_pre.eProp.reserve(E);
+		typedef std::pair<size_t, size_t> head_t; // (position, shard)
+		std::priority_queue<head_t, vector<head_t>, std::greater<head_t> > heads;
+		vector<size_t> next(T, 0);
+		for(size_t s = 0; s != T; ++s)
+			if (shards[s].E.size()) heads.push(head_t(shards[s].pos[0], s));
+		while(!heads.empty()) {
+			size_t s = heads.top().second;
+			heads.pop();
+			size_t i = next[s]++;
+			csr_pre.E.push_back(shards[s].E[i]);
+			csr_pre.eProp.push_back(shards[s].eProp[i]);
+			if (next[s] != shards[s].E.size()) heads.push(head_t(shards[s].pos[next[s]], s));
+		}
+		csr_pre.m_esize = E;
+		vector<txt_shard>().swap(shards);
+
+		init_graph(csr_pre);
 	}
 
 	void Kb::read_from_txt(const std::string & synsFileName,
@@ -666,12 +1179,412 @@ namespace ukb {
 		}
 		if(glVars::kb::v1_kb) {
 			throw runtime_error(synsFileName + " :sorry, the binary representation has an old format.");
+		} else if (glVars::kb::parse_threads > 1 && input_ifs.peek() != EOF) {
+			input_ifs.close();
+			this->read_from_txt_mt(synsFileName, src_allowed, glVars::kb::parse_threads);
 		} else {
 			std::istream input_is(input_ifs.rdbuf());
 			this->read_from_txt(input_is, src_allowed);
 		}
 	}
 
+	////////////////////////////////////////////////////////////////////////////////
+	// Apply a delta file to the graph
+	//
+	// Lines are relation lines (see above), optionally prefixed by the
+	// operation:
+	//
+	// + (default): add the relation. If the edge exists, set its weight and
+	//              add the relation type, as when a relation is repeated in
+	//              the text source.
+	// -          : remove the relation.
+	// =          : set the weight of an existing relation.
+	//
+	// As in the text source, undirected relations stand for both u->v and
+	// v->u. Removing or reweighting them fails only if neither exists.
+	//
+	// Lines are applied in order to the state of every directed edge (a
+	// map, sorted by source and target). The rows of the vertices of
+	// changed edges (touched vertices) are then rebuilt, and the others
+	// copied. The symmetric status (see init_in_edges) of edge u->v only
+	// depends on v->u, so it can only change if u and v are both touched;
+	// the in-edges of an untouched vertex are the same.
+
+	static const Kb_index_t delta_no_edge = std::numeric_limits<Kb_index_t>::max();
+
+	// state of a directed edge, after the lines read so far
+
+	struct delta_state {
+		bool exists;
+		float w;
+		etype_t::value_type etype;
+		Kb_index_t old;  // index in the graph, or delta_no_edge
+
+		delta_state() : exists(false), w(0.0f), etype(0), old(delta_no_edge) {}
+	};
+
+	typedef std::pair<Kb_vertex_t, Kb_vertex_t> delta_key;
+	typedef std::map<delta_key, delta_state> delta_map;
+
+	// out-edge of a touched vertex
+
+	struct delta_out {
+		Kb_vertex_t v;
+		float w;
+		etype_t::value_type etype;
+		Kb_index_t old;  // index in the graph, or delta_no_edge
+		bool sym;
+		Kb_index_t pos;  // position in the new row
+
+		delta_out(Kb_vertex_t v_, float w_, etype_t::value_type et, Kb_index_t old_, bool sym_)
+			: v(v_), w(w_), etype(et), old(old_), sym(sym_), pos(0) {}
+
+		bool operator<(const delta_out & o) const { return v < o.v; }
+	};
+
+	// order of the new row: symmetric edges first, then the others,
+	// keeping the order of old edges and placing new ones at the end
+
+	struct delta_row_order {
+		const vector<delta_out> & row;
+		delta_row_order(const vector<delta_out> & r) : row(r) {}
+		bool operator()(size_t a, size_t b) const {
+			const delta_out & x = row[a];
+			const delta_out & y = row[b];
+			if (x.sym != y.sym) return x.sym;
+			bool xn = x.old == delta_no_edge;
+			bool yn = y.old == delta_no_edge;
+			if (xn != yn) return yn;
+			return xn ? x.v < y.v : x.old < y.old;
+		}
+	};
+
+	// overlay in-edge: (target, source, edge index)
+
+	typedef boost::tuple<Kb_vertex_t, Kb_vertex_t, Kb_index_t> delta_in;
+
+	static bool delta_in_lt(const delta_in & a, const delta_in & b) {
+		if (a.get<0>() != b.get<0>()) return a.get<0>() < b.get<0>();
+		return a.get<1>() < b.get<1>();
+	}
+
+	static const delta_out *delta_find(const vector<delta_out> & row, Kb_vertex_t v) {
+		vector<delta_out>::const_iterator it =
+			std::lower_bound(row.begin(), row.end(), delta_out(v, 0.0f, 0, delta_no_edge, false));
+		if (it == row.end() || it->v != v) return 0;
+		return &(*it);
+	}
+
+	size_t Kb::apply_delta(istream & is,
+						   const set<string> & src_allowed) {
+
+		const MappedArray<Kb_index_t> & rowstart = m_rowstart;
+		const MappedArray<Kb_vertex_t> & column = m_column;
+		size_t V = m_vertexN;
+
+		delta_map D;
+		std::map<string, Kb_vertex_t> new_vmap;
+		vector<string> new_names;  // names of vertices V, V + 1, ...
+
+		// old out-edges of the vertices found in the delta, sorted by target
+		std::map<Kb_vertex_t, vector<std::pair<Kb_vertex_t, Kb_index_t> > > old_rows;
+
+		string line;
+		size_t line_number = 0;
+		set<string>::const_iterator srel_end = src_allowed.end();
+		rel_parse f;
+		while(is) {
+			read_line_noblank(is, line, line_number);
+			if(!is) continue;
+			if (line[0] == '#') continue;
+			char op = '+';
+			text_ref rel(line);
+			if (line[0] == '+' || line[0] == '-' || line[0] == '=') {
+				op = line[0];
+				rel = rel.substr(1);
+			}
+			try {
+				if (!parse_line(rel, f)) continue;
+
+				if (glVars::kb::filter_src) {
+					if (src_allowed.find(f.src) == srel_end) continue; // Skip this relation
+				}
+
+				if (f.u == f.v) continue; // no self-loops
+
+				// vertices (only added relations create them)
+				Kb_vertex_t uv[2];
+				const string *names[2] = { &f.u, &f.v };
+				for(int k = 0; k != 2; ++k) {
+					std::pair<Kb_vertex_t, bool> r = get_vertex_by_name(*names[k]);
+					if (r.second) {
+						uv[k] = r.first;
+						continue;
+					}
+					std::map<string, Kb_vertex_t>::iterator it = new_vmap.find(*names[k]);
+					if (it == new_vmap.end()) {
+						if (op != '+')
+							throw runtime_error("apply_delta error. Unknown vertex " + *names[k]);
+						it = new_vmap.insert(std::make_pair(*names[k], Kb_vertex_t(V + new_names.size()))).first;
+						new_names.push_back(*names[k]);
+					}
+					uv[k] = it->second;
+				}
+
+				// states of u->v, and v->u if undirected
+				delta_state *S[2] = { 0, 0 };
+				int n = (!f.directed || !glVars::kb::keep_directed) ? 2 : 1;
+				for(int k = 0; k != n; ++k) {
+					delta_key key(uv[k], uv[1 - k]);
+					delta_map::iterator it = D.find(key);
+					if (it == D.end()) {
+						it = D.insert(std::make_pair(key, delta_state())).first;
+						if (key.first < V) {
+							vector<std::pair<Kb_vertex_t, Kb_index_t> > & orow = old_rows[key.first];
+							if (orow.empty()) {
+								for(Kb_index_t i = rowstart[key.first]; i != rowstart[key.first + 1]; ++i)
+									orow.push_back(std::make_pair(column[i], i));
+								std::sort(orow.begin(), orow.end());
+							}
+							vector<std::pair<Kb_vertex_t, Kb_index_t> >::const_iterator oit =
+								std::lower_bound(orow.begin(), orow.end(), std::make_pair(key.second, Kb_index_t(0)));
+							if (oit != orow.end() && oit->first == key.second) {
+								delta_state & s = it->second;
+								s.exists = true;
+								s.old = oit->second;
+								s.w = m_eweight[s.old];
+								s.etype = m_etype[s.old];
+							}
+						}
+					}
+					S[k] = &it->second;
+				}
+
+				float w = f.w ? f.w : 1.0;
+				if (op == '+') {
+					etype_t::value_type et = 0;
+					if (glVars::kb::keep_reltypes && f.rtype.size())
+						m_rtypes.add_type(f.rtype, et);
+					this->add_relSource(f.src);
+					for(int k = 0; k != n; ++k) {
+						S[k]->exists = true;
+						S[k]->w = w;
+						S[k]->etype |= et;
+					}
+				} else {
+					if (!S[0]->exists && (n == 1 || !S[1]->exists))
+						throw runtime_error("apply_delta error. No relation between " + f.u + " and " + f.v);
+					for(int k = 0; k != n; ++k) {
+						if (!S[k]->exists) continue;
+						if (op == '-') {
+							S[k]->exists = false;
+							S[k]->etype = 0;
+						} else {
+							S[k]->w = w;
+						}
+					}
+				}
+			} catch (std::exception & e) {
+				string msg(string(e.what()) + " in line " + lexical_cast<string>(line_number));
+				if(!glVars::input::swallow) throw std::runtime_error(msg);
+				if (glVars::debug::warning) {
+					cerr << msg << " (Skipping)\n";
+				}
+			}
+		}
+		std::map<Kb_vertex_t, vector<std::pair<Kb_vertex_t, Kb_index_t> > >().swap(old_rows);
+
+		// touched vertices (and all new ones), and their index in rows
+		size_t V2 = V + new_names.size();
+		vector<Kb_index_t> tpos(V2, delta_no_edge);
+		size_t changed = 0;
+		for(delta_map::const_iterator it = D.begin(), end = D.end(); it != end; ++it) {
+			const delta_state & s = it->second;
+			bool old_exists = s.old != delta_no_edge;
+			if (s.exists == old_exists &&
+				(!s.exists || (s.w == m_eweight[s.old] && s.etype == m_etype[s.old])))
+				continue;
+			++changed;
+			tpos[it->first.first] = 0;
+			tpos[it->first.second] = 0;
+		}
+		for(size_t u = V; u != V2; ++u) tpos[u] = 0;
+		vector<Kb_vertex_t> T;
+		for(size_t u = 0; u != V2; ++u)
+			if (tpos[u] != delta_no_edge) {
+				tpos[u] = T.size();
+				T.push_back(u);
+			}
+		if (!changed && V2 == V) return 0;
+
+		// new rows of the touched vertices, sorted by target: old edges
+		// merged with the states of the delta
+		vector<vector<delta_out> > rows(T.size());
+		for(size_t t = 0; t != T.size(); ++t) {
+			Kb_vertex_t u = T[t];
+			vector<delta_out> orow;
+			if (u < V) {
+				for(Kb_index_t i = rowstart[u]; i != rowstart[u + 1]; ++i)
+					orow.push_back(delta_out(column[i], m_eweight[i], m_etype[i], i, i < m_sym_end[u]));
+				std::sort(orow.begin(), orow.end());
+			}
+			vector<delta_out> & row = rows[t];
+			vector<delta_out>::const_iterator oit = orow.begin();
+			delta_map::const_iterator dit = D.lower_bound(delta_key(u, 0));
+			delta_map::const_iterator dend = D.end();
+			while(oit != orow.end() || (dit != dend && dit->first.first == u)) {
+				if (dit == dend || dit->first.first != u ||
+					(oit != orow.end() && oit->v < dit->first.second)) {
+					row.push_back(*oit++);
+					continue;
+				}
+				const delta_state & s = dit->second;
+				if (s.exists)
+					row.push_back(delta_out(dit->first.second, s.w, s.etype, s.old,
+											s.old != delta_no_edge && s.old < (u < V ? m_sym_end[u] : 0)));
+				if (oit != orow.end() && oit->v == dit->first.second) ++oit;
+				++dit;
+			}
+		}
+		delta_map().swap(D);
+
+		// symmetric status and position of the edges of the touched rows
+		vector<size_t> sym_n(T.size(), 0);
+		vector<size_t> idx;
+		for(size_t t = 0; t != T.size(); ++t) {
+			vector<delta_out> & row = rows[t];
+			for(size_t j = 0; j != row.size(); ++j) {
+				Kb_index_t tw = tpos[row[j].v];
+				if (tw != delta_no_edge)
+					row[j].sym = delta_find(rows[tw], T[t]) != 0;
+				if (row[j].sym) ++sym_n[t];
+			}
+			idx.resize(row.size());
+			for(size_t j = 0; j != row.size(); ++j) idx[j] = j;
+			std::sort(idx.begin(), idx.end(), delta_row_order(row));
+			for(size_t j = 0; j != idx.size(); ++j) row[idx[j]].pos = j;
+		}
+
+		// new forward CSR
+		vector<Kb_index_t> new_rowstart(V2 + 1, 0);
+		for(size_t u = 0; u != V2; ++u) {
+			size_t deg = tpos[u] != delta_no_edge ? rows[tpos[u]].size() : rowstart[u + 1] - rowstart[u];
+			new_rowstart[u + 1] = new_rowstart[u] + deg;
+		}
+		size_t E2 = new_rowstart[V2];
+		size_t max_n = std::numeric_limits<Kb_index_t>::max();
+		if (V2 >= max_n || E2 >= max_n)
+			throw runtime_error("[E] KB too large for " + lexical_cast<string>(sizeof(Kb_index_t) * 8) +
+								" bit indices (build with -DUKB_KB_INDEX64)");
+
+		vector<Kb_vertex_t> new_column(E2);
+		vector<float> eweight(E2);
+		vector<etype_t::value_type> etype(E2);
+		vector<Kb_index_t> sym_end(V2);
+		vector<delta_in> tin;   // non-symmetric edges of touched rows
+		for(size_t u = 0; u != V2; ++u) {
+			Kb_index_t t = tpos[u];
+			if (t == delta_no_edge) {
+				Kb_index_t b = rowstart[u];
+				Kb_index_t e = rowstart[u + 1];
+				std::copy(column.begin() + b, column.begin() + e, new_column.begin() + new_rowstart[u]);
+				std::copy(m_eweight.begin() + b, m_eweight.begin() + e, eweight.begin() + new_rowstart[u]);
+				std::copy(m_etype.begin() + b, m_etype.begin() + e, etype.begin() + new_rowstart[u]);
+				sym_end[u] = m_sym_end[u] - b + new_rowstart[u];
+				continue;
+			}
+			const vector<delta_out> & row = rows[t];
+			for(size_t j = 0; j != row.size(); ++j) {
+				Kb_index_t i = new_rowstart[u] + row[j].pos;
+				new_column[i] = row[j].v;
+				eweight[i] = row[j].w;
+				etype[i] = row[j].etype;
+				if (!row[j].sym) tin.push_back(delta_in(row[j].v, u, i));
+			}
+			sym_end[u] = new_rowstart[u] + sym_n[t];
+		}
+		std::sort(tin.begin(), tin.end(), delta_in_lt);
+
+		// new overlay: the old in-edges of untouched sources (shifted along
+		// their rows), merged by source with the ones of touched sources
+		vector<Kb_index_t> ovl_rowstart(V2 + 1, 0);
+		vector<Kb_vertex_t> ovl_column;
+		vector<Kb_index_t> ovl_edge;
+		ovl_column.reserve(m_ovl_column.size() + tin.size());
+		ovl_edge.reserve(m_ovl_column.size() + tin.size());
+		vector<delta_in>::const_iterator tit = tin.begin();
+		for(size_t v = 0; v != V2; ++v) {
+			Kb_index_t k = v < V ? m_ovl_rowstart[v] : 0;
+			Kb_index_t k_end = v < V ? m_ovl_rowstart[v + 1] : 0;
+			while(true) {
+				while(k != k_end && tpos[m_ovl_column[k]] != delta_no_edge) ++k;
+				bool has_t = tit != tin.end() && tit->get<0>() == v;
+				if (k == k_end && !has_t) break;
+				if (has_t && (k == k_end || tit->get<1>() < m_ovl_column[k])) {
+					ovl_column.push_back(tit->get<1>());
+					ovl_edge.push_back(tit->get<2>());
+					++tit;
+				} else {
+					Kb_vertex_t x = m_ovl_column[k];
+					ovl_column.push_back(x);
+					ovl_edge.push_back(m_ovl_edge[k] - rowstart[x] + new_rowstart[x]);
+					++k;
+				}
+			}
+			ovl_rowstart[v + 1] = ovl_column.size();
+		}
+
+		// vertex names
+		if (new_names.size()) {
+			NameIndex idx;
+			size_t chars_n = m_names.chars_size();
+			for(size_t i = 0; i != new_names.size(); ++i) chars_n += new_names[i].size();
+			idx.reserve(V2, chars_n);
+			for(size_t u = 0; u != V; ++u) {
+				name_ref nr = m_names.name(u);
+				idx.push_back(nr.data, nr.size);
+			}
+			for(size_t i = 0; i != new_names.size(); ++i)
+				idx.push_back(new_names[i]);
+			idx.build_table();
+			m_names.swap(idx);
+		}
+
+		KbGraph *new_g = new KbGraph();
+		new_g->m_forward.m_rowstart.swap(new_rowstart);
+		new_g->m_forward.m_column.swap(new_column);
+		m_g.reset(new_g);
+		map_csr();
+		m_eweight.swap(eweight);
+		m_etype.swap(etype);
+		m_sym_end.swap(sym_end);
+		m_ovl_rowstart.swap(ovl_rowstart);
+		m_ovl_column.swap(ovl_column);
+		m_ovl_edge.swap(ovl_edge);
+		m_vertexN = V2;
+		m_edgeN = E2;
+		assert(num_vertices(*m_g) == m_vertexN);
+		assert(num_edges(*m_g) == m_edgeN);
+
+		// derived data is stale
+		vector<float>().swap(m_static_ppv);
+		vector<unsigned int>().swap(m_fp);
+		m_fp_R = 0;
+		m_ppv_cache.reset();
+		init_prank();
+		return changed;
+	}
+
+	size_t Kb::apply_delta(const std::string & deltaFile,
+						   const set<string> & src_allowed) {
+
+		std::ifstream input_ifs(deltaFile.c_str(), ofstream::in);
+		if (!input_ifs) {
+			throw runtime_error("Kb::apply_delta error: Can't open " + deltaFile);
+		}
+		return this->apply_delta(input_ifs, src_allowed);
+	}
+
 	void Kb::display_info(std::ostream & o) const {
 
 		o << "Relation sources: ";
@@ -680,9 +1593,9 @@ namespace ukb {
 			o << "\nM_Notes: ";
 			writeV(o, m_notes);
 		}
-		size_t edge_n = num_edges(*m_g);
+		size_t edge_n = m_edgeN;
 
-		o << "\n" << num_vertices(*m_g) << " vertices and " << edge_n << " edges.\n(Note that if graph is undirected you should divide the edge number by 2)" << endl;
+		o << "\n" << m_vertexN << " vertices and " << edge_n << " edges.\n(Note that if graph is undirected you should divide the edge number by 2)" << endl;
 		if (m_rtypes.size()) {
 			o << "Relations:";
 			writeV(o, m_rtypes.m_strtypes);
@@ -698,14 +1611,12 @@ namespace ukb {
 
 		size_t d = 0;
 
-		graph_traits<KbGraph>::vertex_iterator it, end;
-		tie(it, end) = vertices(*m_g);
-		for(; it != end; ++it) {
-			d = in_degree(*it, *m_g);
+		for(size_t v = 0; v != m_vertexN; ++v) {
+			d = in_degree(v);
 			if (d > M) M = d;
 			if (d < m) m = d;
 		}
-		return make_pair<size_t, size_t>(M, m);
+		return make_pair(M, m);
 	}
 
 	std::pair<size_t, size_t> Kb::outdeg_maxmin() const {
@@ -715,25 +1626,24 @@ namespace ukb {
 
 		size_t d;
 
-		graph_traits<KbGraph>::vertex_iterator it, end;
-		tie(it, end) = vertices(*m_g);
-		for(; it != end; ++it) {
-			d = out_degree(*it, *m_g);
+		for(size_t v = 0; v != m_vertexN; ++v) {
+			d = m_rowstart[v + 1] - m_rowstart[v];
 			if (d > M) M = d;
 			if (d < m) m = d;
 		}
-		return make_pair<size_t, size_t>(M, m);
+		return make_pair(M, m);
 	}
 
 
 	int Kb::components() const {
 
-		vector<size_t> v(num_vertices(*m_g));
+		const KbGraph & g = boost_graph();
+		vector<size_t> v(num_vertices(g));
 		boost::iterator_property_map<
 			std::vector<size_t>::iterator,
-			boost::property_map<KbGraph, boost::vertex_index_t>::type> pm(v.begin(), get(boost::vertex_index, *m_g));
+			boost::property_map<KbGraph, boost::vertex_index_t>::type> pm(v.begin(), get(boost::vertex_index, g));
 
-		int i = boost::strong_components(*m_g, pm);
+		int i = boost::strong_components(g, pm);
 
 		return i;
 
@@ -741,12 +1651,13 @@ namespace ukb {
 
 	int Kb::components(vector<size_t> & v) const {
 
-		vector<size_t> (num_vertices(*m_g)).swap(v);
+		const KbGraph & g = boost_graph();
+		vector<size_t> (num_vertices(g)).swap(v);
 		boost::iterator_property_map<
 			std::vector<size_t>::iterator,
-			boost::property_map<KbGraph, boost::vertex_index_t>::type> pm(v.begin(), get(boost::vertex_index, *m_g));
+			boost::property_map<KbGraph, boost::vertex_index_t>::type> pm(v.begin(), get(boost::vertex_index, g));
 
-		int i = boost::strong_components(*m_g, pm);
+		int i = boost::strong_components(g, pm);
 
 		return i;
 
@@ -754,70 +1665,635 @@ namespace ukb {
 
 	void Kb::ppv_weights(const vector<float> & ppv) {
 
-		graph_traits<KbGraph>::edge_iterator it, end;
-
-		tie(it, end) = edges(*m_g);
-		for(; it != end; ++it) {
-			(*m_g)[*it].weight = ppv[target(*it, *m_g)];
+		vector<float> & eweight = m_eweight.own();
+		for(size_t i = 0; i != m_edgeN; ++i) {
+			eweight[i] = ppv[m_column[i]];
 		}
+		init_in_coefs(); // transition coefs are stale
 	}
 
 	////////////////////////////////////////////////////////////////////////////////
-	// PageRank in KB
+	// Sparse vectors
 
+	static bool sparse_pair_lt(const Kb_sparse_vector::value_type & a,
+							   const Kb_sparse_vector::value_type & b) {
+		return a.first < b.first;
+	}
+
+	float Kb_sparse_vector::operator[](Kb_vertex_t u) const {
+		const_iterator it = std::lower_bound(m_v.begin(), m_v.end(),
+											 value_type(u, 0.0f), sparse_pair_lt);
+		if (it == m_v.end() || it->first != u) return 0.0f;
+		return it->second;
+	}
+
+	void Kb_sparse_vector::clear(size_t n) {
+		m_n = n;
+		m_v.clear();
+	}
+
+	void Kb_sparse_vector::sort_merge() {
+		std::stable_sort(m_v.begin(), m_v.end(), sparse_pair_lt);
+		size_t j = 0;
+		for(size_t i = 0, m = m_v.size(); i != m; ++i) {
+			if (j && m_v[j - 1].first == m_v[i].first) {
+				m_v[j - 1].second += m_v[i].second;
+			} else {
+				m_v[j++] = m_v[i];
+			}
+		}
+		m_v.resize(j);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// PageRank in KB
+
+
+	// Init the coefficients and vertex lists PageRank needs. Called when
+	// the graph is loaded, so that PageRank can be computed on a const Kb.
+
+	void Kb::init_prank() {
+
+		const MappedArray<Kb_index_t> & rowstart = m_rowstart;
+
+		// m_out_coefs[v] is 1 / (sum of weights of out-edges), 0 for
+		// dangling vertices and -1 for isolated ones (see
+		// prank::init_out_coefs)
+		m_prank_weight = glVars::prank::use_weight;
+		vector<float>(m_vertexN, 0.0f).swap(m_out_coefs);
+		for(size_t v = 0; v != m_vertexN; ++v) {
+			if (rowstart[v] == rowstart[v + 1]) {
+				m_out_coefs[v] = in_degree(v) ? 0.0f : -1.0f;
+				continue;
+			}
+			float total_w = 0.0;
+			for(Kb_index_t i = rowstart[v]; i != rowstart[v + 1]; ++i)
+				total_w += m_prank_weight ? m_eweight[i] : 1.0f;
+			m_out_coefs[v] = 1.0f / total_w;
+		}
+		init_in_coefs();
+		init_prank_lists();
+	}
+
+	// Init the vertex lists and chunks of m_out_coefs
+
+	void Kb::init_prank_lists() {
+
+		prank::init_vertex_lists(m_out_coefs, m_prank_active, m_prank_dangling);
+		if (glVars::prank::num_threads > 1)
+			prank::edge_balanced_chunks(prank_in_csr(), glVars::prank::num_threads, m_prank_chunks);
+	}
+
+	// Init m_in_coefs and m_ovl_coefs, keeping m_out_coefs. The coefficient
+	// of the in-edge u->v is weight(u->v) * m_out_coefs[u]. Symmetric
+	// in-edges are stored as their reverse v->u, so their weight is the one
+	// of the reverse edge (see sym_reverse).
+
+	void Kb::init_in_coefs() {
+
+		const MappedArray<Kb_index_t> & rowstart = m_rowstart;
+		const MappedArray<Kb_vertex_t> & column = m_column;
+
+		vector<Kb_index_t> rev;
+		if (m_prank_weight) sym_reverse(rev);
+		vector<float> in_coefs(m_edgeN, 0.0f);
+		for(size_t v = 0; v != m_vertexN; ++v) {
+			for(Kb_index_t i = rowstart[v]; i != m_sym_end[v]; ++i) {
+				float w = m_prank_weight ? m_eweight[rev[i]] : 1.0f;
+				in_coefs[i] = w * m_out_coefs[column[i]];
+			}
+		}
+		size_t ovl_n = m_ovl_column.size();
+		vector<float> ovl_coefs(ovl_n);
+		for(size_t i = 0; i != ovl_n; ++i) {
+			float w = m_prank_weight ? m_eweight[m_ovl_edge[i]] : 1.0f;
+			ovl_coefs[i] = w * m_out_coefs[m_ovl_column[i]];
+		}
+		m_in_coefs.swap(in_coefs);
+		m_ovl_coefs.swap(ovl_coefs);
+		vector<float>().swap(m_static_ppv); // it follows the coefficients
+	}
+
+	// Recompute the coefficients if they are stale, that is, if edge
+	// weights changed or glVars::prank::use_weight did since they were
+	// computed. Warm starts from the static vector (see prank_init_vector)
+	// also need it computed.
+
+	void Kb::refresh_prank() {
+
+		if (m_out_coefs.size() != m_vertexN || m_prank_weight != glVars::prank::use_weight) {
+			init_prank();
+		} else if (m_in_coefs.size() != m_edgeN) {
+			init_in_coefs();
+		}
+		if (glVars::prank::init == glVars::init_static && m_static_ppv.size() != m_vertexN)
+			compute_static_prank();
+	}
+
+	void Kb::check_prank() const {
+
+		if (m_out_coefs.size() != m_vertexN || m_in_coefs.size() != m_edgeN ||
+			m_prank_weight != glVars::prank::use_weight)
+			throw std::logic_error("pageRank_ppv: PageRank coefficients are stale");
+	}
+
+	// Initial vector for PageRank iterations, according to
+	// glVars::prank::init. NULL means the uniform vector.
+
+	const float *Kb::prank_init_vector(const PrankWorkspace & ws) const {
+
+		switch(glVars::prank::init) {
+		case glVars::init_prev:
+			if (ws.prev_ranks.size() != m_vertexN) return 0;
+			return &ws.prev_ranks[0];
+		case glVars::init_static:
+			return &(static_prank()[0]);
+		default:
+			break;
+		}
+		return 0;
+	}
 
 	// PPV version
 
 	void Kb::pageRank_ppv(const vector<float> & ppv_map,
 						  vector<float> & ranks) {
 
-		typedef graph_traits<KbGraph>::edge_descriptor edge_descriptor;
-		property_map<Kb::boost_graph_t, float edge_prop_t::*>::type weight_map = get(&edge_prop_t::weight, *m_g);
-		prank::constant_property_map <edge_descriptor, float> cte_weight(1.0); // always return 1
+		refresh_prank();
+		if (glVars::prank::impl == glVars::mc) load_fingerprints();
+		pageRank_ppv(ppv_map, ranks, m_ws);
+	}
+
+	void Kb::pageRank_ppv(const vector<float> & ppv_map,
+						  vector<float> & ranks,
+						  PrankWorkspace & ws) const {
 
-		if (0 == m_out_coefs.size()) {
-			vector<float>(m_vertexN, 0.0f).swap(m_out_coefs);
-			if (glVars::prank::use_weight) {
-				prank::init_out_coefs(*m_g,  &m_out_coefs[0], weight_map);
-			} else {
-				prank::init_out_coefs(*m_g,  &m_out_coefs[0], cte_weight);
-			}
+		check_prank();
+		if (m_ppv_cache.get()) {
+			pageRank_ppv_cached(ppv_map, ranks, ws);
+			return;
 		}
+		pageRank_ppv_init(ppv_map, ranks, prank_init_vector(ws), ws);
+		if (glVars::prank::init == glVars::init_prev) ws.prev_ranks = ranks;
+	}
+
+	// Warm start version
+
+	void Kb::pageRank_ppv(const vector<float> & ppv_map,
+						  vector<float> & ranks,
+						  const vector<float> & init_ranks) {
+
+		if (init_ranks.size() != m_vertexN)
+			throw std::logic_error("pageRank_ppv: initial ranks do not match graph size");
+		refresh_prank();
+		if (glVars::prank::impl == glVars::mc) load_fingerprints();
+		pageRank_ppv_init(ppv_map, ranks, &init_ranks[0], m_ws);
+	}
+
+	template<typename wmap_t>
+	static size_t pageRank_adaptive_run(const MappedArray<Kb_index_t> & rowstart,
+										const MappedArray<Kb_vertex_t> & column,
+										const prank::in_csr<Kb_index_t, Kb_vertex_t> & in,
+										const vector<float> & out_coefs,
+										const vector<float> & ppv_map,
+										vector<float> & ranks,
+										float local_tol,
+										wmap_t wmap,
+										const prank::pm_accel *accel,
+										PrankWorkspace & ws) {
+
+		return prank::do_pageRank_adaptive(out_coefs.size(), in,
+										   rowstart.data(), column.data(),
+										   wmap, &ppv_map[0], &ranks[0],
+										   glVars::prank::num_iterations,
+										   glVars::prank::threshold,
+										   glVars::prank::damping,
+										   local_tol,
+										   out_coefs, ws.edges, ws.adaptive, accel);
+	}
+
+	void Kb::pageRank_ppv_init(const vector<float> & ppv_map,
+							   vector<float> & ranks,
+							   const float *init,
+							   PrankWorkspace & ws) const {
+
 		if (m_vertexN == ranks.size()) {
 			std::fill(ranks.begin(), ranks.end(), 0.0);
 		} else {
 			vector<float>(m_vertexN, 0.0).swap(ranks); // Initialize rank vector
 		}
-		vector<float> rank_tmp(m_vertexN, 0.0);    // auxiliary rank vector
+		if (glVars::prank::impl == glVars::pm) ws.rank_tmp.assign(m_vertexN, 0.0f); // auxiliary rank vector
+
+		prank::pm_accel accel;
+		accel.init = init;
+		accel.aitken_period = glVars::prank::aitken_period;
 
 		switch(glVars::prank::impl) {
 		  case glVars::pm:
-			  if (glVars::prank::use_weight) {
-				  prank::do_pageRank(*m_g, m_vertexN, &ppv_map[0],
-									 weight_map, &ranks[0], &rank_tmp[0],
-									 glVars::prank::num_iterations,
-									 glVars::prank::threshold,
-									 glVars::prank::damping,
-									 m_out_coefs);
-			  } else {
-				  prank::do_pageRank(*m_g, m_vertexN, &ppv_map[0],
-									 cte_weight, &ranks[0], &rank_tmp[0],
-									 glVars::prank::num_iterations,
-									 glVars::prank::threshold,
-									 glVars::prank::damping,
-									 m_out_coefs);
+			  {
+				  size_t iters;
+				  if (glVars::prank::num_threads > 1) {
+					  iters = pageRank_ppv_mt(ppv_map, ranks, init, ws);
+				  } else {
+					  iters = prank::do_pageRank_coef(m_vertexN, prank_in_csr(),
+													  &ppv_map[0], &ranks[0], &ws.rank_tmp[0],
+													  glVars::prank::num_iterations,
+													  glVars::prank::threshold,
+													  glVars::prank::damping,
+													  m_out_coefs, m_prank_active, m_prank_dangling,
+													  m_prank_weight, ws.scaled1, ws.scaled2, ws.x2, &accel);
+				  }
+				  ws.iters += iters;
+				  ws.edges += iters * m_edgeN;
 			  }
+			  ws.vectors++;
 			  break;
-		  case glVars::nibble:
-			  prank::pageRank_nibble_lazy(*m_g, ppv_map, m_out_coefs, glVars::prank::damping, glVars::prank::nibble_epsilon, ranks);
+		  case glVars::gs:
+			  {
+				  size_t iters = prank::do_pageRank_gs(m_vertexN, prank_in_csr(),
+													   &ppv_map[0], &ranks[0],
+													   glVars::prank::num_iterations,
+													   glVars::prank::threshold,
+													   glVars::prank::damping,
+													   glVars::prank::sor_omega,
+													   m_out_coefs, &accel);
+				  ws.iters += iters;
+				  ws.edges += iters * m_edgeN;
+			  }
+			  ws.vectors++;
 			  break;
+		  case glVars::adaptive:
+			  {
+				  // by default, vertices are frozen while their residual is
+				  // below an even share of the threshold
+				  float local_tol = glVars::prank::adaptive_tol;
+				  if (local_tol == 0.0f) local_tol = glVars::prank::threshold / m_vertexN;
+				  if (m_prank_weight) {
+					  const float *wmap = &m_eweight[0];
+					  ws.iters += pageRank_adaptive_run(m_rowstart, m_column, prank_in_csr(), m_out_coefs,
+														ppv_map, ranks, local_tol, wmap, &accel, ws);
+				  } else {
+					  prank::constant_property_map<size_t, float> wmap(1.0f);
+					  ws.iters += pageRank_adaptive_run(m_rowstart, m_column, prank_in_csr(), m_out_coefs,
+														ppv_map, ranks, local_tol, wmap, &accel, ws);
+				  }
+			  }
+			  ws.vectors++;
+			  break;
+		  case glVars::nibble:
+			  {
+				  // same pushes as pageRank_ppv_sparse, so that only the
+				  // vertices reached are visited
+				  Kb_sparse_vector pv, sranks;
+				  pv.clear(m_vertexN);
+				  for(size_t i = 0; i < m_vertexN; ++i) {
+					  if (ppv_map[i] != 0.0f) pv.push_back(i, ppv_map[i]);
+				  }
+				  prank::pageRank_push(m_vertexN, m_rowstart.data(), m_column.data(),
+									   pv.pairs(), m_out_coefs,
+									   glVars::prank::damping, glVars::prank::nibble_epsilon,
+									   ws.push, sranks.pairs());
+				  for(Kb_sparse_vector::const_iterator it = sranks.begin(), end = sranks.end();
+					  it != end; ++it) {
+					  ranks[it->first] = it->second;
+				  }
+			  }
+			  return;
+		  case glVars::mc:
+			  {
+				  Kb_sparse_vector pv, sranks;
+				  pv.clear(m_vertexN);
+				  for(size_t i = 0; i < m_vertexN; ++i) {
+					  if (ppv_map[i] != 0.0f) pv.push_back(i, ppv_map[i]);
+				  }
+				  pageRank_ppv_mc(pv, sranks);
+				  for(Kb_sparse_vector::const_iterator it = sranks.begin(), end = sranks.end();
+					  it != end; ++it) {
+					  ranks[it->first] = it->second;
+				  }
+			  }
+			  return;
 		default:
 			cerr << "Error! undefined method for PageRank calculation.\n";
 			exit(1);
 			break;
 		}
+		if (init) ws.warm++;
+		ws.aitken += accel.aitken_n;
+	}
+
+
+	// Sparse PPV version
+
+	void Kb::pageRank_ppv_sparse(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks) {
+
+		refresh_prank();
+		if (glVars::prank::impl == glVars::mc) load_fingerprints();
+		pageRank_ppv_sparse(ppv_map, ranks, m_ws);
 	}
 
+	void Kb::pageRank_ppv_sparse(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks,
+								 PrankWorkspace & ws) const {
+
+		check_prank();
+		if (m_ppv_cache.get()) {
+			pageRank_ppv_cached(ppv_map, ranks, ws);
+			return;
+		}
+		pageRank_ppv_sparse_iter(ppv_map, ranks, ws);
+	}
+
+	void Kb::pageRank_ppv_sparse_iter(const Kb_sparse_vector & ppv_map,
+									  Kb_sparse_vector & ranks,
+									  PrankWorkspace & ws) const {
+
+		ranks.clear(m_vertexN);
+		if (glVars::prank::impl == glVars::mc) {
+			pageRank_ppv_mc(ppv_map, ranks);
+			return;
+		}
+		if (glVars::prank::impl != glVars::nibble) {
+			vector<float> pv(m_vertexN, 0.0f);
+			for(Kb_sparse_vector::const_iterator it = ppv_map.begin(), end = ppv_map.end();
+				it != end; ++it) {
+				pv[it->first] = it->second;
+			}
+			vector<float> dense_ranks;
+			if (m_ppv_cache.get())
+				pageRank_ppv_init(pv, dense_ranks, 0, ws);
+			else
+				pageRank_ppv(pv, dense_ranks, ws);
+			for(size_t i = 0; i < m_vertexN; ++i) {
+				if (dense_ranks[i] != 0.0f) ranks.push_back(i, dense_ranks[i]);
+			}
+			return;
+		}
+		prank::pageRank_push(m_vertexN, m_rowstart.data(), m_column.data(),
+							 ppv_map.pairs(), m_out_coefs,
+							 glVars::prank::damping, glVars::prank::nibble_epsilon,
+							 ws.push, ranks.pairs());
+	}
+
+	// Monte-Carlo PPV version, from the fingerprints of the vertices in ppv_map
+
+	void Kb::pageRank_ppv_mc(const Kb_sparse_vector & ppv_map,
+							 Kb_sparse_vector & ranks) const {
+
+		if (m_fp_R == 0)
+			throw std::logic_error("pageRank_ppv: random walk fingerprints are not loaded");
+		ranks.clear(m_vertexN);
+		prank::pageRank_mc(ppv_map.pairs(), &m_fp[0], m_fp_R, ranks.pairs());
+		ranks.sort_merge();
+	}
+
+	// L1 distance bound from a PPV of mass W, computed in iters
+	// iterations, to the exact one. If iterations stopped at the threshold,
+	// it is at most threshold / (1 - damping). Else it is at most
+	// damping^iters times the distance from the initial vector (of mass 1)
+	// to the exact PPV, that is, damping^iters * (1 + W). Methods that do
+	// not iterate (nibble, mc) get the trivial bound 1 + W. The bound
+	// does not hold with Aitken extrapolation.
+
+	static float rest_solver_bound(size_t iters, float W) {
+		int max_iters = glVars::prank::num_iterations;
+		if (iters && glVars::prank::threshold > 0.0f &&
+			(max_iters == 0 || iters < static_cast<size_t>(max_iters)))
+			return glVars::prank::threshold / (1.0f - glVars::prank::damping);
+		return std::pow(glVars::prank::damping, static_cast<float>(iters)) * (1.0f + W);
+	}
+
+	// PPV composed from the PPV cache. The stored PPVs of the vertices of
+	// ppv_map are added up, and PageRank is only computed for the rest of
+	// vertices.
+	//
+	// The L1 error bound of the result is the sum of the bounds of the
+	// stored PPVs (see PpvCache) plus the solver error of the rest, which
+	// rest_solver_bound estimates.
+
+	static void add_ppvc_bound(PrankWorkspace & ws, float bound) {
+		++ws.ppvc_queries;
+		ws.ppvc_bound_sum += bound;
+		if (bound > ws.ppvc_bound_max) ws.ppvc_bound_max = bound;
+	}
+
+	void Kb::pageRank_ppv_cached(const vector<float> & ppv_map,
+								 vector<float> & ranks,
+								 PrankWorkspace & ws) const {
+
+		vector<float> & rest = ws.rest;
+		vector<float> & acc = ws.acc;
+		acc.assign(m_vertexN, 0.0f);
+		float bound = 0.0f;
+		bool missing = false;
+		for(size_t i = 0; i < m_vertexN; ++i) {
+			float w = ppv_map[i];
+			if (w == 0.0f) continue;
+			const PpvCache::entry_t *e = m_ppv_cache->find(i);
+			if (!e) {
+				if (!missing) rest.assign(m_vertexN, 0.0f);
+				rest[i] = w;
+				missing = true;
+				++ws.ppvc_misses;
+				continue;
+			}
+			++ws.ppvc_hits;
+			bound += w * (e->tail + e->err);
+			m_ppv_cache->add_to(*e, w, acc);
+		}
+		if (missing) {
+			float W = 0.0f;
+			for(size_t i = 0; i < m_vertexN; ++i) W += rest[i];
+			size_t iters = ws.iters;
+			pageRank_ppv_init(rest, ranks, 0, ws);
+			bound += rest_solver_bound(ws.iters - iters, W);
+			for(size_t i = 0; i < m_vertexN; ++i) ranks[i] += acc[i];
+		} else {
+			ranks.swap(acc);
+		}
+		add_ppvc_bound(ws, bound);
+	}
+
+	void Kb::pageRank_ppv_cached(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks,
+								 PrankWorkspace & ws) const {
+
+		Kb_sparse_vector rest;
+		rest.clear(m_vertexN);
+		float bound = 0.0f;
+		vector<Kb_sparse_vector::value_type> acc;
+		for(Kb_sparse_vector::const_iterator it = ppv_map.begin(), end = ppv_map.end();
+			it != end; ++it) {
+			const PpvCache::entry_t *e = m_ppv_cache->find(it->first);
+			if (!e) {
+				rest.push_back(it->first, it->second);
+				++ws.ppvc_misses;
+				continue;
+			}
+			++ws.ppvc_hits;
+			bound += it->second * (e->tail + e->err);
+			m_ppv_cache->append_to(*e, it->second, acc);
+		}
+		if (rest.nnz()) {
+			float W = 0.0f;
+			for(Kb_sparse_vector::const_iterator r_it = rest.begin(), r_end = rest.end();
+				r_it != r_end; ++r_it) W += r_it->second;
+			size_t iters = ws.iters;
+			pageRank_ppv_sparse_iter(rest, ranks, ws);
+			bound += rest_solver_bound(ws.iters - iters, W);
+		} else {
+			ranks.clear(m_vertexN);
+		}
+		ranks.pairs().insert(ranks.pairs().end(), acc.begin(), acc.end());
+		ranks.sort_merge();
+		add_ppvc_bound(ws, bound);
+	}
+
+	void Kb::load_ppv_cache(const string & fname) {
+
+		std::auto_ptr<PpvCache> cache(new PpvCache);
+		cache->open(fname, m_vertexN, graph_checksum(glVars::prank::use_weight),
+					glVars::prank::damping, glVars::prank::use_weight);
+		m_ppv_cache = cache;
+	}
+
+	// Run the batched kernel over the K personalization vectors interleaved
+	// in ws.batch_pv, pulling the ranks from a bfloat16 copy if bf16 is set,
+	// and de-interleave the results
+
+	static size_t pageRank_batch_run(const prank::in_csr<Kb_index_t, Kb_vertex_t> & in, size_t K,
+									 const vector<float> & out_coefs,
+									 prank::pm_accel & accel,
+									 bool bf16,
+									 vector<vector<float> > & ranks,
+									 PrankWorkspace & ws) {
+
+		size_t N = out_coefs.size();
+		vector<float> & rank_nk = ws.batch_ranks;
+		rank_nk.assign(N * K, 0.0f);
+		if (bf16) ws.batch_pulled.resize(N * K);
+		else ws.batch_tmp.assign(N * K, 0.0f);
+
+		size_t iters = prank::do_pageRank_batch(N, K, in,
+												&ws.batch_pv[0], &rank_nk[0],
+												bf16 ? static_cast<float *>(0) : &ws.batch_tmp[0],
+												bf16 ? &ws.batch_pulled[0] : static_cast<bfloat16 *>(0),
+												glVars::prank::num_iterations,
+												glVars::prank::threshold,
+												glVars::prank::damping,
+												out_coefs, ws.batch, &accel);
+		// de-interleave
+		for(size_t k = 0; k < K; ++k) {
+			vector<float> & ranks_k = ranks[k];
+			ranks_k.resize(N);
+			for(size_t i = 0; i < N; ++i)
+				ranks_k[i] = rank_nk[i * K + k];
+		}
+		return iters;
+	}
+
+	// Batched PPV version. All personalization vectors are computed at once.
+
+	void Kb::pageRank_ppv_batch(const vector<vector<float> > & ppvs,
+								size_t K,
+								vector<vector<float> > & ranks) {
+
+		refresh_prank();
+		if (glVars::prank::impl == glVars::mc) load_fingerprints();
+		pageRank_ppv_batch(ppvs, K, ranks, m_ws);
+	}
+
+	void Kb::pageRank_ppv_batch(const vector<vector<float> > & ppvs,
+								size_t K,
+								vector<vector<float> > & ranks,
+								PrankWorkspace & ws) const {
+
+		if (ranks.size() < K) ranks.resize(K);
+		if (K == 0) return;
+
+		// Only the single-threaded power method has a batched kernel
+		if (K == 1 || glVars::prank::impl != glVars::pm || glVars::prank::num_threads > 1 ||
+			m_ppv_cache.get()) {
+			for(size_t k = 0; k < K; ++k)
+				pageRank_ppv(ppvs[k], ranks[k], ws);
+			return;
+		}
+
+		check_prank();
+
+		// interleave personalization vectors (N x K layout)
+		vector<float> & pv = ws.batch_pv;
+		pv.resize(m_vertexN * K);
+		for(size_t k = 0; k < K; ++k) {
+			const vector<float> & ppv_k = ppvs[k];
+			for(size_t i = 0; i < m_vertexN; ++i)
+				pv[i * K + k] = ppv_k[i];
+		}
+
+		prank::pm_accel accel;
+		accel.init = prank_init_vector(ws);
+		accel.aitken_period = glVars::prank::aitken_period;
+
+		size_t iters = pageRank_batch_run(prank_in_csr(), K, m_out_coefs, accel,
+										  glVars::prank::bf16_ranks, ranks, ws);
+		ws.iters += iters;
+		ws.edges += iters * m_edgeN;
+		ws.vectors += K;
+		if (accel.init) ws.warm += K;
+		ws.aitken += accel.aitken_n;
+
+		if (glVars::prank::init == glVars::init_prev) ws.prev_ranks = ranks[K - 1];
+	}
+
+	// Multi-threaded power method
+
+	size_t Kb::pageRank_ppv_mt(const vector<float> & ppv_map,
+							   vector<float> & ranks,
+							   const float *init,
+							   PrankWorkspace & ws) const {
+
+		const vector<size_t> *chunks = &m_prank_chunks;
+		if (m_prank_chunks.size() != glVars::prank::num_threads + 1) {
+			if (ws.chunks.size() != glVars::prank::num_threads + 1)
+				prank::edge_balanced_chunks(prank_in_csr(), glVars::prank::num_threads, ws.chunks);
+			chunks = &ws.chunks;
+		}
+
+		return prank::do_pageRank_mt(m_vertexN, prank_in_csr(),
+									 &ppv_map[0], &ranks[0], &ws.rank_tmp[0],
+									 glVars::prank::num_iterations,
+									 glVars::prank::threshold,
+									 glVars::prank::damping,
+									 m_out_coefs, m_prank_active, m_prank_dangling,
+									 m_prank_weight, *chunks, ws.scaled1, ws.scaled2, init);
+	}
+
+	ostream & Kb::write_prank_stats(ostream & o) const {
+		return write_prank_stats(o, m_ws);
+	}
+
+	ostream & Kb::write_prank_stats(ostream & o, const PrankWorkspace & ws) const {
+		o << "PageRank: " << ws.vectors << " vectors, " << ws.iters << " iterations";
+		if (ws.vectors)
+			o << " (" << static_cast<double>(ws.iters) / ws.vectors << " per vector)";
+		o << ", " << ws.edges << " edges visited";
+		o << ", " << ws.warm << " warm starts, " << ws.aitken << " extrapolations\n";
+		if (m_ppv_cache.get()) {
+			size_t n = ws.ppvc_hits + ws.ppvc_misses;
+			o << "PPV cache: " << m_ppv_cache->header().entry_n << " PPVs (top "
+			  << m_ppv_cache->header().topk << ", " << m_ppv_cache->header().value_bits
+			  << " bit values), " << ws.ppvc_hits << " hits, "
+			  << ws.ppvc_misses << " misses";
+			if (n)
+				o << " (" << 100.0 * ws.ppvc_hits / n << "% hit rate)";
+			o << ", L1 error bound max " << ws.ppvc_bound_max;
+			if (ws.ppvc_queries)
+				o << ", mean " << ws.ppvc_bound_sum / ws.ppvc_queries;
+			o << "\n";
+		}
+		return o;
+	}
 
 	////////////////////////////////////////////////////////////////////////////////
 	// Debug
@@ -826,21 +2302,148 @@ namespace ukb {
 		o << "Sources: ";
 		writeS(o, m_relsSource);
 		o << endl;
+		const KbGraph & g = boost_graph();
 		graph_traits<KbGraph>::vertex_iterator it, end;
-		tie(it, end) = vertices(*m_g);
+		tie(it, end) = vertices(g);
 		for(;it != end; ++it) {
-			o << (*m_g)[*it].name;
+			o << get_vertex_name(*it);
 			graph_traits<KbGraph>::out_edge_iterator e, e_end;
-			tie(e, e_end) = out_edges(*it, *m_g);
+			tie(e, e_end) = out_edges(*it, g);
 			if (e != e_end)
 				o << "\n";
 			for(; e != e_end; ++e) {
 				o << "  ";
 				vector<string> r = edge_reltypes(*e);
 				writeV(o, r);
-				o << " " << (*m_g)[target(*e, *m_g)].name;
-				o << " (" << (*m_g)[*e].weight << ")\n";
+				o << " " << get_vertex_name(target(*e, g));
+				o << " (" << m_eweight[e->idx] << ")\n";
+			}
+		}
+		return o;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Load profile
+
+	static boost::posix_time::ptime wall_now() {
+		return boost::posix_time::microsec_clock::universal_time();
+	}
+
+	static double wall_secs(const boost::posix_time::ptime & a, const boost::posix_time::ptime & b) {
+		return (b - a).total_microseconds() / 1e6;
+	}
+
+	static void add_load_step(vector<Kb::load_step_t> & steps, const string & name,
+							  size_t bytes, double secs, bool concurrent) {
+		Kb::load_step_t st;
+		st.name = name;
+		st.bytes = bytes;
+		st.secs = secs;
+		st.concurrent = concurrent;
+		steps.push_back(st);
+	}
+
+	// Records the steps of a load, one after the other
+
+	class load_timer {
+	public:
+		load_timer(vector<Kb::load_step_t> & steps) : m_steps(steps), m_t(wall_now()) {
+			m_steps.clear();
+		}
+
+		// The step finishing now
+		void step(const string & name, size_t bytes) {
+			boost::posix_time::ptime t = wall_now();
+			add_load_step(m_steps, name, bytes, wall_secs(m_t, t), false);
+			m_t = t;
+		}
+
+	private:
+		vector<Kb::load_step_t> & m_steps;
+		boost::posix_time::ptime m_t;
+	};
+
+	// A step run concurrently with others. Errors are kept, and thrown
+	// by the loading thread once all steps are over (see throw_errors).
+
+	struct load_task {
+		string name;
+		size_t bytes;
+		boost::function<void ()> f;
+		double secs;
+		string error;
+
+		load_task(const string & name_, size_t bytes_, const boost::function<void ()> & f_)
+			: name(name_), bytes(bytes_), f(f_), secs(0.0) {}
+
+		void operator()() {
+			boost::posix_time::ptime t = wall_now();
+			try {
+				f();
+			} catch (std::exception & e) {
+				error = e.what();
 			}
+			secs = wall_secs(t, wall_now());
+		}
+	};
+
+	static void throw_errors(const vector<load_task> & tasks) {
+		for(size_t i = 0; i != tasks.size(); ++i) {
+			if (!tasks[i].error.empty())
+				throw runtime_error(tasks[i].error);
+		}
+	}
+
+	static void add_load_steps(vector<Kb::load_step_t> & steps, const vector<load_task> & tasks) {
+		for(size_t i = 0; i != tasks.size(); ++i)
+			add_load_step(steps, tasks[i].name, tasks[i].bytes, tasks[i].secs, true);
+	}
+
+	// Run tasks with a pool of threads (the calling one included), each
+	// taking the next pending task
+
+	class load_pool {
+	public:
+		load_pool(vector<load_task> & tasks) : m_tasks(tasks), m_next(0) {}
+
+		void run() {
+			size_t n_threads = std::min<size_t>(boost::thread::hardware_concurrency(), m_tasks.size());
+			boost::thread_group workers;
+			for(size_t t = 1; t < n_threads; ++t)
+				workers.create_thread(boost::bind(&load_pool::work, this));
+			work();
+			workers.join_all();
+		}
+
+	private:
+		void work() {
+			for(;;) {
+				size_t i;
+				{
+					boost::mutex::scoped_lock lock(m_mutex);
+					if (m_next == m_tasks.size()) return;
+					i = m_next++;
+				}
+				m_tasks[i]();
+			}
+		}
+
+		vector<load_task> & m_tasks;
+		size_t m_next;
+		boost::mutex m_mutex;
+	};
+
+	ostream & Kb::write_load_stats(ostream & o) const {
+		double total = 0.0;
+		for(size_t i = 0; i != m_load_steps.size(); ++i) {
+			if (!m_load_steps[i].concurrent) total += m_load_steps[i].secs;
+		}
+		o << "KB load: " << total * 1000 << " ms\n";
+		for(size_t i = 0; i != m_load_steps.size(); ++i) {
+			const load_step_t & st = m_load_steps[i];
+			o << (st.concurrent ? "    " : "  ") << st.name << ": " << st.secs * 1000 << " ms";
+			if (st.bytes) o << ", " << st.bytes << " bytes";
+			o << "\n";
 		}
 		return o;
 	}
@@ -851,38 +2454,145 @@ namespace ukb {
 	static const size_t magic_id_v1 = 0x070201;
 	static const size_t magic_id = 0x080826;
 	static const size_t magic_id_csr = 0x110501;
+	static const size_t magic_id_csr_bf16 = 0x110502; // same as csr, with bfloat16 edge weights
+	static const size_t magic_id_csr_fmt = 0x110503;  // same as csr, followed by the bits of weights and indices
+	static const size_t magic_id_csr_sym = 0x110504;  // same as csr_fmt, with symmetric in-edges (see init_in_edges)
 
 	// CSR read
 
-	vertex_prop_t read_vertex_prop_from_stream(istream & is) {
+	// Read a vertex name into the name pool. buf is reused among calls.
 
-		string name;
+	void read_vertex_name_from_stream(istream & is, NameIndex & names, vector<char> & buf) {
 
-		read_atom_from_stream(is, name);
-		return vertex_prop_t(name);
+		size_t len;
+
+		read_atom_from_stream(is, len);
+		if (!is) throw runtime_error("Truncated vertex names");
+		if (buf.size() < len) buf.resize(len);
+		if (len) is.read(&buf[0], len);
+		names.push_back(len ? &buf[0] : "", len);
 	}
 
-	edge_prop_t read_edge_prop_from_stream(istream & is) {
+	void read_edge_prop_from_stream(istream & is, bool bf16,
+									float & w, etype_t::value_type & etype) {
 
-		float w;
-		etype_t::value_type etype;
-
-		read_atom_from_stream(is, w);
+		if (bf16) {
+			bfloat16 w16;
+			read_atom_from_stream(is, w16);
+			w = w16;
+		} else {
+			read_atom_from_stream(is, w);
+		}
 		read_atom_from_stream(is, etype);
+	}
 
-		return edge_prop_t(w, etype);
+	static void skip_synset_map(istream & is, size_t index_bits) {
 
+		size_t map_n;
+		size_t len;
+		read_atom_from_stream(is, map_n);
+		for(size_t i = 0; i != map_n && is; ++i) {
+			read_atom_from_stream(is, len);
+			is.ignore(len + index_bits / 8);
+		}
+	}
+
+	// Copy indices to a vector of (possibly) different width
+
+	template<typename S, typename T>
+	static void convert_indices(const S *src, size_t n, vector<T> & v) {
+
+		vector<T> aux(n);
+		for(size_t i = 0; i != n; ++i) {
+			if (src[i] > std::numeric_limits<T>::max())
+				throw runtime_error("KB too large for " + lexical_cast<string>(sizeof(T) * 8) +
+									" bit indices (build with -DUKB_KB_INDEX64)");
+			aux[i] = static_cast<T>(src[i]);
+		}
+		aux.swap(v);
+	}
+
+	// Read a vector of indices stored with index_bits bits
+
+	template<typename T>
+	static void read_index_vector_from_stream(istream & is, vector<T> & v, size_t index_bits) {
+
+		if (index_bits == sizeof(T) * 8) {
+			read_vector_from_stream(is, v);
+		} else if (index_bits == 32) {
+			vector<boost::uint32_t> aux;
+			read_vector_from_stream(is, aux);
+			convert_indices(aux.empty() ? 0 : &aux[0], aux.size(), v);
+		} else {
+			vector<boost::uint64_t> aux;
+			read_vector_from_stream(is, aux);
+			convert_indices(aux.empty() ? 0 : &aux[0], aux.size(), v);
+		}
+	}
+
+	// Check the in-edges (see init_in_edges) of a graph read from a file
+
+	template<typename IndexArray, typename VertexArray>
+	static void check_in_edges(size_t vertex_n, size_t edge_n,
+							   const IndexArray & rowstart,
+							   const IndexArray & sym_end,
+							   const IndexArray & ovl_rowstart,
+							   const VertexArray & ovl_column,
+							   const IndexArray & ovl_edge) {
+
+		if (rowstart.size() != vertex_n + 1 || sym_end.size() != vertex_n ||
+			ovl_rowstart.size() != vertex_n + 1 || ovl_column.size() != ovl_rowstart[vertex_n] ||
+			ovl_edge.size() != ovl_column.size())
+			throw runtime_error("Invalid in-edges");
+		for(size_t v = 0; v != vertex_n; ++v) {
+			if (sym_end[v] < rowstart[v] || sym_end[v] > rowstart[v + 1])
+				throw runtime_error("Invalid in-edges");
+		}
+		for(size_t i = 0, m = ovl_column.size(); i != m; ++i) {
+			if (ovl_column[i] >= vertex_n || ovl_edge[i] >= edge_n)
+				throw runtime_error("Invalid in-edges");
+		}
+	}
+
+	static size_t stream_pos(istream & is) {
+		std::streamoff p = is.tellg();
+		return p < 0 ? 0 : static_cast<size_t>(p);
 	}
 
 	void  Kb::read_from_stream (std::istream & is) {
 
+		load_timer timer(m_load_steps);
+		size_t pos = stream_pos(is);
 		size_t vertex_n;
 		size_t edge_n;
 		size_t id;
 		KbGraph *new_g;
+		NameIndex names;
+		vector<float> eweight;
+		vector<etype_t::value_type> etype;
+		bool sym;
+		vector<Kb_index_t> sym_end;
+		vector<Kb_index_t> ovl_rowstart;
+		vector<Kb_vertex_t> ovl_column;
+		vector<Kb_index_t> ovl_edge;
 
 		try {
 			read_atom_from_stream(is, id);
+			size_t weight_bits = 32;
+			size_t index_bits = 64; // older files use 64 bit indices
+			sym = false;            // older files have a backward CSR
+			if (id == magic_id_csr_bf16) {
+				weight_bits = 16;
+				id = magic_id_csr;
+			} else if (id == magic_id_csr_fmt || id == magic_id_csr_sym) {
+				sym = (id == magic_id_csr_sym);
+				read_atom_from_stream(is, weight_bits);
+				read_atom_from_stream(is, index_bits);
+				if ((weight_bits != 32 && weight_bits != 16) || (index_bits != 32 && index_bits != 64))
+					throw runtime_error("Invalid format of weights or indices");
+				id = magic_id_csr;
+			}
+			bool bf16 = (weight_bits == 16);
 			if (id != magic_id_csr) {
 				if (id == magic_id_v1 || id == magic_id)
 					throw runtime_error("Old (pre 2.0) binary serialization format. Convert the graph to new format using the \"convert2.0\" utility.");
@@ -891,7 +2601,8 @@ namespace ukb {
 			}
 			read_set_from_stream(is, m_relsSource);
 			m_rtypes.read_from_stream(is);
-			read_map_from_stream(is, m_synsetMap);
+			// The synset map is built from the vertex names instead
+			skip_synset_map(is, index_bits);
 
 			read_atom_from_stream(is, id);
 			if (id != magic_id_csr) {
@@ -905,54 +2616,104 @@ namespace ukb {
 			if (id != magic_id_csr) {
 				throw runtime_error("Invalid id after reading graph sizes");
 			}
+			timer.step("header", stream_pos(is) - pos);
+			pos = stream_pos(is);
 			new_g = new KbGraph();
 
 			new_g->m_forward.m_rowstart.resize(0);
-			read_vector_from_stream(is, new_g->m_forward.m_rowstart);
-			read_vector_from_stream(is, new_g->m_forward.m_column);
-			new_g->m_backward.m_rowstart.resize(0);
-			read_vector_from_stream(is, new_g->m_backward.m_rowstart);
-			read_vector_from_stream(is, new_g->m_backward.m_column);
-			read_vector_from_stream(is, new_g->m_backward.m_edge_properties);
+			read_index_vector_from_stream(is, new_g->m_forward.m_rowstart, index_bits);
+			read_index_vector_from_stream(is, new_g->m_forward.m_column, index_bits);
+			timer.step("graph", stream_pos(is) - pos);
+			pos = stream_pos(is);
+			if (sym) {
+				read_index_vector_from_stream(is, sym_end, index_bits);
+				read_index_vector_from_stream(is, ovl_rowstart, index_bits);
+				read_index_vector_from_stream(is, ovl_column, index_bits);
+				read_index_vector_from_stream(is, ovl_edge, index_bits);
+				check_in_edges(vertex_n, edge_n, new_g->m_forward.m_rowstart,
+							   sym_end, ovl_rowstart, ovl_column, ovl_edge);
+			} else {
+				// backward CSR (rowstart, column and edge indices), which
+				// init_in_edges replaces
+				vector<Kb_index_t> backward;
+				for(int i = 0; i != 3; ++i)
+					read_index_vector_from_stream(is, backward, index_bits);
+			}
+			timer.step("in-edges", stream_pos(is) - pos);
+			pos = stream_pos(is);
 
+			vector<char> buf;
 			for(size_t i = 0; i != vertex_n; ++i) {
-				new_g->vertex_properties().m_vertex_properties.push_back(read_vertex_prop_from_stream(is));
+				read_vertex_name_from_stream(is, names, buf);
 			}
-
-			for(size_t i = 0; i != edge_n; ++i) {
-				new_g->m_forward.m_edge_properties.push_back(read_edge_prop_from_stream(is));
+			timer.step("names", stream_pos(is) - pos);
+			pos = stream_pos(is);
+
+			// The name index is built while edge properties are read
+			vector<float>(edge_n).swap(eweight);
+			vector<etype_t::value_type>(edge_n).swap(etype);
+			vector<load_task> tasks(1, load_task("name index", 0, boost::bind(&NameIndex::build_table, &names)));
+			boost::thread name_thread(boost::ref(tasks[0]));
+			for(size_t i = 0; i != edge_n && is; ++i) {
+				read_edge_prop_from_stream(is, bf16, eweight[i], etype[i]);
 			}
+			name_thread.join();
+			throw_errors(tasks);
+			timer.step("edge properties", stream_pos(is) - pos);
+			add_load_steps(m_load_steps, tasks);
+			pos = stream_pos(is);
 
 			read_atom_from_stream(is, id);
 			if (id != magic_id_csr) {
 				throw runtime_error("Invalid id after reading graph");
 			}
 			read_vector_from_stream(is, m_notes);
+			timer.step("notes", stream_pos(is) - pos);
 		} catch (std::exception & e) {
 			throw runtime_error(string("Error when reading serialized graph: ") + e.what());
 		}
 
 		m_g.reset(new_g);
+		map_csr();
+		m_names.swap(names);
+		m_eweight.swap(eweight);
+		m_etype.swap(etype);
 		vector<float>().swap(m_static_ppv); // empty static rank vector
 
 		m_vertexN = vertex_n;
 		m_edgeN = edge_n;
 		assert(num_vertices(*m_g) == m_vertexN);
 		assert(num_edges(*m_g) == m_edgeN);
+		if (sym) {
+			m_sym_end.swap(sym_end);
+			m_ovl_rowstart.swap(ovl_rowstart);
+			m_ovl_column.swap(ovl_column);
+			m_ovl_edge.swap(ovl_edge);
+		} else {
+			init_in_edges();
+			timer.step("in-edges (rebuilt)", 0);
+		}
+		init_prank();
+		timer.step("PageRank setup", 0);
 	}
 
 	// write
 
-	ostream & write_vertex_prop_to_stream(ostream & o,
-										  const vertex_prop_t & p) {
-		write_atom_to_stream(o, p.name);
+	ostream & write_vertex_name_to_stream(ostream & o,
+										  const name_ref & name) {
+		write_atom_to_stream(o, name.size);
+		o.write(name.data, name.size);
 		return o;
 	}
 
 	ostream & write_edge_prop_to_stream(ostream & o,
-										const edge_prop_t & ep) {
-		write_atom_to_stream(o, ep.weight);
-		write_atom_to_stream(o, ep.etype);
+										float w, etype_t::value_type etype,
+										bool bf16) {
+		if (bf16)
+			write_atom_to_stream(o, bfloat16(w));
+		else
+			write_atom_to_stream(o, w);
+		write_atom_to_stream(o, etype);
 		return o;
 	}
 
@@ -960,14 +2721,21 @@ namespace ukb {
 
 		// First write maps
 
-		assert(m_vertexN == num_vertices(*m_g));
-		assert(m_edgeN == num_edges(*m_g));
+		assert(m_rowstart.size() == m_vertexN + 1);
+		assert(m_column.size() == m_edgeN);
 
-		write_atom_to_stream(o, magic_id_csr);
+		write_atom_to_stream(o, magic_id_csr_sym);
+		write_atom_to_stream(o, size_t(glVars::kb::bf16_weights ? 16 : 32));
+		write_atom_to_stream(o, size_t(sizeof(Kb_index_t) * 8));
 
 		write_vector_to_stream(o, m_relsSource);
 		m_rtypes.write_to_stream(o);
-		write_map_to_stream(o, m_synsetMap);
+		// synset map, as (name, vertex) pairs
+		write_atom_to_stream(o, m_vertexN);
+		for(size_t i = 0; i != m_vertexN; ++i) {
+			write_vertex_name_to_stream(o, get_vertex_name(i));
+			write_atom_to_stream(o, Kb_vertex_t(i));
+		}
 
 		write_atom_to_stream(o, magic_id_csr);
 
@@ -976,25 +2744,21 @@ namespace ukb {
 
 		write_atom_to_stream(o, magic_id_csr);
 
-		write_vector_to_stream(o, m_g->m_forward.m_rowstart);
-		write_vector_to_stream(o, m_g->m_forward.m_column);
-		write_vector_to_stream(o, m_g->m_backward.m_rowstart);
-		write_vector_to_stream(o, m_g->m_backward.m_column);
-		write_vector_to_stream(o, m_g->m_backward.m_edge_properties);
-
-		//	write_vector_to_stream(o, m_g->vertex_properties().m_vertex_properties);
-		//	write_vector_to_stream(o, m_g->m_forward.m_edge_properties);
+		write_vector_to_stream(o, m_rowstart);
+		write_vector_to_stream(o, m_column);
+		write_vector_to_stream(o, m_sym_end);
+		write_vector_to_stream(o, m_ovl_rowstart);
+		write_vector_to_stream(o, m_ovl_column);
+		write_vector_to_stream(o, m_ovl_edge);
 
-		size_t vProp_n = m_g->vertex_properties().m_vertex_properties.size();
-		assert(vProp_n == m_vertexN);
-		for(size_t i = 0; i != vProp_n; ++i) {
-			write_vertex_prop_to_stream(o, m_g->vertex_properties().m_vertex_properties[i]);
+		assert(m_names.size() == m_vertexN);
+		for(size_t i = 0; i != m_vertexN; ++i) {
+			write_vertex_name_to_stream(o, get_vertex_name(i));
 		}
 
-		size_t eProp_n = m_g->m_forward.m_edge_properties.size();
-		assert(eProp_n == m_edgeN);
-		for(size_t i = 0; i != eProp_n; ++i) {
-			write_edge_prop_to_stream(o, m_g->m_forward.m_edge_properties[i]);
+		assert(m_eweight.size() == m_edgeN);
+		for(size_t i = 0; i != m_edgeN; ++i) {
+			write_edge_prop_to_stream(o, m_eweight[i], m_etype[i], glVars::kb::bf16_weights);
 		}
 
 		write_atom_to_stream(o, magic_id_csr);
@@ -1011,18 +2775,1061 @@ namespace ukb {
 			cerr << "Error: can't create" << fName << endl;
 			exit(-1);
 		}
-		write_to_stream(fo);
+		if (glVars::kb::mmap_format)
+			write_to_mapstream(fo);
+		else
+			write_to_stream(fo);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// External-memory compilation (see compile_kb --mem_budget)
+	//
+	// compile_from_txt writes the same binfile as read_from_txt and
+	// write_to_stream do, but only vertex names and a few arrays with one
+	// index per vertex stay in memory. Edges go through external sorts (see
+	// ExtSorter) and temporary files:
+	//
+	//   1. Parse the relations, interning vertex names, and sort the
+	//      inserted edges by (source, target, insertion order).
+	//   2. Merge repeated edges as precsr_t::insert_edge does (the first
+	//      insertion gives the position, the last one the weight, and
+	//      relation types add up) into the edge file, and sort the reverse
+	//      of every edge.
+	//   3. Join both, row by row: u->v is symmetric if v->u is an edge too.
+	//      Lay out each row as in memory (symmetric edges first, each group
+	//      in insertion order; see init_in_edges), writing its targets and
+	//      properties, and sort the edges without a reverse by (target,
+	//      source), which is the order of the overlay.
+	//   4. Write the binfile, copying the arrays from the temporary files.
+	//
+	// Each stage splits the memory left by the vertex data among the sorters
+	// it uses.
+
+	struct ext_edge {
+		Kb_vertex_t u;
+		Kb_vertex_t v;
+		size_t seq;                     // insertion order
+		float w;
+		etype_t::value_type etype;
+	};
+
+	struct ext_edge_lt {
+		bool operator()(const ext_edge & a, const ext_edge & b) const {
+			if (a.u != b.u) return a.u < b.u;
+			if (a.v != b.v) return a.v < b.v;
+			return a.seq < b.seq;
+		}
+	};
+
+	// Overlay in-edge u->v, with its edge index
+
+	struct ext_ovl {
+		Kb_vertex_t v;
+		Kb_vertex_t u;
+		Kb_index_t idx;
+	};
+
+	struct ext_ovl_lt {
+		bool operator()(const ext_ovl & a, const ext_ovl & b) const {
+			if (a.v != b.v) return a.v < b.v;
+			return a.u < b.u;
+		}
+	};
+
+	// Out-edge of the row being laid out
+
+	struct ext_slot {
+		bool sym;
+		size_t seq;
+		Kb_vertex_t v;
+		float w;
+		etype_t::value_type etype;
+	};
+
+	static bool ext_slot_lt(const ext_slot & a, const ext_slot & b) {
+		if (a.sym != b.sym) return a.sym;
+		return a.seq < b.seq;
+	}
+
+	// Temporary files, removed when done
+
+	struct ext_tmp {
+		string prefix;
+		vector<string> files;
+
+		ext_tmp(const string & p) : prefix(p) {}
+		~ext_tmp() {
+			for(size_t i = 0; i != files.size(); ++i)
+				std::remove(files[i].c_str());
+		}
+
+		string file(const string & suffix) {
+			files.push_back(prefix + "." + suffix);
+			return files.back();
+		}
+	};
+
+	static bool ext_read(istream & is, ext_edge & e) {
+		read_atom_from_stream(is, e);
+		return static_cast<bool>(is);
+	}
+
+	static void ext_check(const ios & s, const string & fname) {
+		if (!s) throw runtime_error("[E] compiling KB: can not write " + fname);
+	}
+
+	// Append the contents of file fname to o
+
+	static void ext_copy(ostream & o, const string & fname) {
+		ifstream fi(fname.c_str(), ifstream::binary|ifstream::in);
+		if (!fi) throw runtime_error("[E] compiling KB: can not read " + fname);
+		if (fi.peek() != EOF) o << fi.rdbuf();
+	}
+
+	// Memory left for the sorters by the vertex data
+
+	static size_t ext_memory(size_t vertex_bytes) {
+		if (vertex_bytes >= glVars::kb::mem_budget)
+			throw runtime_error("[E] compiling KB: vertex names and arrays (" +
+								lexical_cast<string>(vertex_bytes >> 20) + " MB) do not fit in the memory budget");
+		return glVars::kb::mem_budget - vertex_bytes;
+	}
+
+	std::pair<size_t, size_t> Kb::compile_from_txt(std::istream & is,
+												   const set<string> & src_allowed,
+												   const string & binFile,
+												   const vector<string> & notes) {
+
+		if (glVars::kb::reorder != glVars::reorder_none)
+			throw runtime_error("[E] compiling KB: vertices can not be reordered out of memory");
+		if (glVars::kb::mmap_format)
+			throw runtime_error("[E] compiling KB: the aligned format can not be written out of memory");
+
+		size_t max_n = std::numeric_limits<Kb_index_t>::max();
+		ext_tmp tmp(binFile + ".tmp");
+		NameIndex names;
+		set<string> srcs;
+		string edge_file(tmp.file("edges"));
+		string col_file(tmp.file("column"));
+		string prop_file(tmp.file("props"));
+		string ovl_file(tmp.file("overlay"));
+		vector<Kb_index_t> rowstart;
+		vector<Kb_index_t> sym_end;
+		vector<Kb_index_t> ovl_rowstart;
+		size_t V = 0;
+		size_t E = 0;
+		size_t mem = 0;
+		ExtSorter<ext_ovl, ext_ovl_lt> ovl(tmp.prefix + ".ovl", 0);
+
+		{
+			ExtSorter<pair<Kb_vertex_t, Kb_vertex_t> > rev(tmp.prefix + ".rev", 0);
+			{
+				// 1. parse
+
+				ExtSorter<ext_edge, ext_edge_lt> edges(tmp.prefix + ".ins", glVars::kb::mem_budget);
+				etype_t rtypes;
+				size_t seq = 0;
+				string line;
+				size_t line_number = 0;
+				rel_parse f;
+				while(is) {
+					if (edges.memory() + names.memory() >= glVars::kb::mem_budget) {
+						ext_memory(names.memory());
+						edges.spill();
+					}
+					read_line_noblank(is, line, line_number);
+					if(!is) continue;
+					if (line[0] == '#') continue;
+					try {
+						if (!parse_line(line, f)) continue;
+						if (glVars::kb::filter_src) {
+							if (src_allowed.find(f.src) == src_allowed.end()) continue; // Skip this relation
+						}
+						if (f.u == f.v) continue; // no self-loops
+						if (f.src.size()) srcs.insert(f.src);
+
+						ext_edge e;
+						e.u = names.insert(f.u.data(), f.u.size()).first;
+						e.v = names.insert(f.v.data(), f.v.size()).first;
+						e.w = f.w ? f.w : 1.0;
+						e.etype = 0;
+						if (glVars::kb::keep_reltypes && f.rtype.size())
+							rtypes.add_type(f.rtype, e.etype);
+						e.seq = seq++;
+						edges.push(e);
+						// v->u if undirected relation
+						if (!f.directed || !glVars::kb::keep_directed) {
+							std::swap(e.u, e.v);
+							e.seq = seq++;
+							edges.push(e);
+						}
+					} catch (std::exception & e) {
+						string msg(string(e.what()) + " in line " + lexical_cast<string>(line_number));
+						if(!glVars::input::swallow) throw std::runtime_error(msg);
+						if (glVars::debug::warning) {
+							cerr << msg << " (Skipping)\n";
+						}
+					}
+				}
+				V = names.size();
+				if (V >= max_n)
+					throw runtime_error("[E] KB too large for " + lexical_cast<string>(sizeof(Kb_index_t) * 8) +
+										" bit indices (build with -DUKB_KB_INDEX64)");
+				vector<Kb_index_t>(V + 1, 0).swap(rowstart);
+				mem = ext_memory(names.memory() + 3 * (V + 1) * sizeof(Kb_index_t));
+
+				// 2. merge repeated edges
+
+				edges.set_memory(mem / 2);
+				edges.finish();
+				rev.set_memory(mem / 2);
+				ofstream fo(edge_file.c_str(), ofstream::binary|ofstream::out);
+				ext_edge e;
+				bool more = edges.next(e);
+				while(more) {
+					ext_edge cur = e;
+					while((more = edges.next(e)) && e.u == cur.u && e.v == cur.v) {
+						cur.w = e.w;
+						cur.etype |= e.etype;
+					}
+					write_atom_to_stream(fo, cur);
+					++rowstart[cur.u + 1];
+					rev.push(std::make_pair(cur.v, cur.u));
+					++E;
+				}
+				ext_check(fo, edge_file);
+			}
+			if (E >= max_n)
+				throw runtime_error("[E] KB too large for " + lexical_cast<string>(sizeof(Kb_index_t) * 8) +
+									" bit indices (build with -DUKB_KB_INDEX64)");
+			for(size_t u = 0; u != V; ++u) rowstart[u + 1] += rowstart[u];
+
+			// 3. lay out the rows
+
+			rev.finish();
+			ovl.set_memory(mem / 2);
+			vector<Kb_index_t>(V).swap(sym_end);
+			vector<Kb_index_t>(V + 1, 0).swap(ovl_rowstart);
+			ifstream fe(edge_file.c_str(), ifstream::binary|ifstream::in);
+			ofstream fc(col_file.c_str(), ofstream::binary|ofstream::out);
+			ofstream fp(prop_file.c_str(), ofstream::binary|ofstream::out);
+			vector<ext_slot> row;
+			ext_edge e;
+			bool more_e = ext_read(fe, e);
+			pair<Kb_vertex_t, Kb_vertex_t> r; // reverse of edge r.second->r.first
+			bool more_r = rev.next(r);
+			for(size_t u = 0; u != V; ++u) {
+				row.clear();
+				for(; more_e && e.u == u; more_e = ext_read(fe, e)) {
+					while(more_r && r.first == u && r.second < e.v) more_r = rev.next(r);
+					ext_slot x;
+					x.sym = more_r && r.first == u && r.second == e.v;
+					x.seq = e.seq;
+					x.v = e.v;
+					x.w = e.w;
+					x.etype = e.etype;
+					row.push_back(x);
+				}
+				while(more_r && r.first == u) more_r = rev.next(r);
+				std::sort(row.begin(), row.end(), ext_slot_lt);
+				Kb_index_t i = rowstart[u];
+				sym_end[u] = i;
+				for(vector<ext_slot>::const_iterator it = row.begin(); it != row.end(); ++it, ++i) {
+					write_atom_to_stream(fc, it->v);
+					write_edge_prop_to_stream(fp, it->w, it->etype, glVars::kb::bf16_weights);
+					if (it->sym) {
+						sym_end[u] = i + 1;
+						continue;
+					}
+					ext_ovl o;
+					o.v = it->v;
+					o.u = u;
+					o.idx = i;
+					ovl.push(o);
+					++ovl_rowstart[it->v + 1];
+				}
+			}
+			ext_check(fc, col_file);
+			ext_check(fp, prop_file);
+		}
+		for(size_t v = 0; v != V; ++v) ovl_rowstart[v + 1] += ovl_rowstart[v];
+
+		// 4. write the binfile (see write_to_stream)
+
+		ovl.set_memory(mem);
+		ovl.finish();
+		ofstream o(binFile.c_str(), ofstream::binary|ofstream::out);
+		if (!o) throw runtime_error("[E] compiling KB: can not create " + binFile);
+
+		write_atom_to_stream(o, magic_id_csr_sym);
+		write_atom_to_stream(o, size_t(glVars::kb::bf16_weights ? 16 : 32));
+		write_atom_to_stream(o, size_t(sizeof(Kb_index_t) * 8));
+		write_vector_to_stream(o, srcs);
+		// read_from_txt keeps the type bits of the edges, but not the type
+		// names, and neither does this
+		etype_t().write_to_stream(o);
+		write_atom_to_stream(o, V);
+		for(size_t i = 0; i != V; ++i) {
+			write_vertex_name_to_stream(o, names.name(i));
+			write_atom_to_stream(o, Kb_vertex_t(i));
+		}
+		write_atom_to_stream(o, magic_id_csr);
+		write_atom_to_stream(o, E);
+		write_atom_to_stream(o, V);
+		write_atom_to_stream(o, magic_id_csr);
+
+		write_vector_to_stream(o, rowstart);
+		write_atom_to_stream(o, E);
+		ext_copy(o, col_file);
+		write_vector_to_stream(o, sym_end);
+		write_vector_to_stream(o, ovl_rowstart);
+		// overlay sources, and edge indices through a file
+		write_atom_to_stream(o, size_t(ovl_rowstart[V]));
+		{
+			ofstream fo(ovl_file.c_str(), ofstream::binary|ofstream::out);
+			ext_ovl x;
+			while(ovl.next(x)) {
+				write_atom_to_stream(o, x.u);
+				write_atom_to_stream(fo, x.idx);
+			}
+			ext_check(fo, ovl_file);
+		}
+		write_atom_to_stream(o, size_t(ovl_rowstart[V]));
+		ext_copy(o, ovl_file);
+
+		for(size_t i = 0; i != V; ++i)
+			write_vertex_name_to_stream(o, names.name(i));
+		ext_copy(o, prop_file);
+
+		write_atom_to_stream(o, magic_id_csr);
+		write_vector_to_stream(o, notes);
+		ext_check(o, binFile);
+		return std::make_pair(V, E);
+	}
+
+	std::pair<size_t, size_t> Kb::compile_from_txt(const string & synsFileName,
+												   const set<string> & src_allowed,
+												   const string & binFile,
+												   const vector<string> & notes) {
+
+		std::ifstream input_ifs(synsFileName.c_str(), ofstream::in);
+		if (!input_ifs) {
+			throw runtime_error("Kb::compile_from_txt error: Can't open " + synsFileName);
+		}
+		return compile_from_txt(input_ifs, src_allowed, binFile, notes);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Aligned format
+	//
+	// Every array of the graph is stored as it is laid out in memory, so that
+	// the file is memory-mapped and its arrays are used in place, instead of
+	// being read element by element. The boost graph owns its rowstart and
+	// column arrays, so those two are copied in one go. Sections are
+	// independent, and are checked and loaded concurrently.
+	//
+	// File layout (native byte order):
+	//
+	//   header    (offset, size in bytes and CRC-32 of each section)
+	//   sections  (in mm_section order, each one aligned to mm_align bytes)
+	//
+	// Index arrays are written with the width of Kb_index_t, and converted
+	// when the file is read by a build with a different width.
+	//
+	// Older files (magic_id_mm_v1 and v2) have no mm_sym_end section, and
+	// store the backward CSR in the overlay sections. Their in-edges are
+	// rebuilt when they are read (see init_in_edges). Files older than
+	// magic_id_mm have no checksums.
+	//
+	// The meta section holds the relation sources, relation types and notes,
+	// as in the stream format. Vertex names and the synset map are the
+	// arrays of the name index (see NameIndex): the name pool (name chars,
+	// plus vertex_n + 1 name offsets) and its hash table.
+
+	enum mm_section {
+		mm_meta,
+		mm_frow,        // forward rowstart
+		mm_fcol,        // forward column
+		mm_ovl_row,     // overlay rowstart (see init_in_edges)
+		mm_ovl_col,     // overlay column
+		mm_ovl_edge,    // overlay edge indices (into forward edges)
+		mm_weight,      // edge weights (float or bfloat16)
+		mm_etype,       // edge relation types
+		mm_name_off,
+		mm_name_chr,
+		mm_name_table,
+		mm_sym_end,     // end of the symmetric out-edges of each vertex
+		mm_section_n
+	};
+
+	static const char *mm_section_name[mm_section_n] = {
+		"meta", "forward rowstart", "forward column", "overlay rowstart",
+		"overlay column", "overlay edges", "edge weights", "edge types",
+		"name offsets", "name chars", "name table", "symmetric ends"
+	};
+
+	static const size_t mm_align = 64;
+
+	// header of magic_id_mm_v3 files
+
+	struct mm_header_v3_t {
+		size_t magic;
+		size_t vertex_n;
+		size_t edge_n;
+		size_t weight_bits; // 32 (float) or 16 (bfloat16)
+		size_t offset[mm_section_n];
+		size_t size[mm_section_n];
+		size_t index_bits;  // 32 or 64
+	};
+
+	struct mm_header_t : public mm_header_v3_t {
+		size_t checksum[mm_section_n]; // CRC-32
+	};
+
+	// header of magic_id_mm_v1 (without index_bits) and v2 files
+
+	struct mm_header_v2_t {
+		size_t magic;
+		size_t vertex_n;
+		size_t edge_n;
+		size_t weight_bits;
+		size_t offset[mm_sym_end];
+		size_t size[mm_sym_end];
+		size_t index_bits;
+	};
+
+	static size_t mm_aligned(size_t n) {
+		return (n + mm_align - 1) / mm_align * mm_align;
+	}
+
+	static size_t mm_checksum(const char *p, size_t size) {
+		boost::crc_32_type crc;
+		crc.process_bytes(p, size);
+		return crc.checksum();
+	}
+
+	template<typename T>
+	static size_t mm_checksum(const vector<T> & v) {
+		return mm_checksum(v.empty() ? 0 : reinterpret_cast<const char *>(&v[0]), v.size() * sizeof(T));
+	}
+
+	template<typename T>
+	static size_t mm_checksum(const MappedArray<T> & v) {
+		return mm_checksum(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+	}
+
+	template<typename T>
+	static const T *mm_array(const char *base, const mm_header_t & h, mm_section s, size_t n) {
+		if (h.size[s] != n * sizeof(T))
+			throw runtime_error("Invalid section size");
+		return reinterpret_cast<const T *>(base + h.offset[s]);
+	}
+
+	template<typename T>
+	static void mm_copy(const char *base, const mm_header_t & h, mm_section s, size_t n,
+						vector<T> & v) {
+		const T *p = mm_array<T>(base, h, s, n);
+		vector<T>(p, p + n).swap(v);
+	}
+
+	template<typename T>
+	static void mm_copy_index(const char *base, const mm_header_t & h, mm_section s, size_t n,
+							  size_t index_bits, vector<T> & v) {
+		if (index_bits == sizeof(T) * 8)
+			mm_copy(base, h, s, n, v);
+		else if (index_bits == 32)
+			convert_indices(mm_array<boost::uint32_t>(base, h, s, n), n, v);
+		else
+			convert_indices(mm_array<boost::uint64_t>(base, h, s, n), n, v);
+	}
+
+	// Use a section in place (if it has the width of T), or copy it
+
+	template<typename T>
+	static void mm_load_index(const char *base, const mm_header_t & h, mm_section s, size_t n,
+							  size_t index_bits, MappedArray<T> & a) {
+		if (index_bits == sizeof(T) * 8) {
+			a.map(mm_array<T>(base, h, s, n), n);
+		} else {
+			vector<T> v;
+			mm_copy_index(base, h, s, n, index_bits, v);
+			a.swap(v);
+		}
+	}
+
+	template<typename T>
+	static void mm_load(const char *base, const mm_header_t & h, mm_section s, size_t n,
+						MappedArray<T> & a) {
+		mm_load_index(base, h, s, n, sizeof(T) * 8, a);
+	}
+
+	// bfloat16 weights are converted to float
+
+	static void mm_load_weights(const char *base, const mm_header_t & h, size_t n,
+								MappedArray<float> & a) {
+		if (h.weight_bits == 16) {
+			const bfloat16 *w = mm_array<bfloat16>(base, h, mm_weight, n);
+			vector<float> v(w, w + n);
+			a.swap(v);
+		} else {
+			mm_load(base, h, mm_weight, n, a);
+		}
+	}
+
+	// Check the checksum of a section (if verify), and decode it
+
+	static void mm_load_section(const char *base, const mm_header_t & h, mm_section s,
+								bool verify, const boost::function<void ()> & decode) {
+		if (verify && mm_checksum(base + h.offset[s], h.size[s]) != h.checksum[s])
+			throw runtime_error(string("Checksum mismatch in section ") + mm_section_name[s]);
+		if (decode) decode();
+	}
+
+	static void mm_add_task(vector<load_task> & tasks, const char *base, const mm_header_t & h,
+							mm_section s, bool verify, const boost::function<void ()> & decode) {
+		if (!verify && !decode) return;
+		tasks.push_back(load_task(mm_section_name[s], h.size[s],
+								  boost::bind(&mm_load_section, base, boost::cref(h), s, verify, decode)));
+	}
+
+	void Kb::read_from_mapfile(const string & fname) {
+
+		using namespace boost::interprocess;
+
+		std::auto_ptr<file_mapping> file;
+		std::auto_ptr<mapped_region> region;
+		try {
+			file.reset(new file_mapping(fname.c_str(), read_only));
+			region.reset(new mapped_region(*file, read_only));
+		} catch (std::exception & e) {
+			throw runtime_error(string("[E] loading KB: can not open ") + fname + ": " + e.what());
+		}
+		// Start reading the whole file, as all of it is needed
+		region->advise(mapped_region::advice_willneed);
+		read_from_mapping(static_cast<const char *>(region->get_address()), region->get_size(), true);
+		m_map_file = file;
+		m_map_region = region;
+		if (m_sym_end.empty() && m_vertexN) {
+			init_in_edges();
+			add_load_step(m_load_steps, "in-edges (rebuilt)", 0, 0.0, false);
+		}
+		boost::posix_time::ptime t = wall_now();
+		init_prank();
+		add_load_step(m_load_steps, "PageRank setup", 0, wall_secs(t, wall_now()), false);
+	}
+
+	// Read a KB in the aligned format at base, checking the section
+	// checksums if verify. The graph, names, edge properties and in-edges
+	// point to base, so the caller keeps base mapped. Only bfloat16
+	// weights and index arrays of another width are copied.
+	//
+	// In-edges of older files are left empty, and PageRank coefficients
+	// are not computed.
+
+	void Kb::read_from_mapping(const char *base, size_t fsize, bool verify_sums) {
+
+		using namespace boost::interprocess;
+
+		load_timer timer(m_load_steps);
+		MappedArray<Kb_index_t> rowstart;
+		MappedArray<Kb_vertex_t> column;
+		MappedArray<float> eweight;
+		MappedArray<etype_t::value_type> etype;
+		size_t vertex_n;
+		size_t edge_n;
+
+		MappedArray<Kb_index_t> sym_end;
+		MappedArray<Kb_index_t> ovl_rowstart;
+		MappedArray<Kb_vertex_t> ovl_column;
+		MappedArray<Kb_index_t> ovl_edge;
+		bool sym;
+
+		try {
+			if (fsize < sizeof(mm_header_v2_t))
+				throw runtime_error("Truncated file");
+			mm_header_t h;
+			size_t magic = reinterpret_cast<const mm_header_v2_t *>(base)->magic;
+			bool verify = (magic == magic_id_mm) && verify_sums;
+			sym = (magic == magic_id_mm || magic == magic_id_mm_v3);
+			if (magic == magic_id_mm) {
+				if (fsize < sizeof(mm_header_t))
+					throw runtime_error("Truncated file");
+				h = *reinterpret_cast<const mm_header_t *>(base);
+			} else if (magic == magic_id_mm_v3) {
+				if (fsize < sizeof(mm_header_v3_t))
+					throw runtime_error("Truncated file");
+				static_cast<mm_header_v3_t &>(h) = *reinterpret_cast<const mm_header_v3_t *>(base);
+			} else if (magic == magic_id_mm_v2 || magic == magic_id_mm_v1) {
+				const mm_header_v2_t & h2 = *reinterpret_cast<const mm_header_v2_t *>(base);
+				h.magic = h2.magic;
+				h.vertex_n = h2.vertex_n;
+				h.edge_n = h2.edge_n;
+				h.weight_bits = h2.weight_bits;
+				std::copy(h2.offset, h2.offset + mm_sym_end, h.offset);
+				std::copy(h2.size, h2.size + mm_sym_end, h.size);
+				h.offset[mm_sym_end] = h.size[mm_sym_end] = 0;
+				h.index_bits = h2.magic == magic_id_mm_v1 ? 64 : h2.index_bits;
+			} else {
+				throw runtime_error("Invalid id (same platform used to compile the KB?)");
+			}
+			if (h.weight_bits != 32 && h.weight_bits != 16)
+				throw runtime_error("Invalid id (same platform used to compile the KB?)");
+			size_t index_bits = h.index_bits;
+			if (index_bits != 32 && index_bits != 64)
+				throw runtime_error("Invalid index size");
+			for(size_t i = 0; i != mm_section_n; ++i) {
+				if (h.offset[i] % mm_align || h.offset[i] > fsize || h.size[i] > fsize - h.offset[i])
+					throw runtime_error("Truncated file");
+			}
+			vertex_n = h.vertex_n;
+			edge_n = h.edge_n;
+
+			mm_load_section(base, h, mm_meta, verify, boost::function<void ()>());
+			ibufferstream meta(base + h.offset[mm_meta], h.size[mm_meta]);
+			read_set_from_stream(meta, m_relsSource);
+			m_rtypes.read_from_stream(meta);
+			read_vector_from_stream(meta, m_notes);
+			if (!meta)
+				throw runtime_error("Invalid meta section");
+			timer.step("header", mm_aligned(sizeof(h)) + h.size[mm_meta]);
+
+			// Every other section is a task. Big sections go first.
+			vector<load_task> tasks;
+			mm_add_task(tasks, base, h, mm_fcol, verify,
+						boost::bind(&mm_load_index<Kb_vertex_t>, base, boost::cref(h), mm_fcol, edge_n,
+									index_bits, boost::ref(column)));
+			mm_add_task(tasks, base, h, mm_weight, verify,
+						boost::bind(&mm_load_weights, base, boost::cref(h), edge_n,
+									boost::ref(eweight)));
+			mm_add_task(tasks, base, h, mm_etype, verify,
+						boost::bind(&mm_load<etype_t::value_type>, base, boost::cref(h), mm_etype, edge_n,
+									boost::ref(etype)));
+			mm_add_task(tasks, base, h, mm_name_chr, verify, boost::function<void ()>());
+			mm_add_task(tasks, base, h, mm_name_table, verify, boost::function<void ()>());
+			mm_add_task(tasks, base, h, mm_name_off, verify, boost::function<void ()>());
+			mm_add_task(tasks, base, h, mm_frow, verify,
+						boost::bind(&mm_load_index<Kb_index_t>, base, boost::cref(h), mm_frow, vertex_n + 1,
+									index_bits, boost::ref(rowstart)));
+			if (sym) {
+				size_t ovl_n = h.size[mm_ovl_col] / (index_bits / 8);
+				mm_add_task(tasks, base, h, mm_sym_end, verify,
+							boost::bind(&mm_load_index<Kb_index_t>, base, boost::cref(h), mm_sym_end, vertex_n,
+										index_bits, boost::ref(sym_end)));
+				mm_add_task(tasks, base, h, mm_ovl_row, verify,
+							boost::bind(&mm_load_index<Kb_index_t>, base, boost::cref(h), mm_ovl_row, vertex_n + 1,
+										index_bits, boost::ref(ovl_rowstart)));
+				mm_add_task(tasks, base, h, mm_ovl_col, verify,
+							boost::bind(&mm_load_index<Kb_vertex_t>, base, boost::cref(h), mm_ovl_col, ovl_n,
+										index_bits, boost::ref(ovl_column)));
+				mm_add_task(tasks, base, h, mm_ovl_edge, verify,
+							boost::bind(&mm_load_index<Kb_index_t>, base, boost::cref(h), mm_ovl_edge, ovl_n,
+										index_bits, boost::ref(ovl_edge)));
+			}
+			load_pool(tasks).run();
+			throw_errors(tasks);
+			size_t task_bytes = 0;
+			for(size_t i = 0; i != tasks.size(); ++i)
+				task_bytes += tasks[i].bytes;
+			timer.step("sections", task_bytes);
+			add_load_steps(m_load_steps, tasks);
+			if (sym) {
+				check_in_edges(vertex_n, edge_n, rowstart,
+							   sym_end, ovl_rowstart, ovl_column, ovl_edge);
+				timer.step("in-edges check", 0);
+			}
+
+			size_t table_n = h.size[mm_name_table] / sizeof(NameIndex::slot_type);
+			mm_array<NameIndex::offset_type>(base, h, mm_name_off, vertex_n + 1); // check sizes
+			mm_array<NameIndex::slot_type>(base, h, mm_name_table, table_n);
+			size_t names_begin = h.offset[mm_name_off];
+			size_t names_end = h.offset[mm_name_table] + h.size[mm_name_table];
+			if (h.offset[mm_name_chr] < names_begin || names_end < h.offset[mm_name_chr] + h.size[mm_name_chr])
+				throw runtime_error("Invalid vertex names");
+			const char *names_base = base + names_begin;
+			if (!m_names.map(names_base + (h.offset[mm_name_chr] - names_begin), h.size[mm_name_chr],
+							 reinterpret_cast<const NameIndex::offset_type *>(names_base), vertex_n,
+							 reinterpret_cast<const NameIndex::slot_type *>(names_base + (h.offset[mm_name_table] - names_begin)),
+							 table_n))
+				throw runtime_error("Invalid vertex names");
+			timer.step("names", 0);
+		} catch (std::exception & e) {
+			throw runtime_error(string("Error when reading serialized graph: ") + e.what());
+		}
+
+		m_rowstart.swap(rowstart);
+		m_column.swap(column);
+		m_eweight.swap(eweight);
+		m_etype.swap(etype);
+		m_sym_end.swap(sym_end);
+		m_ovl_rowstart.swap(ovl_rowstart);
+		m_ovl_column.swap(ovl_column);
+		m_ovl_edge.swap(ovl_edge);
+		vector<float>().swap(m_static_ppv); // empty static rank vector
+
+		m_vertexN = vertex_n;
+		m_edgeN = edge_n;
+	}
+
+	// Write an array, padded to mm_align bytes
+
+	static void mm_write(ostream & o, const char *p, size_t size) {
+		static const char zeros[mm_align] = { 0 };
+		if (size) o.write(p, size);
+		o.write(zeros, mm_aligned(size) - size);
+	}
+
+	template<typename T>
+	static void mm_write(ostream & o, const vector<T> & v) {
+		mm_write(o, v.empty() ? 0 : reinterpret_cast<const char *>(&v[0]), v.size() * sizeof(T));
+	}
+
+	template<typename T>
+	static void mm_write(ostream & o, const MappedArray<T> & v) {
+		mm_write(o, reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+	}
+
+	ostream & Kb::write_to_mapstream(ostream & o) const {
+
+		assert(m_rowstart.size() == m_vertexN + 1);
+		assert(m_column.size() == m_edgeN);
+
+		std::ostringstream meta;
+		write_vector_to_stream(meta, m_relsSource);
+		m_rtypes.write_to_stream(meta);
+		write_vector_to_stream(meta, m_notes);
+		string meta_str(meta.str());
+
+		vector<bfloat16> w16;
+		if (glVars::kb::bf16_weights)
+			w16.assign(m_eweight.begin(), m_eweight.end());
+
+		if (m_names.size() != m_vertexN)
+			throw runtime_error("[E] writing KB: name index does not match the graph");
+
+		mm_header_t h;
+		h.magic = magic_id_mm;
+		h.vertex_n = m_vertexN;
+		h.edge_n = m_edgeN;
+		h.weight_bits = glVars::kb::bf16_weights ? 16 : 32;
+		h.index_bits = sizeof(Kb_index_t) * 8;
+		h.size[mm_meta] = meta_str.size();
+		h.size[mm_frow] = m_rowstart.size() * sizeof(Kb_index_t);
+		h.size[mm_fcol] = m_column.size() * sizeof(Kb_vertex_t);
+		h.size[mm_ovl_row] = m_ovl_rowstart.size() * sizeof(Kb_index_t);
+		h.size[mm_ovl_col] = m_ovl_column.size() * sizeof(Kb_vertex_t);
+		h.size[mm_ovl_edge] = m_ovl_edge.size() * sizeof(Kb_index_t);
+		h.size[mm_weight] = glVars::kb::bf16_weights ? m_edgeN * sizeof(bfloat16) : m_edgeN * sizeof(float);
+		h.size[mm_etype] = m_edgeN * sizeof(etype_t::value_type);
+		h.size[mm_name_off] = (m_vertexN + 1) * sizeof(NameIndex::offset_type);
+		h.size[mm_name_chr] = m_names.chars_size();
+		h.size[mm_name_table] = m_names.table_size() * sizeof(NameIndex::slot_type);
+		h.size[mm_sym_end] = m_sym_end.size() * sizeof(Kb_index_t);
+		size_t offset = mm_aligned(sizeof(mm_header_t));
+		for(size_t i = 0; i != mm_section_n; ++i) {
+			h.offset[i] = offset;
+			offset += mm_aligned(h.size[i]);
+		}
+		h.checksum[mm_meta] = mm_checksum(meta_str.data(), meta_str.size());
+		h.checksum[mm_frow] = mm_checksum(m_rowstart);
+		h.checksum[mm_fcol] = mm_checksum(m_column);
+		h.checksum[mm_ovl_row] = mm_checksum(m_ovl_rowstart);
+		h.checksum[mm_ovl_col] = mm_checksum(m_ovl_column);
+		h.checksum[mm_ovl_edge] = mm_checksum(m_ovl_edge);
+		h.checksum[mm_weight] = glVars::kb::bf16_weights ? mm_checksum(w16) : mm_checksum(m_eweight);
+		h.checksum[mm_etype] = mm_checksum(m_etype);
+		h.checksum[mm_name_off] = mm_checksum(reinterpret_cast<const char *>(m_names.offsets()), h.size[mm_name_off]);
+		h.checksum[mm_name_chr] = mm_checksum(m_names.chars(), h.size[mm_name_chr]);
+		h.checksum[mm_name_table] = mm_checksum(reinterpret_cast<const char *>(m_names.table()), h.size[mm_name_table]);
+		h.checksum[mm_sym_end] = mm_checksum(m_sym_end);
+
+		mm_write(o, reinterpret_cast<const char *>(&h), sizeof(mm_header_t));
+		mm_write(o, meta_str.data(), meta_str.size());
+		mm_write(o, m_rowstart);
+		mm_write(o, m_column);
+		mm_write(o, m_ovl_rowstart);
+		mm_write(o, m_ovl_column);
+		mm_write(o, m_ovl_edge);
+		if (glVars::kb::bf16_weights) mm_write(o, w16);
+		else mm_write(o, m_eweight);
+		mm_write(o, m_etype);
+		mm_write(o, reinterpret_cast<const char *>(m_names.offsets()), h.size[mm_name_off]);
+		mm_write(o, m_names.chars(), h.size[mm_name_chr]);
+		mm_write(o, reinterpret_cast<const char *>(m_names.table()), h.size[mm_name_table]);
+		mm_write(o, m_sym_end);
+		return o;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Shared memory
+	//
+	// A POSIX shared-memory segment holds a KB in the aligned format,
+	// followed by its PageRank coefficients:
+	//
+	//   header     (offset and size in bytes of each part)
+	//   KB         (as written by write_to_mapstream)
+	//   coefficients (m_out_coefs, m_in_coefs and m_ovl_coefs)
+	//
+	// Each part is aligned to mm_align bytes. The magic number is written
+	// last, so that a segment can not be attached while it is written.
+
+	static const size_t magic_id_shm = 0x261024;
+
+	enum shm_part {
+		shm_kb,
+		shm_out_coef,
+		shm_in_coef,
+		shm_ovl_coef,
+		shm_part_n
+	};
+
+	struct shm_header_t {
+		size_t magic;
+		size_t prank_weight; // whether coefficients follow edge weights
+		size_t offset[shm_part_n];
+		size_t size[shm_part_n];
+	};
+
+	// Stream buffer which only counts the bytes written to it
+
+	class count_streambuf : public std::streambuf {
+	public:
+		count_streambuf() : n(0) {}
+		size_t n;
+	protected:
+		int_type overflow(int_type c) {
+			if (!traits_type::eq_int_type(c, traits_type::eof())) ++n;
+			return traits_type::not_eof(c);
+		}
+		std::streamsize xsputn(const char *, std::streamsize k) {
+			n += k;
+			return k;
+		}
+	};
+
+	template<typename T>
+	static void shm_write(char *base, const shm_header_t & h, shm_part p, const T *v) {
+		if (h.size[p]) std::memcpy(base + h.offset[p], v, h.size[p]);
+	}
+
+	void Kb::write_to_shared(const string & name) {
+
+		using namespace boost::interprocess;
+
+		refresh_prank();
+		// Weights are used in place, so they are stored as floats
+		bool bf16 = glVars::kb::bf16_weights;
+		glVars::kb::bf16_weights = false;
+		try {
+			count_streambuf kb_size;
+			ostream count_os(&kb_size);
+			write_to_mapstream(count_os);
+
+			shm_header_t h;
+			h.magic = 0;
+			h.prank_weight = m_prank_weight;
+			h.size[shm_kb] = kb_size.n;
+			h.size[shm_out_coef] = m_out_coefs.size() * sizeof(float);
+			h.size[shm_in_coef] = m_in_coefs.size() * sizeof(float);
+			h.size[shm_ovl_coef] = m_ovl_coefs.size() * sizeof(float);
+			size_t offset = mm_aligned(sizeof(shm_header_t));
+			for(size_t i = 0; i != shm_part_n; ++i) {
+				h.offset[i] = offset;
+				offset += mm_aligned(h.size[i]);
+			}
+
+			shared_memory_object::remove(name.c_str());
+			shared_memory_object shm(create_only, name.c_str(), read_write);
+			shm.truncate(offset);
+			mapped_region region(shm, read_write);
+			char *base = static_cast<char *>(region.get_address());
+			std::memcpy(base, &h, sizeof(shm_header_t));
+			obufferstream kb_os(base + h.offset[shm_kb], h.size[shm_kb]);
+			write_to_mapstream(kb_os);
+			if (!kb_os)
+				throw runtime_error("segment too small");
+			shm_write(base, h, shm_out_coef, vector_data(m_out_coefs));
+			shm_write(base, h, shm_in_coef, m_in_coefs.data());
+			shm_write(base, h, shm_ovl_coef, m_ovl_coefs.data());
+			reinterpret_cast<shm_header_t *>(base)->magic = magic_id_shm;
+		} catch (std::exception & e) {
+			glVars::kb::bf16_weights = bf16;
+			throw runtime_error(string("[E] writing KB to shared memory ") + name + ": " + e.what());
+		}
+		glVars::kb::bf16_weights = bf16;
+	}
+
+	bool Kb::remove_shared(const string & name) {
+		return boost::interprocess::shared_memory_object::remove(name.c_str());
+	}
+
+	void Kb::attach_shared(const string & name) {
+
+		using namespace boost::interprocess;
+
+		if (p_instance) return;
+		Kb *tenp = create();
+
+		std::auto_ptr<mapped_region> region;
+		try {
+			shared_memory_object shm(open_only, name.c_str(), read_only);
+			region.reset(new mapped_region(shm, read_only));
+		} catch (std::exception & e) {
+			throw runtime_error(string("[E] attaching KB: can not open shared memory ") + name + ": " + e.what());
+		}
+		const char *base = static_cast<const char *>(region->get_address());
+		size_t size = region->get_size();
+		if (size < sizeof(shm_header_t))
+			throw runtime_error(string("[E] attaching KB: invalid shared memory ") + name);
+		const shm_header_t & h = *reinterpret_cast<const shm_header_t *>(base);
+		if (h.magic != magic_id_shm)
+			throw runtime_error(string("[E] attaching KB: invalid (or unfinished) shared memory ") + name);
+		for(size_t i = 0; i != shm_part_n; ++i) {
+			if (h.offset[i] % mm_align || h.offset[i] > size || h.size[i] > size - h.offset[i])
+				throw runtime_error(string("[E] attaching KB: truncated shared memory ") + name);
+		}
+
+		// The image was checked when it was written, so checksums are
+		// not verified again
+		tenp->read_from_mapping(base + h.offset[shm_kb], h.size[shm_kb], false);
+
+		boost::posix_time::ptime t = wall_now();
+		size_t V = tenp->m_vertexN;
+		if (h.prank_weight == static_cast<size_t>(glVars::prank::use_weight) &&
+			h.size[shm_out_coef] == V * sizeof(float) &&
+			h.size[shm_in_coef] == tenp->m_edgeN * sizeof(float) &&
+			h.size[shm_ovl_coef] == tenp->m_ovl_column.size() * sizeof(float)) {
+			const float *out_coefs = reinterpret_cast<const float *>(base + h.offset[shm_out_coef]);
+			tenp->m_prank_weight = glVars::prank::use_weight;
+			vector<float>(out_coefs, out_coefs + V).swap(tenp->m_out_coefs);
+			tenp->m_in_coefs.map(reinterpret_cast<const float *>(base + h.offset[shm_in_coef]), tenp->m_edgeN);
+			tenp->m_ovl_coefs.map(reinterpret_cast<const float *>(base + h.offset[shm_ovl_coef]),
+								  tenp->m_ovl_column.size());
+			tenp->init_prank_lists();
+		} else {
+			// coefficients for the other use_weight setting
+			tenp->init_prank();
+		}
+		add_load_step(tenp->m_load_steps, "PageRank setup", 0, wall_secs(t, wall_now()), false);
+		tenp->m_map_region = region;
+		p_instance = tenp;
+	}
+
+	// Random walk fingerprints
+	//
+	// The file header keeps the number of vertices and edges of the KB, and a
+	// CRC-32 of the forward CSR the walks went through (and of the edge
+	// weights, if walks followed them), so fingerprints of another KB are
+	// rejected.
+
+	static const size_t magic_id_fp = 0x261026;
+
+	size_t Kb::graph_checksum(bool use_weight) const {
+
+		boost::crc_32_type crc;
+		crc.process_bytes(m_rowstart.data(), m_rowstart.size() * sizeof(Kb_index_t));
+		if (m_column.size())
+			crc.process_bytes(m_column.data(), m_column.size() * sizeof(Kb_vertex_t));
+		if (use_weight && m_eweight.size())
+			crc.process_bytes(&m_eweight[0], m_eweight.size() * sizeof(float));
+		return crc.checksum();
+	}
+
+	void Kb::build_fingerprints(size_t R, float damping, bool use_weight) {
+
+		static const size_t max_len = 100; // damping^100 is negligible
+
+		vector<unsigned int>(m_vertexN * R).swap(m_fp);
+		if (R)
+			prank::fingerprint_walks(m_vertexN, m_rowstart.data(), m_column.data(),
+									 use_weight && m_edgeN ? &m_eweight[0] : static_cast<const float *>(0),
+									 damping, R, max_len, glVars::rnd::urng, &m_fp[0]);
+		m_fp_R = R;
+		m_fp_damping = damping;
+		m_fp_weight = use_weight;
+	}
+
+	void Kb::write_fingerprints(const string & fname) const {
+
+		ofstream fo(fname.c_str(),  ofstream::binary|ofstream::out);
+		if (!fo) {
+			cerr << "Error: can't create" << fname << endl;
+			exit(-1);
+		}
+		write_atom_to_stream(fo, magic_id_fp);
+		write_atom_to_stream(fo, m_vertexN);
+		write_atom_to_stream(fo, m_edgeN);
+		write_atom_to_stream(fo, graph_checksum(m_fp_weight));
+		write_atom_to_stream(fo, m_fp_R);
+		write_atom_to_stream(fo, m_fp_damping);
+		write_atom_to_stream(fo, m_fp_weight);
+		write_atom_to_stream(fo, magic_id_fp);
+		if (m_fp.size())
+			fo.write(reinterpret_cast<const char *>(&m_fp[0]), m_fp.size() * sizeof(unsigned int));
+	}
+
+	void Kb::load_fingerprints() {
+
+		if (m_fp_R) return;
+		string fname(glVars::prank::fp_fname);
+		if (!fname.size()) {
+			// There is no binfile name to derive the name from
+			if (glVars::kb::shm_name.size())
+				throw runtime_error("[E] loading fingerprints: a KB in shared memory needs an explicit fingerprint file (--fp_file)");
+			fname = glVars::kb::fname + ".fp";
+		}
+		read_fingerprints(fname);
+	}
+
+	void Kb::read_fingerprints(const string & fname) {
+
+		ifstream fi(fname.c_str(), ifstream::binary|ifstream::in);
+		if (!fi)
+			throw std::runtime_error(string("[E] loading fingerprints: can not open ") + fname);
+
+		size_t id, vertex_n, edge_n, checksum, R;
+		float damping;
+		bool use_weight;
+		read_atom_from_stream(fi, id);
+		if (id != magic_id_fp)
+			throw runtime_error(string("[E] loading fingerprints: invalid id in ") + fname);
+		read_atom_from_stream(fi, vertex_n);
+		read_atom_from_stream(fi, edge_n);
+		read_atom_from_stream(fi, checksum);
+		read_atom_from_stream(fi, R);
+		read_atom_from_stream(fi, damping);
+		read_atom_from_stream(fi, use_weight);
+		read_atom_from_stream(fi, id);
+		if (id != magic_id_fp)
+			throw runtime_error(string("[E] loading fingerprints: invalid id in ") + fname);
+		if (vertex_n != m_vertexN || edge_n != m_edgeN || checksum != graph_checksum(use_weight))
+			throw runtime_error(string("[E] loading fingerprints: ") + fname + " does not match the KB");
+		if (!R)
+			throw runtime_error(string("[E] loading fingerprints: no fingerprints in ") + fname);
+		vector<unsigned int> fp(vertex_n * R);
+		fi.read(reinterpret_cast<char *>(&fp[0]), fp.size() * sizeof(unsigned int));
+		if (!fi)
+			throw runtime_error(string("[E] loading fingerprints: ") + fname + " is truncated");
+		fp.swap(m_fp);
+		m_fp_R = R;
+		m_fp_damping = damping;
+		m_fp_weight = use_weight;
+		if (glVars::debug::warning &&
+			(damping != glVars::prank::damping || use_weight != glVars::prank::use_weight)) {
+			cerr << "[W] fingerprints in " << fname << " were computed with damping " << damping
+				 << (use_weight ? " and" : " and no") << " edge weights\n";
+		}
 	}
 
 	// text write
 
 	ostream & Kb::write_to_textstream(ostream & o) const {
 
+		const KbGraph & g = boost_graph();
 		graph_traits<KbGraph>::edge_iterator it, end;
-		tie(it, end) = edges(*m_g);
+		tie(it, end) = edges(g);
 		for(;it != end; ++it) {
-			const string & u_str = (*m_g)[source(*it, *m_g)].name;
-			const string & v_str = (*m_g)[target(*it, *m_g)].name;
+			name_ref u_str = get_vertex_name(source(*it, g));
+			name_ref v_str = get_vertex_name(target(*it, g));
 			vector<string> r = edge_reltypes(*it);
 			if (r.size()) {
 				for(vector<string>::const_iterator rit = r.begin(), rend = r.end();
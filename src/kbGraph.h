@@ -14,6 +14,10 @@
 
 #include "kbGraph_common.h"
 #include "kbGraph_v16.h"
+#include "ppvCache.h"
+#include "nameIndex.h"
+#include "mappedArray.h"
+#include "prank.h"
 
 // graph
 
@@ -28,6 +32,9 @@
 #endif
 
 #include <boost/graph/properties.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 using boost::compressed_sparse_row_graph;
 using boost::graph_traits;
@@ -40,16 +47,127 @@ using boost::edge_weight;
 
 namespace ukb {
 
-	typedef compressed_sparse_row_graph<boost::bidirectionalS,
-										vertex_prop_t,
-										edge_prop_t> KbGraph;
+	// Vertex names are not stored in the graph, but in Kb (see NameIndex).
+	// Neither are edge properties: Kb keeps them in separate arrays indexed
+	// by edge (see Kb::weight_map), so that each algorithm only reads the
+	// arrays it needs.
+	//
+	// Vertex and edge indices are 32 bits wide, which halves the size of the
+	// CSR arrays. KBs with more than 2^32 vertices or edges need a build
+	// with -DUKB_KB_INDEX64.
+	//
+	// The graph only stores out-edges. Most relations of a KB are undirected,
+	// and both u->v and v->u are in the graph, so the in-edges of a vertex
+	// are mostly its own out-edges. Kb keeps those symmetric edges first in
+	// each forward row, and only stores apart the in-edges without a reverse
+	// out-edge (see Kb::in_edges and prank::in_csr).
+
+#ifdef UKB_KB_INDEX64
+	typedef std::size_t Kb_index_t;
+#else
+	typedef boost::uint32_t Kb_index_t;
+#endif
+
+	typedef compressed_sparse_row_graph<boost::directedS,
+										boost::no_property,
+										boost::no_property,
+										boost::no_property,
+										Kb_index_t,
+										Kb_index_t> KbGraph;
 
 	typedef graph_traits<KbGraph>::vertex_descriptor Kb_vertex_t;
 	typedef graph_traits<KbGraph>::vertex_iterator Kb_vertex_iter_t;
 	typedef graph_traits<KbGraph>::vertices_size_type Kb_vertex_size_t;
 	typedef graph_traits<KbGraph>::edge_descriptor Kb_edge_t;
 	typedef graph_traits<KbGraph>::out_edge_iterator Kb_out_edge_iter_t;
-	typedef graph_traits<KbGraph>::in_edge_iterator Kb_in_edge_iter_t;
+
+	// Read-only map from edges to their weights
+
+	typedef boost::iterator_property_map<const float *,
+										 property_map<KbGraph, boost::edge_index_t>::const_type,
+										 float, const float &> Kb_weight_map_t;
+
+	// Sparse vector over the vertices of the KB. It holds (vertex, value)
+	// pairs sorted by vertex; the value of any other vertex is zero. size()
+	// is the dimension of the vector (as with a dense std::vector<float>), so
+	// it can be used as a rank map (see CWord::rank_synsets).
+
+	class Kb_sparse_vector {
+
+	public:
+
+		typedef std::pair<Kb_vertex_t, float> value_type;
+		typedef std::vector<value_type>::const_iterator const_iterator;
+
+		explicit Kb_sparse_vector(size_t n = 0) : m_n(n) {}
+
+		size_t size() const { return m_n; }
+		size_t nnz() const { return m_v.size(); }
+		const_iterator begin() const { return m_v.begin(); }
+		const_iterator end() const { return m_v.end(); }
+
+		float operator[](Kb_vertex_t u) const;
+
+		// Remove all values and set dimension to n
+		void clear(size_t n);
+
+		// Add a value. Pairs need not be in order until sort_merge is called.
+		void push_back(Kb_vertex_t u, float value) { m_v.push_back(value_type(u, value)); }
+
+		// Sort pairs by vertex, adding up the values of repeated vertices
+		// (in insertion order)
+		void sort_merge();
+
+		// Underlying pairs
+		std::vector<value_type> & pairs() { return m_v; }
+		const std::vector<value_type> & pairs() const { return m_v; }
+
+	private:
+		size_t m_n;
+		std::vector<value_type> m_v;
+	};
+
+	// Scratch vectors and statistics of PageRank computations (see the
+	// const Kb::pageRank_ppv). Vectors are sized on first use and reused
+	// afterwards, so that later computations do not allocate memory. A
+	// workspace must not be shared among threads.
+
+	struct PrankWorkspace {
+		std::vector<float> rank_tmp;       // auxiliary rank vector
+		std::vector<float> scaled1;        // scaled ranks (unweighted power method)
+		std::vector<float> scaled2;
+		std::vector<float> x2;             // Aitken extrapolation
+		prank::adaptive_workspace adaptive; // adaptive PageRank residuals and active vertices
+		std::vector<size_t> chunks;        // vertex chunks, if the ones of the Kb do not match glVars::prank::num_threads
+		std::vector<float> rest;           // PPV cache: vector of the vertices without a stored PPV
+		std::vector<float> acc;            // PPV cache: sum of stored PPVs
+		std::vector<float> prev_ranks;     // last PPV (for warm starts)
+		std::vector<float> pv;             // personalization vector (see calculate_kb_ppr)
+		Kb_sparse_vector sparse_pv;        // sparse personalization vector
+		prank::push_workspace<Kb_vertex_t> push; // residuals and estimates of PageRank nibble
+		std::vector<float> batch_pv;       // interleaved personalization vectors (see pageRank_ppv_batch)
+		std::vector<float> batch_ranks;    // interleaved rank vectors
+		std::vector<float> batch_tmp;      // auxiliary interleaved rank vectors
+		std::vector<bfloat16> batch_pulled; // bfloat16 copy of batch_ranks
+		prank::batch_workspace batch;      // residuals and active vectors of a batch
+		std::vector<std::vector<float> > ppvs;  // personalization vectors of a batch (see calculate_kb_ppr_batch)
+		std::vector<std::vector<float> > ranks; // rank vectors of a batch, for the callers of calculate_kb_ppr_batch
+
+		size_t vectors;                    // PPVs computed so far
+		size_t iters;                      // iterations needed by those PPVs
+		size_t warm;                       // PPVs computed with a warm start
+		size_t aitken;                     // Aitken extrapolations applied
+		size_t edges;                      // edges visited by those iterations
+		size_t ppvc_hits;                  // personalized vertices found in the PPV cache
+		size_t ppvc_misses;                // personalized vertices not found
+		size_t ppvc_queries;               // PPVs composed from the cache
+		double ppvc_bound_sum;             // sum of their L1 error bounds
+		float ppvc_bound_max;              // maximum L1 error bound
+
+		PrankWorkspace() : vectors(0), iters(0), warm(0), aitken(0), edges(0),
+						   ppvc_hits(0), ppvc_misses(0), ppvc_queries(0),
+						   ppvc_bound_sum(0.0), ppvc_bound_max(0.0f) {}
+	};
 
 	class Kb {
 
@@ -79,16 +197,58 @@ namespace ukb {
 
 
 		// 2. create_from_binfile
-		//    Load a binary snapshot of the graph into memory
+		//    Load a binary snapshot of the graph into memory. Files in the
+		//    aligned format (see glVars::kb::mmap_format) are memory-mapped,
+		//    and their sections are checked against the stored checksums
+		//    concurrently. The graph, names, edge properties and in-edges
+		//    are used in place. Other files are read through a large
+		//    buffer. See write_load_stats.
 
 		static void create_from_binfile(const std::string & o);
 
+		// 3. attach_shared
+		//    Use a KB placed in a POSIX shared-memory segment by
+		//    write_to_shared. The graph, names, edge properties, in-edges
+		//    and PageRank coefficients are used in place, and shared among
+		//    all processes attached to the segment.
+
+		static void attach_shared(const std::string & name);
+
 
 		// write_to_binfile
-		// Write kb graph to a binary serialization file
+		// Write kb graph to a binary serialization file (in the aligned
+		// format if glVars::kb::mmap_format)
 
 		void write_to_binfile (const std::string & str);
 
+		// compile_from_txt
+		// Write the binfile of the relations of a text file (the one
+		// create_from_txt and write_to_binfile would write, in the stream
+		// format) without building the graph in memory, for KBs larger
+		// than it. Only vertex names are kept in memory; edges are sorted
+		// through temporary files (binFile.tmp.*) within
+		// glVars::kb::mem_budget bytes. notes are the comments of the
+		// graph. Returns the number of vertices and edges.
+
+		static std::pair<size_t, size_t> compile_from_txt(const std::string & synsFile,
+														  const std::set<std::string> & rels_source,
+														  const std::string & binFile,
+														  const std::vector<std::string> & notes);
+		static std::pair<size_t, size_t> compile_from_txt(std::istream & is,
+														  const std::set<std::string> & rels_source,
+														  const std::string & binFile,
+														  const std::vector<std::string> & notes);
+
+		// write_to_shared
+		// Place the KB in the POSIX shared-memory segment name, replacing
+		// it if it exists. PageRank coefficients are stored for the
+		// current glVars::prank::use_weight. The segment lasts until
+		// remove_shared (or a reboot), and processes use it through
+		// attach_shared.
+
+		void write_to_shared(const std::string & name);
+		static bool remove_shared(const std::string & name);
+
 		// write_to_textfile
 		// Write kb graph to a text file
 
@@ -99,7 +259,9 @@ namespace ukb {
 		std::ostream & write_to_textstream(std::ostream & o) const;
 
 		// read_from_txt
-		// add relations from synsFile to the graph
+		// add relations from synsFile to the graph. The file is parsed by
+		// glVars::kb::parse_threads threads; the graph is the same
+		// regardless of their number.
 
 		void read_from_txt(const std::string & synsFile,
 						   const std::set<std::string> & rels_source);
@@ -109,6 +271,19 @@ namespace ukb {
 		void read_from_txt(std::istream & is,
 						   const std::set<std::string> & rels_source);
 
+		// apply_delta
+		// Add, remove and reweight relations of the graph, as listed in a
+		// delta file (see compile_kb --apply_delta), without reading the
+		// whole text source again. Only the forward rows and in-edges of
+		// the vertices of changed relations are rebuilt; the rest are
+		// copied in one sequential pass. New vertices get the next ids;
+		// vertices are never removed. Returns the number of edges changed.
+
+		size_t apply_delta(const std::string & deltaFile,
+						   const std::set<std::string> & rels_source);
+		size_t apply_delta(std::istream & is,
+						   const std::set<std::string> & rels_source);
+
 		// add_relSource
 		// add a new relation source
 
@@ -121,9 +296,12 @@ namespace ukb {
 		void add_token(const std::string & str); // Add just a word (lemma)
 
 		// graph
-		// Get the underlying boost graph
+		// Get the underlying boost graph. KBs mapped from a file or from
+		// shared memory only have the arrays of their forward CSR (which
+		// PageRank, bfs and random walks read in place), and their boost
+		// graph is copied from those arrays the first time it is needed.
 
-		KbGraph & graph() {return *m_g;}
+		KbGraph & graph() {return boost_graph();}
 
 		// Add relation type to edge
 
@@ -135,25 +313,31 @@ namespace ukb {
 
 		// ask for node properties
 
-		std::string & get_vertex_name(Kb_vertex_t u) {return (*m_g)[u].name;}
-		const std::string & get_vertex_name(Kb_vertex_t u) const {return (*m_g)[u].name;}
+		name_ref get_vertex_name(Kb_vertex_t u) const {return m_names.name(u);}
 		//std::string  get_vertex_gloss(Kb_vertex_t u) const {return get(vertex_gloss, g, u);}
 
 		// Get vertices iterator
 
-		std::pair<Kb_vertex_iter_t, Kb_vertex_iter_t> get_vertices() { return boost::vertices(*m_g); }
+		std::pair<Kb_vertex_iter_t, Kb_vertex_iter_t> get_vertices() {
+			return std::make_pair(Kb_vertex_iter_t(0), Kb_vertex_iter_t(m_vertexN));
+		}
 
 		// Get out-edges for vertex u
 
 		std::pair<Kb_out_edge_iter_t, Kb_out_edge_iter_t> out_neighbors(Kb_vertex_t u);
-		std::pair<Kb_in_edge_iter_t, Kb_in_edge_iter_t> in_neighbors(Kb_vertex_t u);
+
+		// Get in-edges (u->v edges of the graph) for vertex v
+
+		void in_edges(Kb_vertex_t v, std::vector<Kb_edge_t> & E) const;
+		size_t in_degree(Kb_vertex_t v) const;
 
 		bool exists_edge(Kb_vertex_t u, Kb_vertex_t v) const {
-			return edge(u, v, *m_g).second;
+			return std::find(m_column.begin() + m_rowstart[u], m_column.begin() + m_rowstart[u + 1], v) !=
+				m_column.begin() + m_rowstart[u + 1];
 		}
 
-		Kb_vertex_t edge_source(Kb_edge_t e) const { return source(e, *m_g); }
-		Kb_vertex_t edge_target(Kb_edge_t e) const { return target(e, *m_g); }
+		Kb_vertex_t edge_source(Kb_edge_t e) const { return e.src; }
+		Kb_vertex_t edge_target(Kb_edge_t e) const { return m_column[e.idx]; }
 
 		// ask for edge preperties
 
@@ -162,9 +346,15 @@ namespace ukb {
 		float get_edge_weight(Kb_edge_t e) const;
 		void set_edge_weight(Kb_edge_t e, float w);
 
-		// get static pageRank
+		// Edge weights as a property map (regardless of glVars::prank::use_weight)
+
+		Kb_weight_map_t weight_map() const;
+
+		// get static pageRank. init_static_prank computes it, and must be
+		// called first (throws std::logic_error otherwise).
 
 		const std::vector<float> & static_prank() const;
+		void init_static_prank();
 
 		// Given a previously calculated rank vector, output 2 vector, probably
 		// filtering the nodes.
@@ -195,7 +385,7 @@ namespace ukb {
 		// Some useful info
 
 		void display_info(std::ostream & o) const;
-		size_t size() const {return num_vertices(*m_g); }
+		size_t size() const {return m_vertexN; }
 
 		std::pair<size_t, size_t> indeg_maxmin() const;
 		std::pair<size_t, size_t> outdeg_maxmin() const;
@@ -220,6 +410,109 @@ namespace ukb {
 		void pageRank_ppv(const std::vector<float> & ppv_map,
 						  std::vector<float> & ranks);
 
+		// Thread-safe version of the above. The coefficients PageRank needs
+		// are computed when the graph is loaded, and scratch vectors come
+		// from ws, so that many threads can share the Kb, each one with its
+		// own workspace. Warm starts use the last PPV of ws. Throws
+		// logic_error if the coefficients are stale (set_edge_weight), or
+		// if the mc method is used before load_fingerprints.
+
+		void pageRank_ppv(const std::vector<float> & ppv_map,
+						  std::vector<float> & ranks,
+						  PrankWorkspace & ws) const;
+
+		// Same as above, but iterations start from init_ranks instead of
+		// the vector selected by glVars::prank::init (warm start).
+		// init_ranks can be any vector close to the solution, such as the
+		// PPV of a similar context, or static_prank().
+
+		void pageRank_ppv(const std::vector<float> & ppv_map,
+						  std::vector<float> & ranks,
+						  const std::vector<float> & init_ranks);
+
+		// Compute the PPVs of the first K personalization vectors of ppvs at
+		// once (see glVars::prank::batch_size).
+		// ranks[i] is the PPV of ppvs[i]. ranks is grown to K vectors if it
+		// is shorter, but never shrunk, and its vectors are reused, so that
+		// callers which keep ppvs and ranks among batches do not allocate
+		// memory.
+
+		void pageRank_ppv_batch(const std::vector<std::vector<float> > & ppvs,
+								size_t K,
+								std::vector<std::vector<float> > & ranks);
+
+		// Thread-safe version of the above (see the const pageRank_ppv)
+
+		void pageRank_ppv_batch(const std::vector<std::vector<float> > & ppvs,
+								size_t K,
+								std::vector<std::vector<float> > & ranks,
+								PrankWorkspace & ws) const;
+
+		// Sparse PPV, computed by pushing mass from the vertices of ppv_map
+		// (see glVars::prank::nibble_epsilon). Its cost depends on the
+		// vertices reached, not on the size of the graph. With the mc
+		// method, it is estimated from the random walk fingerprints of the
+		// vertices of ppv_map, and its cost only depends on the size of
+		// ppv_map. With other methods it falls back to pageRank_ppv.
+
+		void pageRank_ppv_sparse(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks);
+
+		// Thread-safe version of the above (see the const pageRank_ppv)
+
+		void pageRank_ppv_sparse(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks,
+								 PrankWorkspace & ws) const;
+
+		// Write how many PPVs have been computed with the power method or
+		// Gauss-Seidel, how many iterations they needed, and how many of
+		// them were warm-started or extrapolated
+
+		std::ostream & write_prank_stats(std::ostream & o) const;
+		std::ostream & write_prank_stats(std::ostream & o, const PrankWorkspace & ws) const;
+
+		// Write the wall clock time and bytes of each step of the last
+		// create_from_binfile. Sections of aligned files are loaded
+		// concurrently, and their times overlap.
+
+		std::ostream & write_load_stats(std::ostream & o) const;
+
+		struct load_step_t {
+			std::string name;
+			size_t bytes;
+			double secs;
+			bool concurrent;   // run along with other steps
+		};
+
+		// Random walk fingerprints for the mc PageRank method. Every vertex
+		// gets R endpoints of random walks that stop with probability
+		// (1 - damping) at each step (see prank::fingerprint_walks).
+		// Fingerprints are stored in a separate file, and are read the
+		// first time they are needed (see glVars::prank::fp_fname).
+
+		void build_fingerprints(size_t R, float damping, bool use_weight);
+		void write_fingerprints(const std::string & fname) const;
+		void read_fingerprints(const std::string & fname);
+		void load_fingerprints(); // read glVars::prank::fp_fname, unless already read
+
+		// Use a file of precomputed PPVs (see PpvCache). From then on,
+		// pageRank_ppv and pageRank_ppv_sparse add up the stored PPVs of
+		// the vertices of the personalization vector, and only compute
+		// PageRank for the vertices without a stored PPV. write_prank_stats
+		// reports the hit rate and the error bounds.
+		// Throws runtime_error if the PPVs were computed over another graph
+		// (see graph_checksum) or with other damping or edge weights.
+
+		void load_ppv_cache(const std::string & fname);
+
+		// CRC-32 of the graph PageRank and random walks follow (the forward
+		// CSR), and of its edge weights if use_weight is set. Files derived
+		// from the graph (fingerprints, PPV caches) store it, so that they
+		// are not used with another KB, or with a KB modified afterwards
+		// (see apply_delta).
+
+		size_t graph_checksum(bool use_weight) const;
+
 		void ppv_weights(const std::vector<float> & ppv);
 
 		// given a source node and a limit (100) return a subgraph by performing a
@@ -254,19 +547,86 @@ namespace ukb {
 		static Kb * create();
 
 		// Private methods
-		Kb() : m_g(NULL), m_vertexN(0), m_edgeN(0) {};
+		Kb() : m_g(NULL), m_prank_weight(false), m_vertexN(0), m_edgeN(0),
+			   m_fp_R(0), m_fp_damping(0.0f), m_fp_weight(false) {};
 		Kb(const Kb &) {};
 		Kb &operator=(const Kb &);
 		~Kb() {};
 
 		Kb_vertex_t InsertNode(const std::string & name, unsigned char flags);
 
+		void init_prank();
+		void init_in_coefs();
+		void init_prank_lists();
+		void refresh_prank();
+		void check_prank() const;
+		void compute_static_prank();
+
+		const float *prank_init_vector(const PrankWorkspace & ws) const;
+
+		void pageRank_ppv_init(const std::vector<float> & ppv_map,
+							   std::vector<float> & ranks,
+							   const float *init,
+							   PrankWorkspace & ws) const;
+
+		size_t pageRank_ppv_mt(const std::vector<float> & ppv_map,
+							   std::vector<float> & ranks,
+							   const float *init,
+							   PrankWorkspace & ws) const;
+
+		void pageRank_ppv_mc(const Kb_sparse_vector & ppv_map,
+							 Kb_sparse_vector & ranks) const;
+
+		void pageRank_ppv_sparse_iter(const Kb_sparse_vector & ppv_map,
+									  Kb_sparse_vector & ranks,
+									  PrankWorkspace & ws) const;
+
+		void pageRank_ppv_cached(const std::vector<float> & ppv_map,
+								 std::vector<float> & ranks,
+								 PrankWorkspace & ws) const;
+		void pageRank_ppv_cached(const Kb_sparse_vector & ppv_map,
+								 Kb_sparse_vector & ranks,
+								 PrankWorkspace & ws) const;
+
+		void init_name_index(const std::vector<vertex_prop_t> & vProp);
+		void init_edge_props(const precsr_t & pre);
+		void init_in_edges();
+		void sym_reverse(std::vector<Kb_index_t> & rev) const;
+		prank::in_csr<Kb_index_t, Kb_vertex_t> prank_in_csr() const;
+		void map_csr();
+		KbGraph & boost_graph() const;
+		void build_boost_graph() const;
+
+		void read_from_txt_mt(const std::string & synsFile,
+							  const std::set<std::string> & rels_source, size_t threads);
+		void init_graph(precsr_t & pre);
 		void read_from_stream (std::istream & o);
 		std::ostream & write_to_stream(std::ostream & o) const;
+		void read_from_mapfile(const std::string & fname);
+		void read_from_mapping(const char *base, size_t size, bool verify_sums);
+		std::ostream & write_to_mapstream(std::ostream & o) const;
 		// Private members
-		std::auto_ptr<KbGraph> m_g;
+		mutable std::auto_ptr<KbGraph> m_g;             // boost graph (see boost_graph)
+
+		// Forward CSR. It points to the arrays of m_g, or to the mapped
+		// file or shared memory segment of the KB (see map_csr).
+
+		MappedArray<Kb_index_t> m_rowstart;
+		MappedArray<Kb_vertex_t> m_column;
 		std::set<std::string> m_relsSource;              // Relation sources
-		std::map<std::string, Kb_vertex_t> m_synsetMap; // synset name to vertex id
+		NameIndex m_names;                              // vertex names, and synset name to vertex id
+		MappedArray<float> m_eweight;                   // edge weights (forward CSR order)
+		MappedArray<etype_t::value_type> m_etype;       // edge relation types (forward CSR order)
+
+		// In-edges (see init_in_edges). The out-edges of v in
+		// [rowstart[v], m_sym_end[v]) of the forward CSR have their reverse
+		// in the graph, so they are in-edges of v as well. The other
+		// in-edges of v are the overlay, [m_ovl_rowstart[v], m_ovl_rowstart[v + 1]).
+
+		MappedArray<Kb_index_t> m_sym_end;
+		MappedArray<Kb_index_t> m_ovl_rowstart;
+		MappedArray<Kb_vertex_t> m_ovl_column;          // overlay: source vertices
+		MappedArray<Kb_index_t> m_ovl_edge;             // overlay: edge indices
 
 		// Registered relation types
 
@@ -277,9 +637,24 @@ namespace ukb {
 		// Aux variables
 
 		std::vector<float> m_out_coefs;          // aux. vector of out-degree coefficients
+		MappedArray<float> m_in_coefs;           // aux. vector of symmetric in-edge transition coefficients (forward CSR order)
+		MappedArray<float> m_ovl_coefs;          // aux. vector of overlay in-edge transition coefficients
+		std::vector<size_t> m_prank_active;      // vertices with out-edges
+		std::vector<size_t> m_prank_dangling;    // vertices with in-edges only
+		std::vector<size_t> m_prank_chunks;      // vertex chunks for multi-threaded PageRank
+		bool m_prank_weight;                     // whether the coefficients follow edge weights
 		size_t m_vertexN;                        // Number of vertices
 		size_t m_edgeN;                          // Number of edges
 		std::vector<float> m_static_ppv;         // aux. vector with static prank computation
+		PrankWorkspace m_ws;                     // workspace of the non-const PageRank methods
+		std::vector<unsigned int> m_fp;          // random walk fingerprints (m_fp_R per vertex)
+		size_t m_fp_R;                           // fingerprints per vertex
+		float m_fp_damping;                      // damping used when computing the fingerprints
+		bool m_fp_weight;                        // whether walks followed edge weights
+		std::auto_ptr<PpvCache> m_ppv_cache;      // precomputed PPVs (if any)
+		std::auto_ptr<boost::interprocess::file_mapping> m_map_file;   // binfile in the aligned format,
+		std::auto_ptr<boost::interprocess::mapped_region> m_map_region; // where m_names (and mapped arrays) point to
+		std::vector<load_step_t> m_load_steps;   // profile of the last load (see write_load_stats)
 	};
 }
 
@@ -1,5 +1,8 @@
 #include "kbGraph_common.h"
 
+#include <algorithm>
+#include <functional>
+
 namespace ukb {
 
 	using namespace std;
@@ -129,4 +132,243 @@ namespace ukb {
 			m_rtypes.add_type(rtype,eProp[eidx].etype);
 		return eidx;
 	}
+
+	void precsr_t::relabel(const std::vector<size_t> & perm) {
+
+		for(std::vector<vertex_pair_t>::iterator it = E.begin(), end = E.end();
+			it != end; ++it) {
+			it->first = perm[it->first];
+			it->second = perm[it->second];
+		}
+		std::vector<vertex_prop_t> newProp(vProp.size());
+		for(size_t u = 0, m = vProp.size(); u != m; ++u)
+			newProp[perm[u]].name.swap(vProp[u].name);
+		vProp.swap(newProp);
+		for(vertex_map_t::iterator it = m_vMap.begin(), end = m_vMap.end();
+			it != end; ++it)
+			it->second = perm[it->second];
+		edge_map_t().swap(m_eMap);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Vertex orderings
+
+	// Undirected adjacency lists of pre, in CSR form, without duplicates
+
+	static void undirected_adjacency(const precsr_t & pre,
+									 std::vector<size_t> & rowstart,
+									 std::vector<size_t> & column) {
+
+		size_t N = pre.m_vsize;
+		std::vector<size_t>(N + 1, 0).swap(rowstart);
+		for(size_t i = 0, m = pre.E.size(); i != m; ++i) {
+			++rowstart[pre.E[i].first + 1];
+			++rowstart[pre.E[i].second + 1];
+		}
+		for(size_t u = 0; u != N; ++u) rowstart[u + 1] += rowstart[u];
+		std::vector<size_t> col(rowstart[N]);
+		std::vector<size_t> pos(rowstart.begin(), rowstart.end() - 1);
+		for(size_t i = 0, m = pre.E.size(); i != m; ++i) {
+			size_t u = pre.E[i].first;
+			size_t v = pre.E[i].second;
+			col[pos[u]++] = v;
+			col[pos[v]++] = u;
+		}
+		// sort and remove duplicates (u->v and v->u give two entries)
+		size_t j = 0;
+		for(size_t u = 0; u != N; ++u) {
+			std::vector<size_t>::iterator b = col.begin() + rowstart[u];
+			std::vector<size_t>::iterator e = col.begin() + rowstart[u + 1];
+			std::sort(b, e);
+			e = std::unique(b, e);
+			rowstart[u] = j;
+			for(; b != e; ++b) col[j++] = *b;
+		}
+		rowstart[N] = j;
+		col.resize(j);
+		column.swap(col);
+	}
+
+	struct degree_less {
+		const std::vector<size_t> & rs;
+		degree_less(const std::vector<size_t> & rowstart) : rs(rowstart) {}
+		size_t deg(size_t u) const { return rs[u + 1] - rs[u]; }
+		bool operator()(size_t u, size_t v) const { return deg(u) < deg(v); }
+	};
+
+	struct degree_greater {
+		degree_less less;
+		degree_greater(const std::vector<size_t> & rowstart) : less(rowstart) {}
+		bool operator()(size_t u, size_t v) const { return less(v, u); }
+	};
+
+	// Breadth-first order of all vertices. Components are visited starting
+	// from the vertices in seeds, in order. If rcm, neighbors are visited by
+	// increasing degree (Cuthill-McKee).
+
+	static void bfs_order(const std::vector<size_t> & rowstart,
+						  const std::vector<size_t> & column,
+						  const std::vector<size_t> & seeds,
+						  bool rcm,
+						  std::vector<size_t> & order) {
+
+		size_t N = rowstart.size() - 1;
+		std::vector<bool> seen(N, false);
+		order.clear();
+		order.reserve(N);
+		degree_less dl(rowstart);
+		for(size_t i = 0; i != N; ++i) {
+			size_t s = seeds[i];
+			if (seen[s]) continue;
+			seen[s] = true;
+			size_t head = order.size();
+			order.push_back(s);
+			while(head != order.size()) {
+				size_t u = order[head++];
+				size_t first = order.size();
+				for(size_t j = rowstart[u], j_end = rowstart[u + 1]; j != j_end; ++j) {
+					size_t v = column[j];
+					if (seen[v]) continue;
+					seen[v] = true;
+					order.push_back(v);
+				}
+				if (rcm)
+					std::stable_sort(order.begin() + first, order.end(), dl);
+			}
+		}
+	}
+
+	// Rabbit Order (Arai et al., 2016), sequential version. Vertices are
+	// visited by increasing degree, and each one is merged into the
+	// neighboring community that most increases modularity, if any. The
+	// merges form a dendrogram, whose depth-first traversal gives the
+	// order, so that vertices of the same community get consecutive ids.
+
+	static void rabbit_order(const std::vector<size_t> & rowstart,
+							 const std::vector<size_t> & column,
+							 std::vector<size_t> & order) {
+
+		typedef std::pair<size_t, float> adj_t;
+
+		size_t N = rowstart.size() - 1;
+		float m2 = static_cast<float>(column.size()); // 2 * number of edges
+		std::vector<std::vector<adj_t> > adj(N);
+		std::vector<float> d(N);
+		std::vector<size_t> parent(N);
+		std::vector<size_t> child(N, N);   // first child in the dendrogram
+		std::vector<size_t> sibling(N, N); // next sibling
+		std::vector<size_t> seeds(N);
+		for(size_t u = 0; u != N; ++u) {
+			d[u] = rowstart[u + 1] - rowstart[u];
+			parent[u] = u;
+			seeds[u] = u;
+			adj[u].reserve(rowstart[u + 1] - rowstart[u]);
+			for(size_t j = rowstart[u], j_end = rowstart[u + 1]; j != j_end; ++j)
+				adj[u].push_back(adj_t(column[j], 1.0f));
+		}
+		std::stable_sort(seeds.begin(), seeds.end(), degree_less(rowstart));
+
+		std::vector<float> acc(N, 0.0f);
+		std::vector<size_t> touched;
+		std::vector<size_t> roots;
+		for(size_t i = 0; i != N; ++i) {
+			size_t u = seeds[i];
+			// gather the edges of community u towards other communities
+			touched.clear();
+			for(size_t j = 0, j_end = adj[u].size(); j != j_end; ++j) {
+				size_t r = adj[u][j].first;
+				while(parent[r] != r) r = parent[r];
+				// path compression
+				for(size_t x = adj[u][j].first; parent[x] != r; ) {
+					size_t nx = parent[x];
+					parent[x] = r;
+					x = nx;
+				}
+				if (r == u) continue;
+				if (acc[r] == 0.0f) touched.push_back(r);
+				acc[r] += adj[u][j].second;
+			}
+			size_t best = N;
+			float best_dq = 0.0f;
+			std::vector<adj_t> A;
+			A.reserve(touched.size());
+			for(size_t j = 0, j_end = touched.size(); j != j_end; ++j) {
+				size_t r = touched[j];
+				float dq = 2.0f * (acc[r] / m2 - d[u] * d[r] / (m2 * m2));
+				if (dq > best_dq) {
+					best_dq = dq;
+					best = r;
+				}
+				A.push_back(adj_t(r, acc[r]));
+				acc[r] = 0.0f;
+			}
+			if (best == N) {
+				adj[u].swap(A);
+				roots.push_back(u);
+				continue;
+			}
+			// merge u into best
+			parent[u] = best;
+			d[best] += d[u];
+			sibling[u] = child[best];
+			child[best] = u;
+			adj[best].insert(adj[best].end(), A.begin(), A.end());
+			std::vector<adj_t>().swap(adj[u]);
+		}
+
+		// depth-first traversal of the dendrogram
+		order.clear();
+		order.reserve(N);
+		std::vector<size_t> S;
+		for(size_t i = 0, m = roots.size(); i != m; ++i) {
+			S.push_back(roots[i]);
+			while(!S.empty()) {
+				size_t u = S.back();
+				S.pop_back();
+				order.push_back(u);
+				for(size_t c = child[u]; c != N; c = sibling[c])
+					S.push_back(c);
+			}
+		}
+	}
+
+	void vertex_order(const precsr_t & pre, glVars::KbReorder how,
+					  std::vector<size_t> & perm) {
+
+		size_t N = pre.m_vsize;
+		std::vector<size_t> order(N);
+		for(size_t u = 0; u != N; ++u) order[u] = u;
+
+		if (how != glVars::reorder_none) {
+			std::vector<size_t> rowstart, column;
+			undirected_adjacency(pre, rowstart, column);
+			switch(how) {
+			case glVars::reorder_degree:
+				std::stable_sort(order.begin(), order.end(), degree_greater(rowstart));
+				break;
+			case glVars::reorder_bfs: {
+				// start each component from its highest degree vertex
+				std::vector<size_t> seeds(order);
+				std::stable_sort(seeds.begin(), seeds.end(), degree_greater(rowstart));
+				bfs_order(rowstart, column, seeds, false, order);
+				break;
+			}
+			case glVars::reorder_rcm: {
+				// start each component from a lowest degree vertex
+				std::vector<size_t> seeds(order);
+				std::stable_sort(seeds.begin(), seeds.end(), degree_less(rowstart));
+				bfs_order(rowstart, column, seeds, true, order);
+				std::reverse(order.begin(), order.end());
+				break;
+			}
+			case glVars::reorder_rabbit:
+				rabbit_order(rowstart, column, order);
+				break;
+			default:
+				break;
+			}
+		}
+		perm.resize(N);
+		for(size_t i = 0; i != N; ++i) perm[order[i]] = i;
+	}
 }
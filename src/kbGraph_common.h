@@ -19,6 +19,7 @@
 #include <boost/tuple/tuple.hpp>   // for "tie"
 
 #include "common.h"
+#include "globalVars.h"
 
 namespace ukb {
 
@@ -137,7 +138,19 @@ namespace ukb {
 						   const std::string & vstr,
 						   float w,
 						   const std::string & rtype);
+
+		// Relabel vertices, so that vertex u becomes perm[u]. m_eMap is
+		// cleared.
+
+		void relabel(const std::vector<size_t> & perm);
 	};
+
+	// Vertex orderings for locality (see compile_kb --reorder). Computes
+	// perm, with perm[u] the new id of vertex u, from the undirected
+	// version of the graph.
+
+	void vertex_order(const precsr_t & pre, glVars::KbReorder how,
+					  std::vector<size_t> & perm);
 }
 
 #endif
@@ -0,0 +1,83 @@
+// -*-C++-*-
+
+#ifndef MAPPEDARRAY_H
+#define MAPPEDARRAY_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// Read-only array which either owns its elements, or points to elements
+// owned by others, such as a shared-memory segment (see
+// Kb::attach_shared). Those must outlive the array.
+//
+// Mapped elements can't be written. own() copies them first, so that
+// every process writes its own copy.
+
+namespace ukb {
+
+	template<typename T>
+	class MappedArray {
+
+	public:
+
+		typedef T value_type;
+		typedef const T * const_iterator;
+
+		MappedArray() : m_p(0), m_n(0), m_mapped(false) {}
+
+		// Use the n elements at p, instead of own ones
+
+		void map(const T *p, size_t n) {
+			std::vector<T>().swap(m_own);
+			m_p = p;
+			m_n = n;
+			m_mapped = true;
+		}
+
+		// Own elements, for writing
+
+		std::vector<T> & own() {
+			if (m_mapped) {
+				std::vector<T>(m_p, m_p + m_n).swap(m_own);
+				m_mapped = false;
+			}
+			return m_own;
+		}
+
+		void swap(std::vector<T> & v) {
+			own().swap(v);
+		}
+
+		void swap(MappedArray & o) {
+			m_own.swap(o.m_own);
+			std::swap(m_p, o.m_p);
+			std::swap(m_n, o.m_n);
+			std::swap(m_mapped, o.m_mapped);
+		}
+
+		bool mapped() const { return m_mapped; }
+		size_t size() const { return m_mapped ? m_n : m_own.size(); }
+		bool empty() const { return size() == 0; }
+
+		// NULL if empty
+
+		const T *data() const {
+			if (m_mapped) return m_p;
+			return m_own.empty() ? 0 : &m_own[0];
+		}
+
+		const T & operator[](size_t i) const { return data()[i]; }
+
+		const T *begin() const { return data(); }
+		const T *end() const { return data() + size(); }
+
+	private:
+
+		const T *m_p;
+		size_t m_n;
+		bool m_mapped;
+		std::vector<T> m_own;
+	};
+}
+#endif
@@ -0,0 +1,196 @@
+#include "nameIndex.h"
+
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+namespace ukb {
+
+	using namespace std;
+
+	std::ostream & operator<<(std::ostream & o, const name_ref & n) {
+		o.write(n.data, n.size);
+		return o;
+	}
+
+	bool operator==(const name_ref & a, const std::string & b) {
+		return a.size == b.size() && (a.size == 0 || memcmp(a.data, b.data(), a.size) == 0);
+	}
+
+	const NameIndex::slot_type NameIndex::empty_slot;
+
+	NameIndex::NameIndex() {
+		point_to_own();
+	}
+
+	// FNV-1a
+
+	size_t NameIndex::hash(const char *str, size_t n) {
+
+		size_t h = 2166136261u;
+		for(size_t i = 0; i != n; ++i) {
+			h ^= static_cast<unsigned char>(str[i]);
+			h *= 16777619u;
+			h &= 0xffffffffu; // same value on 32 and 64 bit platforms
+		}
+		return h;
+	}
+
+	void NameIndex::point_to_own() {
+		if (m_own_offsets.empty()) m_own_offsets.push_back(0);
+		m_chars = m_own_chars.empty() ? "" : &m_own_chars[0];
+		m_chars_n = m_own_chars.size();
+		m_offsets = &m_own_offsets[0];
+		m_n = m_own_offsets.size() - 1;
+		m_table = m_own_table.empty() ? 0 : &m_own_table[0];
+		m_table_n = m_own_table.size();
+	}
+
+	void NameIndex::push_back(const char *str, size_t n) {
+
+		if (m_offsets != &m_own_offsets[0])
+			throw logic_error("NameIndex: can not add names to a mapped index");
+		if (m_own_chars.size() + n >= static_cast<size_t>(static_cast<offset_type>(-1)))
+			throw runtime_error("NameIndex: vertex names are too long");
+		m_own_chars.insert(m_own_chars.end(), str, str + n);
+		m_own_offsets.push_back(m_own_chars.size());
+		point_to_own();
+	}
+
+	void NameIndex::reserve(size_t vertex_n, size_t chars_n) {
+		m_own_chars.reserve(chars_n);
+		m_own_offsets.reserve(vertex_n + 1);
+		point_to_own();
+	}
+
+	void NameIndex::build_table() {
+
+		size_t n = size();
+		if (n >= static_cast<size_t>(empty_slot))
+			throw runtime_error("NameIndex: too many vertices");
+		size_t m = 16;
+		while (m < 2 * n) m *= 2;
+		fill_table(m);
+	}
+
+	// Table of m slots (a power of two) with the names of the pool
+
+	void NameIndex::fill_table(size_t m) {
+
+		size_t n = size();
+		vector<slot_type>(m, empty_slot).swap(m_own_table);
+		size_t mask = m - 1;
+		for(size_t u = 0; u != n; ++u) {
+			name_ref s = name(u);
+			size_t i = hash(s.data, s.size) & mask;
+			while (m_own_table[i] != empty_slot) i = (i + 1) & mask;
+			m_own_table[i] = u;
+		}
+		m_table = &m_own_table[0];
+		m_table_n = m;
+	}
+
+	pair<size_t, bool> NameIndex::insert(const char *str, size_t n) {
+
+		if (m_offsets != &m_own_offsets[0])
+			throw logic_error("NameIndex: can not add names to a mapped index");
+		if (2 * (size() + 1) > m_table_n) {
+			if (size() + 1 >= static_cast<size_t>(empty_slot))
+				throw runtime_error("NameIndex: too many vertices");
+			size_t m = std::max(size_t(16), 2 * m_table_n);
+			while (m < 2 * (size() + 1)) m *= 2;
+			fill_table(m);
+		}
+		size_t mask = m_table_n - 1;
+		size_t i = hash(str, n) & mask;
+		for(;;) {
+			slot_type u = m_table[i];
+			if (u == empty_slot) break;
+			name_ref s = name(u);
+			if (s.size == n && (n == 0 || memcmp(s.data, str, n) == 0))
+				return make_pair(size_t(u), false);
+			i = (i + 1) & mask;
+		}
+		push_back(str, n);
+		m_own_table[i] = size() - 1;
+		return make_pair(size() - 1, true);
+	}
+
+	bool NameIndex::map(const char *chars, size_t chars_n,
+						const offset_type *offsets, size_t vertex_n,
+						const slot_type *table, size_t table_n) {
+
+		NameIndex aux;
+		aux.m_chars = chars_n ? chars : "";
+		aux.m_chars_n = chars_n;
+		aux.m_offsets = offsets;
+		aux.m_n = vertex_n;
+		aux.m_table = table;
+		aux.m_table_n = table_n;
+		if (!aux.valid()) return false;
+		clear();
+		m_chars = aux.m_chars;
+		m_chars_n = chars_n;
+		m_offsets = offsets;
+		m_n = vertex_n;
+		m_table = table;
+		m_table_n = table_n;
+		return true;
+	}
+
+	void NameIndex::clear() {
+		vector<char>().swap(m_own_chars);
+		vector<offset_type>().swap(m_own_offsets);
+		vector<slot_type>().swap(m_own_table);
+		point_to_own();
+	}
+
+	// Buffers of own vectors move along with them, so the pointers stay valid
+
+	void NameIndex::swap(NameIndex & o) {
+		m_own_chars.swap(o.m_own_chars);
+		m_own_offsets.swap(o.m_own_offsets);
+		m_own_table.swap(o.m_own_table);
+		std::swap(m_chars, o.m_chars);
+		std::swap(m_chars_n, o.m_chars_n);
+		std::swap(m_offsets, o.m_offsets);
+		std::swap(m_n, o.m_n);
+		std::swap(m_table, o.m_table);
+		std::swap(m_table_n, o.m_table_n);
+	}
+
+	pair<size_t, bool> NameIndex::find(const string & str) const {
+
+		if (m_table_n == 0) return make_pair(size_t(0), false);
+		size_t mask = m_table_n - 1;
+		size_t i = hash(str.data(), str.size()) & mask;
+		for(;;) {
+			slot_type u = m_table[i];
+			if (u == empty_slot) return make_pair(size_t(0), false);
+			if (name(u) == str) return make_pair(size_t(u), true);
+			i = (i + 1) & mask;
+		}
+	}
+
+	size_t NameIndex::memory() const {
+		return m_own_chars.capacity() * sizeof(char) + m_own_offsets.capacity() * sizeof(offset_type) +
+			m_own_table.capacity() * sizeof(slot_type);
+	}
+
+	// Check the arrays are consistent (after mapping them from a file).
+	// Only offsets and the table are read, not the names.
+
+	bool NameIndex::valid() const {
+
+		size_t n = m_n;
+		if (m_offsets[0] != 0 || m_offsets[n] != m_chars_n) return false;
+		for(size_t u = 0; u != n; ++u)
+			if (m_offsets[u] > m_offsets[u + 1]) return false;
+		size_t m = m_table_n;
+		if (m < 2 * n || (m & (m - 1))) return false; // power of two, at most half full
+		for(size_t i = 0; i != m; ++i)
+			if (m_table[i] != empty_slot && m_table[i] >= n) return false;
+		return true;
+	}
+}
@@ -0,0 +1,126 @@
+// -*-C++-*-
+
+#ifndef NAMEINDEX_H
+#define NAMEINDEX_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <iosfwd>
+
+// Vertex names, and index from vertex names to vertex ids.
+//
+// Names are stored together in a string pool: one blob with the chars of
+// all names, plus the 32 bit offset of each name within it (the name of
+// vertex u spans [offset[u], offset[u + 1])). An open-addressing hash table
+// (linear probing, at most half full) maps each name to its vertex. The
+// table holds vertex ids only; keys are compared against the pool.
+//
+// All members are flat arrays, so that they can be stored in binfiles as
+// they are laid out in memory (see Kb::write_to_mapstream). The arrays are
+// either owned by the index, or point into a memory-mapped binfile (see
+// map), in which case only the pages of the names actually used are read.
+
+namespace ukb {
+
+	// Read-only view of a vertex name. It converts to std::string.
+
+	struct name_ref {
+		const char *data;
+		size_t size;
+
+		name_ref(const char *d, size_t n) : data(d), size(n) {}
+		operator std::string() const { return std::string(data, size); }
+		std::string str() const { return std::string(data, size); }
+	};
+
+	std::ostream & operator<<(std::ostream & o, const name_ref & n);
+	bool operator==(const name_ref & a, const std::string & b);
+
+	class NameIndex {
+
+	public:
+
+		typedef unsigned int offset_type;
+		typedef unsigned int slot_type;
+		static const slot_type empty_slot = static_cast<slot_type>(-1);
+
+		NameIndex();
+
+		// Append the name of the next vertex. Names must be unique; the hash
+		// table is not updated until build_table is called.
+
+		void push_back(const char *str, size_t n);
+		void push_back(const std::string & name) { push_back(name.data(), name.size()); }
+		void reserve(size_t vertex_n, size_t chars_n);
+
+		// (Re)build the hash table over the names of the pool
+
+		void build_table();
+
+		// Vertex of name str, appending it first if it is new (second is
+		// then true). The hash table is kept up to date, and grows so that
+		// it stays at most half full.
+
+		std::pair<size_t, bool> insert(const char *str, size_t n);
+
+		// Use arrays of a memory-mapped binfile, instead of own ones. They
+		// must outlive the index. Returns false if they are not consistent.
+
+		bool map(const char *chars, size_t chars_n,
+				 const offset_type *offsets, size_t vertex_n,
+				 const slot_type *table, size_t table_n);
+
+		void clear();
+		void swap(NameIndex & o);
+
+		size_t size() const { return m_n; }
+
+		// Vertex of name str, if any
+
+		std::pair<size_t, bool> find(const std::string & str) const;
+
+		// Name of vertex u
+
+		name_ref name(size_t u) const {
+			return name_ref(m_chars + m_offsets[u], m_offsets[u + 1] - m_offsets[u]);
+		}
+
+		// Bytes used by the pool and the table (zero if mapped)
+
+		size_t memory() const;
+
+		// Hash function of names. It is stored in binfiles (through the
+		// hash table), so it must not change.
+
+		static size_t hash(const char *str, size_t n);
+
+		// Raw arrays (for serialization)
+
+		const char *chars() const { return m_chars; }
+		size_t chars_size() const { return m_chars_n; }
+		const offset_type *offsets() const { return m_offsets; }  // size() + 1 elements
+		const slot_type *table() const { return m_table; }
+		size_t table_size() const { return m_table_n; }
+
+	private:
+
+		void point_to_own();
+		void fill_table(size_t m);
+		bool valid() const;
+
+		// arrays in use
+		const char *m_chars;
+		size_t m_chars_n;
+		const offset_type *m_offsets;
+		size_t m_n;
+		const slot_type *m_table;
+		size_t m_table_n;
+
+		// own arrays
+		std::vector<char> m_own_chars;
+		std::vector<offset_type> m_own_offsets;
+		std::vector<slot_type> m_own_table;
+	};
+}
+#endif
@@ -0,0 +1,216 @@
+#include "ppvCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace ukb {
+
+	using namespace std;
+
+	static const size_t magic_id_ppvc = 0x261027;
+	static const size_t magic_id_ppvc_v1 = 0x261019; // same, without the KB checksum
+
+	PpvCache::PpvCache() : m_header(0), m_entries(0), m_vertices(0),
+						   m_values32(0), m_values16(0), m_entry_n(0) {}
+
+	PpvCache::~PpvCache() {}
+
+	void PpvCache::open(const string & fname, size_t vertex_n, size_t checksum,
+						float damping, bool weight) {
+
+		using namespace boost::interprocess;
+
+		try {
+			m_file.reset(new file_mapping(fname.c_str(), read_only));
+			m_region.reset(new mapped_region(*m_file, read_only));
+		} catch (std::exception & e) {
+			throw runtime_error(string("[E] loading PPV cache: can not open ") + fname + ": " + e.what());
+		}
+		size_t size = m_region->get_size();
+		const char *base = static_cast<const char *>(m_region->get_address());
+		if (size < sizeof(header_t))
+			throw runtime_error(string("[E] loading PPV cache: ") + fname + " is truncated");
+		const header_t *h = reinterpret_cast<const header_t *>(base);
+		if (h->magic == magic_id_ppvc_v1)
+			throw runtime_error(string("[E] loading PPV cache: ") + fname + " has no KB checksum. Please compile it again");
+		if (h->magic != magic_id_ppvc || (h->value_bits != 32 && h->value_bits != 16))
+			throw runtime_error(string("[E] loading PPV cache: invalid id in ") + fname);
+		if (h->damping != damping || (h->weight != 0) != weight) {
+			ostringstream oss;
+			oss << "[E] loading PPV cache: PPVs in " << fname << " were computed with damping " << h->damping
+				<< (h->weight ? " and" : " and no") << " edge weights";
+			throw runtime_error(oss.str());
+		}
+		if (h->vertex_n != vertex_n || h->checksum != checksum)
+			throw runtime_error(string("[E] loading PPV cache: ") + fname + " does not match the KB");
+
+		// Sizes are checked one section at a time, so that they can not
+		// overflow
+		size_t left = size - sizeof(header_t);
+		if (h->entry_n > left / sizeof(entry_t))
+			throw runtime_error(string("[E] loading PPV cache: ") + fname + " is truncated");
+		left -= h->entry_n * sizeof(entry_t);
+		if (h->value_n > left / (sizeof(unsigned int) + h->value_bits / 8))
+			throw runtime_error(string("[E] loading PPV cache: ") + fname + " is truncated");
+		const entry_t *entries = reinterpret_cast<const entry_t *>(base + sizeof(header_t));
+		const unsigned int *vertices = reinterpret_cast<const unsigned int *>(entries + h->entry_n);
+		const char *values = reinterpret_cast<const char *>(vertices + h->value_n);
+
+		// Entries are sorted by vertex (see find), and their values are
+		// within the file
+		for(size_t i = 0; i != h->entry_n; ++i) {
+			const entry_t & e = entries[i];
+			if (e.u >= vertex_n || (i && e.u <= entries[i - 1].u) ||
+				e.n > h->value_n || e.offset > h->value_n - e.n)
+				throw runtime_error(string("[E] loading PPV cache: ") + fname + " is corrupt (entry " +
+									boost::lexical_cast<string>(i) + ")");
+		}
+		for(size_t j = 0; j != h->value_n; ++j) {
+			if (vertices[j] >= vertex_n)
+				throw runtime_error(string("[E] loading PPV cache: ") + fname + " is corrupt (value " +
+									boost::lexical_cast<string>(j) + ")");
+		}
+		m_header = h;
+		m_entries = entries;
+		m_vertices = vertices;
+		m_values32 = 0;
+		m_values16 = 0;
+		if (h->value_bits == 16)
+			m_values16 = reinterpret_cast<const bfloat16 *>(values);
+		else
+			m_values32 = reinterpret_cast<const float *>(values);
+		m_entry_n = h->entry_n;
+	}
+
+	struct entry_u_less {
+		bool operator()(const PpvCache::entry_t & a, unsigned int u) const { return a.u < u; }
+		bool operator()(const PpvCache::entry_t & a, const PpvCache::entry_t & b) const { return a.u < b.u; }
+	};
+
+	const PpvCache::entry_t *PpvCache::find(unsigned int u) const {
+
+		const entry_t *end = m_entries + m_entry_n;
+		const entry_t *it = std::lower_bound(m_entries, end, u, entry_u_less());
+		if (it == end || it->u != u) return 0;
+		return it;
+	}
+
+	void PpvCache::add_to(const entry_t & e, float w, vector<float> & acc) const {
+
+		const unsigned int *u = m_vertices + e.offset;
+		if (m_values16) {
+			const bfloat16 *v = m_values16 + e.offset;
+			for(size_t j = 0; j != e.n; ++j) acc[u[j]] += w * v[j];
+		} else {
+			const float *v = m_values32 + e.offset;
+			for(size_t j = 0; j != e.n; ++j) acc[u[j]] += w * v[j];
+		}
+	}
+
+	// writer
+
+	PpvCache::writer::writer(const string & fname, size_t vertex_n, size_t checksum, size_t topk,
+							 float damping, bool weight, bool bf16) : m_fname(fname) {
+		m_h.magic = magic_id_ppvc;
+		m_h.vertex_n = vertex_n;
+		m_h.checksum = checksum;
+		m_h.topk = topk;
+		m_h.entry_n = 0;
+		m_h.value_n = 0;
+		m_h.damping = damping;
+		m_h.weight = weight;
+		m_h.value_bits = bf16 ? 16 : 32;
+		m_h.pad = 0;
+	}
+
+	typedef pair<unsigned int, float> value_t;
+
+	struct value_greater {
+		bool operator()(const value_t & a, const value_t & b) const {
+			return a.second > b.second;
+		}
+	};
+
+	void PpvCache::writer::add(unsigned int u, const vector<float> & ppv, float err) {
+
+		vector<value_t> V;
+		float total = 0.0f;
+		for(size_t i = 0, m = ppv.size(); i != m; ++i) {
+			if (ppv[i] == 0.0f) continue;
+			V.push_back(value_t(i, ppv[i]));
+			total += ppv[i];
+		}
+		if (V.size() > m_h.topk) {
+			std::nth_element(V.begin(), V.begin() + m_h.topk, V.end(), value_greater());
+			V.resize(m_h.topk);
+		}
+		std::sort(V.begin(), V.end());
+		// tail is the truncated mass, plus the rounding error of bfloat16
+		float kept = 0.0f;
+		float rounding = 0.0f;
+		for(size_t i = 0, m = V.size(); i != m; ++i) {
+			kept += V[i].second;
+			if (m_h.value_bits == 16) {
+				float r = bfloat16(V[i].second);
+				rounding += fabs(r - V[i].second);
+				V[i].second = r;
+			}
+		}
+
+		entry_t e;
+		e.u = u;
+		e.n = V.size();
+		e.offset = m_values.size();
+		e.tail = std::max(total - kept, 0.0f) + rounding;
+		e.err = err;
+		m_entries.push_back(e);
+		m_values.insert(m_values.end(), V.begin(), V.end());
+	}
+
+	void PpvCache::writer::close() {
+
+		// Sort entries by vertex, and lay out their values in the same order
+		std::sort(m_entries.begin(), m_entries.end(), entry_u_less());
+		vector<unsigned int> vertices;
+		vector<float> values32;
+		vector<bfloat16> values16;
+		vertices.reserve(m_values.size());
+		for(size_t i = 0, m = m_entries.size(); i != m; ++i) {
+			entry_t & e = m_entries[i];
+			size_t offset = vertices.size();
+			for(size_t j = e.offset, j_end = e.offset + e.n; j != j_end; ++j) {
+				vertices.push_back(m_values[j].first);
+				if (m_h.value_bits == 16)
+					values16.push_back(bfloat16(m_values[j].second));
+				else
+					values32.push_back(m_values[j].second);
+			}
+			e.offset = offset;
+		}
+		m_h.entry_n = m_entries.size();
+		m_h.value_n = vertices.size();
+
+		ofstream fo(m_fname.c_str(),  ofstream::binary|ofstream::out);
+		if (!fo)
+			throw runtime_error(string("[E] can not create ") + m_fname);
+		fo.write(reinterpret_cast<const char *>(&m_h), sizeof(header_t));
+		if (m_entries.size())
+			fo.write(reinterpret_cast<const char *>(&m_entries[0]), m_entries.size() * sizeof(entry_t));
+		if (vertices.size())
+			fo.write(reinterpret_cast<const char *>(&vertices[0]), vertices.size() * sizeof(unsigned int));
+		if (values32.size())
+			fo.write(reinterpret_cast<const char *>(&values32[0]), values32.size() * sizeof(float));
+		if (values16.size())
+			fo.write(reinterpret_cast<const char *>(&values16[0]), values16.size() * sizeof(bfloat16));
+		if (!fo)
+			throw runtime_error(string("[E] error writing ") + m_fname);
+	}
+}
@@ -0,0 +1,141 @@
+// -*-C++-*-
+
+#ifndef PPVCACHE_H
+#define PPVCACHE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <iosfwd>
+#include <memory>
+
+#include "common.h"
+
+// Store of precomputed PPVs, one per source vertex (see compile_kb
+// --ppv_cache).
+//
+// PageRank is linear in the personalization vector, so the PPV of a
+// context is the weighted sum of the PPVs of its concepts. Each stored PPV
+// is truncated to its top-k values, and keeps the mass it lost by the
+// truncation and by rounding (its tail), along with a bound of the
+// distance from the computed PPV to the exact one (its err). If the
+// personalization vector has weight w_u on vertex u, the stored part of
+// the result is off by at most sum w_u * (tail_u + err_u) in L1 norm. The
+// PPV of the rest of vertices, computed as usual, adds its own solver
+// error (see Kb::pageRank_ppv_cached).
+//
+// The file is memory-mapped, so it is shared among processes and only the
+// pages of the PPVs actually used are read.
+//
+// Values are stored as float, or as bfloat16 to halve their size.
+//
+// File layout (native byte order):
+//
+//   header
+//   entries  (one per source vertex, sorted by vertex)
+//   vertices (of the values of all PPVs, sorted by vertex within each PPV)
+//   values   (float or bfloat16, in the same order as vertices)
+
+namespace boost {
+	namespace interprocess {
+		class file_mapping;
+		class mapped_region;
+	}
+}
+
+namespace ukb {
+
+	class PpvCache {
+
+	public:
+
+		struct header_t {
+			size_t magic;
+			size_t vertex_n;  // vertices of the KB
+			size_t checksum;  // of the KB graph (see Kb::graph_checksum)
+			size_t topk;      // maximum values per PPV
+			size_t entry_n;   // number of stored PPVs
+			size_t value_n;   // number of stored values
+			float damping;    // PageRank parameters used to compute the PPVs
+			unsigned int weight;
+			unsigned int value_bits; // 32 (float) or 16 (bfloat16)
+			unsigned int pad;
+		};
+
+		struct entry_t {
+			unsigned int u;   // source vertex
+			unsigned int n;   // number of values
+			size_t offset;    // first value
+			float tail;       // L1 mass lost by truncation and rounding
+			float err;        // L1 distance bound to the exact PPV
+		};
+
+		PpvCache();
+		~PpvCache();
+
+		// Map a cache file. Throws runtime_error if it can not be opened, if
+		// it is corrupt, or if its PPVs were not computed over a KB of
+		// vertex_n vertices and graph checksum, with the given damping and
+		// edge weights. Every entry is checked here, so that lookups need
+		// not check anything.
+
+		void open(const std::string & fname, size_t vertex_n, size_t checksum,
+				  float damping, bool weight);
+
+		bool empty() const { return m_entry_n == 0; }
+		const header_t & header() const { return *m_header; }
+
+		// Stored PPV of vertex u, or NULL if there is none
+
+		const entry_t *find(unsigned int u) const;
+
+		// Add w times the stored PPV of e to the dense vector acc
+
+		void add_to(const entry_t & e, float w, std::vector<float> & acc) const;
+
+		// Append the (vertex, w * value) pairs of the stored PPV of e to out
+
+		template<typename Pair>
+		void append_to(const entry_t & e, float w, std::vector<Pair> & out) const {
+			const unsigned int *u = m_vertices + e.offset;
+			if (m_values16) {
+				const bfloat16 *v = m_values16 + e.offset;
+				for(size_t j = 0; j != e.n; ++j) out.push_back(Pair(u[j], w * v[j]));
+			} else {
+				const float *v = m_values32 + e.offset;
+				for(size_t j = 0; j != e.n; ++j) out.push_back(Pair(u[j], w * v[j]));
+			}
+		}
+
+		// Write a cache file. Each added PPV (a dense vector of vertex_n
+		// values) is truncated to its top-k values. err is the L1 distance
+		// bound from ppv to the exact PPV.
+
+		class writer {
+		public:
+			writer(const std::string & fname, size_t vertex_n, size_t checksum, size_t topk,
+				   float damping, bool weight, bool bf16);
+			void add(unsigned int u, const std::vector<float> & ppv, float err);
+			void close();
+		private:
+			std::string m_fname;
+			header_t m_h;
+			std::vector<entry_t> m_entries;
+			std::vector<std::pair<unsigned int, float> > m_values;
+		};
+
+	private:
+		PpvCache(const PpvCache &);
+		PpvCache & operator=(const PpvCache &);
+
+		std::auto_ptr<boost::interprocess::file_mapping> m_file;
+		std::auto_ptr<boost::interprocess::mapped_region> m_region;
+		const header_t *m_header;
+		const entry_t *m_entries;
+		const unsigned int *m_vertices;
+		const float *m_values32;
+		const bfloat16 *m_values16;
+		size_t m_entry_n;
+	};
+}
+#endif
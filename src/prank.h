@@ -6,7 +6,12 @@
 #include <boost/graph/graph_concepts.hpp>
 #include <boost/unordered_set.hpp>
 #include <queue>
+#include <algorithm>
 #include <boost/tuple/tuple.hpp> // for "tie"
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/bind.hpp>
+#include <boost/random/uniform_01.hpp>
 #include <iosfwd>
 
 /////////////////////////////////////////////////////////////////////
@@ -25,6 +30,12 @@
 //
 // Note: it correctly handles dangling nodes
 
+#if defined(__GNUC__)
+#define UKB_PREFETCH(addr) __builtin_prefetch((addr), 0, 1)
+#else
+#define UKB_PREFETCH(addr)
+#endif
+
 namespace ukb {
 
 	namespace prank {
@@ -100,7 +111,6 @@ namespace ukb {
 			return init_out_coefs(g, W, cte_weight);
 		}
 
-
 		//
 		// Apply one step of pageRank algorithm
 		//
@@ -201,6 +211,1052 @@ namespace ukb {
 			}
 		}
 
+		/////////////////////////////////////////////////////////////////
+		// PageRank over a flat CSR
+		//
+		// Same as update_pRank/do_pageRank, but the in-edges are read
+		// directly from flat arrays (see in_csr). Thus every in-edge costs
+		// just two sequential loads plus rank_map1[source], which is
+		// prefetched in advance.
+
+		// in-edges ahead to prefetch
+		static const size_t prefetch_distance = 16;
+
+		// End of the part of [i, i_end) whose edges have an edge to prefetch
+		// prefetch_distance edges ahead, before pf_end. Loops prefetch up to
+		// there, and run the rest without prefetching, so that no edge pays
+		// for the bound check.
+
+		template<typename idx_t>
+		inline idx_t prefetch_end(idx_t i, idx_t i_end, idx_t pf_end) {
+			if (pf_end <= prefetch_distance) return i;
+			idx_t e = pf_end - static_cast<idx_t>(prefetch_distance);
+			if (e > i_end) return i_end;
+			return e < i ? i : e;
+		}
+
+		//
+		// In-edges of a graph stored with symmetric edges. An edge u->v is
+		// symmetric if its reverse v->u is also in the graph. The symmetric
+		// in-edges of v are not stored apart, but read from the forward CSR
+		// of the graph: they are the out-edges [rowstart[v], sym_end[v]) of
+		// v (column[i] is u for the out-edge v->u). The rest of the in-edges
+		// of v (the overlay) are [ovl_rowstart[v], ovl_rowstart[v+1]) of a
+		// CSR of their own. coef and ovl_coef hold the transition
+		// probability of each in-edge (see Kb::init_in_coefs), indexed as
+		// column and ovl_column.
+		//
+		// A plain backward CSR is an in_csr with sym_end[v] = rowstart[v+1]
+		// and an empty overlay.
+		//
+
+		template<typename idx_t, typename vertex_t>
+		struct in_csr {
+			size_t V;
+			const idx_t *rowstart;
+			const idx_t *sym_end;
+			const vertex_t *column;
+			const float *coef;
+			const idx_t *ovl_rowstart;
+			const vertex_t *ovl_column;
+			const float *ovl_coef;
+
+			in_csr(size_t V_,
+				   const idx_t *rowstart_, const idx_t *sym_end_, const vertex_t *column_, const float *coef_,
+				   const idx_t *ovl_rowstart_, const vertex_t *ovl_column_, const float *ovl_coef_)
+				: V(V_), rowstart(rowstart_), sym_end(sym_end_), column(column_), coef(coef_),
+				  ovl_rowstart(ovl_rowstart_), ovl_column(ovl_column_), ovl_coef(ovl_coef_) {}
+
+			size_t degree(size_t v) const {
+				return (sym_end[v] - rowstart[v]) + (ovl_rowstart[v + 1] - ovl_rowstart[v]);
+			}
+
+			// number of in-edges
+			size_t edges() const {
+				size_t n = ovl_rowstart[V];
+				for(size_t v = 0; v != V; ++v) n += sym_end[v] - rowstart[v];
+				return n;
+			}
+		};
+
+		// Sum of the ranks pulled through [i, i_end) of column:
+		// rank_map[column[i]] * coef[i] if weighted, else scaled[column[i]]
+		// (see the specialized kernels below).
+
+		template<bool weighted, typename idx_t, typename vertex_t>
+		inline float pull_ranks(idx_t i, idx_t i_end, idx_t pf_end,
+								const vertex_t *column,
+								const float *coef,
+								const float *rank_map,
+								const float *scaled) {
+			float rank = 0.0;
+			const float *pf_map = weighted ? rank_map : scaled;
+			for(idx_t i_pf = prefetch_end(i, i_end, pf_end); i != i_pf; ++i) {
+				UKB_PREFETCH(pf_map + column[i + prefetch_distance]);
+				if (weighted)
+					rank += rank_map[column[i]] * coef[i];
+				else
+					rank += scaled[column[i]];
+			}
+			for(; i != i_end; ++i) {
+				if (weighted)
+					rank += rank_map[column[i]] * coef[i];
+				else
+					rank += scaled[column[i]];
+			}
+			return rank;
+		}
+
+		template<bool weighted, typename idx_t, typename vertex_t>
+		inline float pull_ranks(const in_csr<idx_t, vertex_t> & in,
+								size_t v,
+								const float *rank_map,
+								const float *scaled) {
+			float rank = pull_ranks<weighted>(in.rowstart[v], in.sym_end[v], in.rowstart[in.V],
+											  in.column, in.coef, rank_map, scaled);
+			if (in.ovl_rowstart[v] != in.ovl_rowstart[v + 1])
+				rank += pull_ranks<weighted>(in.ovl_rowstart[v], in.ovl_rowstart[v + 1], in.ovl_rowstart[in.V],
+											 in.ovl_column, in.ovl_coef, rank_map, scaled);
+			return rank;
+		}
+
+		//
+		// Acceleration of the iterative solvers
+		//
+		// init: initial rank vector (warm start). If NULL, iterations start
+		//       from the uniform vector 1/N.
+		// aitken_period: if not zero, apply Aitken extrapolation every
+		//       aitken_period iterations (power method only).
+		// aitken_n: (output) number of extrapolations applied.
+		//
+
+		struct pm_accel {
+			const float *init;
+			size_t aitken_period;
+			size_t aitken_n;
+			pm_accel() : init(0), aitken_period(0), aitken_n(0) {}
+		};
+
+		//
+		// Aitken's delta-squared extrapolation. x2, x1 and x0 are three
+		// consecutive iterates (x0 the newest) of n components placed every
+		// stride positions. The extrapolated vector is left in x0.
+		//
+		// The extrapolation is only applied to components that converge
+		// linearly, i.e., the ratio r between their two last differences is
+		// in (-1, 1). Then the limit is x0 + (x0 - x1) * r / (1 - r).
+		//
+
+		template<typename rank_t>
+		inline void aitken_extrapolate(const rank_t *x2, const rank_t *x1, rank_t *x0,
+									   size_t n, size_t stride = 1) {
+			for(size_t i = 0, j = 0; i != n; ++i, j += stride) {
+				float a0 = x0[j], a1 = x1[j], a2 = x2[j];
+				float g = a0 - a1;
+				float h = a1 - a2;
+				if (h == 0.0f) continue;
+				float r = g / h;
+				if (r <= -1.0f || r >= 1.0f) continue;
+				float x = a0 + g * r / (1.0f - r);
+				x0[j] = x < 0.0f ? 0.0f : x;
+			}
+		}
+
+		// Initialize a rank vector of V components, either from init or with
+		// the uniform vector 1/N
+
+		inline void init_ranks(float *rank_map, size_t V, size_t N, const pm_accel *accel) {
+			if (accel && accel->init)
+				std::copy(accel->init, accel->init + V, rank_map);
+			else
+				std::fill(rank_map, rank_map + V, 1.0f/static_cast<float>(N));
+		}
+
+		template<typename idx_t, typename vertex_t>
+		float update_pRank_coef(size_t v_begin,
+								size_t v_end,
+								const in_csr<idx_t, vertex_t> & in,
+								float damping,
+								const float *ppv_V,
+								const std::vector<float> & out_coef,
+								const float *rank_map1,
+								float *rank_map2) {
+
+			float norm = 0.0;
+			for (size_t v = v_begin; v != v_end; ++v) {
+				if (-1.0 == out_coef[v]) continue;
+				float rank = pull_ranks<true>(in, v, rank_map1, static_cast<const float *>(0));
+				float dangling_factor = 0.0;
+				if (0.0 == out_coef[v]) {
+					// dangling link
+					dangling_factor = damping * rank_map1[v];
+				}
+				rank_map2[v] = damping * rank + (dangling_factor + 1.0 - damping ) * ppv_V[v];
+				norm += fabs(rank_map2[v] - rank_map1[v]);
+			}
+			return norm;
+		}
+
+		/////////////////////////////////////////////////////////////////
+		// Specialized power method kernels
+		//
+		// update_pRank_coef tests out_coef[v] for every vertex. Instead, the
+		// vertices are classified once per graph (see init_vertex_lists):
+		// active vertices have out-edges, dangling vertices only have
+		// in-edges, and isolated vertices are never updated. Each class has
+		// its own loop, without tests on out_coef.
+		//
+		// The kernels are specialized at compile time for weighted and
+		// unweighted graphs. In unweighted graphs all out-edges of u have
+		// the same transition probability out_coef[u], so each rank vector
+		// comes with a scaled copy (rank_map[u] * out_coef[u]), and every
+		// in-edge costs a single load instead of two loads and a product.
+		// The scaled ranks of dangling and isolated vertices are zero.
+
+		inline void init_vertex_lists(const std::vector<float> & out_coef,
+									  std::vector<size_t> & active,
+									  std::vector<size_t> & dangling) {
+			active.clear();
+			dangling.clear();
+			for (size_t v = 0, V = out_coef.size(); v != V; ++v) {
+				if (out_coef[v] > 0.0f) active.push_back(v);
+				else if (0.0 == out_coef[v]) dangling.push_back(v);
+			}
+		}
+
+		// Update the vertices in [list, list_end). If dangling, all of them
+		// are dangling vertices, else all of them are active.
+
+		template<bool weighted, bool dangling, typename idx_t, typename vertex_t>
+		float update_pRank_list(const size_t *list,
+								const size_t *list_end,
+								const in_csr<idx_t, vertex_t> & in,
+								float damping,
+								const float *ppv_V,
+								const float *out_coef,
+								const float *rank_map1,
+								const float *scaled1,
+								float *rank_map2,
+								float *scaled2) {
+
+			float norm = 0.0;
+			for (; list != list_end; ++list) {
+				size_t v = *list;
+				float rank = pull_ranks<weighted>(in, v, rank_map1, scaled1);
+				float new_rank;
+				if (dangling) {
+					float dangling_factor = damping * rank_map1[v];
+					new_rank = damping * rank + (dangling_factor + 1.0 - damping ) * ppv_V[v];
+				} else {
+					new_rank = damping * rank + (1.0 - damping ) * ppv_V[v];
+					if (!weighted) scaled2[v] = new_rank * out_coef[v];
+				}
+				rank_map2[v] = new_rank;
+				norm += fabs(new_rank - rank_map1[v]);
+			}
+			return norm;
+		}
+
+		// Update the active vertices in [act, act_end) and the dangling
+		// vertices in [dng, dng_end)
+
+		template<bool weighted, bool has_dangling, typename idx_t, typename vertex_t>
+		float update_pRank_spec(const size_t *act, const size_t *act_end,
+								const size_t *dng, const size_t *dng_end,
+								const in_csr<idx_t, vertex_t> & in,
+								float damping,
+								const float *ppv_V,
+								const float *out_coef,
+								const float *rank_map1,
+								const float *scaled1,
+								float *rank_map2,
+								float *scaled2) {
+
+			float norm = update_pRank_list<weighted, false>(act, act_end, in, damping,
+															ppv_V, out_coef, rank_map1, scaled1, rank_map2, scaled2);
+			if (has_dangling)
+				norm += update_pRank_list<weighted, true>(dng, dng_end, in, damping,
+														  ppv_V, out_coef, rank_map1, scaled1, rank_map2, scaled2);
+			return norm;
+		}
+
+		// Scale the ranks of the active vertices by their out_coef
+
+		inline void scale_ranks(const std::vector<size_t> & active,
+								const float *out_coef,
+								const float *rank_map,
+								float *scaled) {
+			for (size_t k = 0, n = active.size(); k != n; ++k) {
+				size_t v = active[k];
+				scaled[v] = rank_map[v] * out_coef[v];
+			}
+		}
+
+		template<bool weighted, bool has_dangling, typename idx_t, typename vertex_t>
+		size_t do_pageRank_spec(const in_csr<idx_t, vertex_t> & in,
+								const float *ppv_V,
+								float *rank_map1,
+								float *rank_map2,
+								int iterations,
+								float threshold,
+								float damping,
+								const std::vector<float> & out_coef,
+								const std::vector<size_t> & active,
+								const std::vector<size_t> & dangling,
+								std::vector<float> & scaled_1,
+								std::vector<float> & scaled_2,
+								std::vector<float> & x2,
+								pm_accel *accel) {
+
+			size_t V = out_coef.size();
+			const size_t *act = active.empty() ? 0 : &active[0];
+			const size_t *act_end = act + active.size();
+			const size_t *dng = dangling.empty() ? 0 : &dangling[0];
+			const size_t *dng_end = dng + dangling.size();
+
+			float *scaled1 = 0;
+			float *scaled2 = 0;
+			if (!weighted) {
+				scaled_1.assign(V, 0.0f);
+				scaled_2.assign(V, 0.0f);
+				scaled1 = &scaled_1[0];
+				scaled2 = &scaled_2[0];
+				scale_ranks(active, &out_coef[0], rank_map1, scaled1);
+			}
+
+			size_t aitken_period = accel ? accel->aitken_period : 0;
+			if (aitken_period) x2.resize(V); // for Aitken extrapolation
+
+			// Continue iterating until the termination condition is met
+
+			bool to_map_2 = true;
+			float residual = 0.0;
+			size_t iters = 0;
+			while(iterations--) {
+				++iters;
+				// Update to the appropriate rank map
+				if (to_map_2)
+					residual = update_pRank_spec<weighted, has_dangling>(act, act_end, dng, dng_end, in, damping,
+																		 ppv_V, &out_coef[0], rank_map1, scaled1, rank_map2, scaled2);
+				else
+					residual = update_pRank_spec<weighted, has_dangling>(act, act_end, dng, dng_end, in, damping,
+																		 ppv_V, &out_coef[0], rank_map2, scaled2, rank_map1, scaled1);
+				// The next iteration will reverse the update mapping
+				to_map_2 = !to_map_2;
+				if (residual < threshold) break;
+				if (aitken_period) {
+					float *x0 = to_map_2 ? rank_map1 : rank_map2; // newest iterate
+					float *x1 = to_map_2 ? rank_map2 : rank_map1;
+					size_t phase = iters % aitken_period;
+					if (phase == aitken_period - 2) {
+						std::copy(x0, x0 + V, x2.begin());
+					} else if (phase == 0) {
+						aitken_extrapolate(&x2[0], x1, x0, V);
+						if (!weighted) scale_ranks(active, &out_coef[0], x0, to_map_2 ? scaled1 : scaled2);
+						accel->aitken_n++;
+					}
+				}
+			}
+
+			// If we stopped after writing the latest results to rank_map2,
+			// copy the results back to rank_map1 for the caller
+			if (!to_map_2) {
+				std::copy(rank_map2, rank_map2 + V, rank_map1);
+			}
+			return iters;
+		}
+
+		// Returns the number of iterations performed. active and dangling
+		// are the vertex lists of init_vertex_lists. If weighted is false,
+		// in_coef is not used (all out-edges of u have probability
+		// out_coef[u]). scaled_1, scaled_2 and x2 are scratch vectors, which
+		// are resized as needed (so that callers can reuse them).
+
+		template<typename idx_t, typename vertex_t>
+		size_t do_pageRank_coef(size_t N,
+							    const in_csr<idx_t, vertex_t> & in,
+							    const float *ppv_V,
+							    float *rank_map1,
+							    float *rank_map2,
+							    int iterations,
+							    float threshold,
+							    float damping,
+							    const std::vector<float> & out_coef,
+							    const std::vector<size_t> & active,
+							    const std::vector<size_t> & dangling,
+							    bool weighted,
+							    std::vector<float> & scaled_1,
+							    std::vector<float> & scaled_2,
+							    std::vector<float> & x2,
+							    pm_accel *accel = 0) {
+
+			if (N == 0) return 0;
+			if (iterations == 0 && threshold == 0.0)
+				throw std::runtime_error("prank error: iterations and threshold are set to zero!\n");
+			if (!iterations) iterations = std::numeric_limits<int>::max();
+
+			// Initialize rank_map1 appropriately
+			init_ranks(rank_map1, out_coef.size(), N, accel);
+
+			if (weighted) {
+				if (dangling.size())
+					return do_pageRank_spec<true, true>(in, ppv_V, rank_map1, rank_map2, iterations,
+														threshold, damping, out_coef, active, dangling,
+													scaled_1, scaled_2, x2, accel);
+				return do_pageRank_spec<true, false>(in, ppv_V, rank_map1, rank_map2, iterations,
+													 threshold, damping, out_coef, active, dangling,
+													scaled_1, scaled_2, x2, accel);
+			}
+			if (dangling.size())
+				return do_pageRank_spec<false, true>(in, ppv_V, rank_map1, rank_map2, iterations,
+													 threshold, damping, out_coef, active, dangling,
+													scaled_1, scaled_2, x2, accel);
+			return do_pageRank_spec<false, false>(in, ppv_V, rank_map1, rank_map2, iterations,
+												  threshold, damping, out_coef, active, dangling,
+													scaled_1, scaled_2, x2, accel);
+		}
+
+		/////////////////////////////////////////////////////////////////
+		// Adaptive PageRank
+		//
+		// Same equation as do_pageRank_coef, x = (1 - d) * ppv + d * M * x,
+		// computed by propagating changes (in the spirit of Kamvar,
+		// Haveliwala and Golub, 2003). Along with the ranks x we keep the
+		// residual r = (1 - d) * ppv + d * M * x - x, which is exactly the
+		// change the next power method iteration would make to x. Moving the
+		// residual of u into x[u] adds d * M(., u) * r[u] to the residuals of
+		// the out-neighbors of u, so each sweep only visits the out-edges of
+		// the vertices whose residual is at least local_tol. Vertices with a
+		// smaller residual are frozen, and keep accumulating it until it
+		// grows over local_tol.
+		//
+		// The vertices of the next sweep are collected while propagating,
+		// when their residual crosses local_tol, and the L1 norm of the
+		// residual is updated with each change. So, after the first one, the
+		// cost of a sweep depends on the active vertices and their edges,
+		// not on the size of the graph.
+		//
+		// Iterations stop when the L1 norm of the residual is below
+		// threshold, which is the termination condition of
+		// do_pageRank_coef. If no vertex reaches local_tol before that,
+		// all of them are swept.
+		//
+		// The first sweep computes the initial residual, and visits all the
+		// in-edges of the graph. The following sweeps need the out-edges
+		// (out_rowstart, out_column), and their weights (out_w, indexed as
+		// out_column).
+
+		struct adaptive_workspace {
+			std::vector<float> r;               // residuals
+			std::vector<size_t> active;         // vertices of the current sweep
+			std::vector<size_t> next;           // vertices of the next sweep
+			std::vector<float> delta;           // residuals moved in the current sweep
+			std::vector<unsigned char> queued;  // whether a vertex is in next
+		};
+
+		template<typename idx_t, typename vertex_t, typename wmap_t>
+		size_t do_pageRank_adaptive(size_t N,
+									const in_csr<idx_t, vertex_t> & in,
+									const idx_t *out_rowstart,
+									const vertex_t *out_column,
+									wmap_t out_w,
+									const float *ppv_V,
+									float *rank_map,
+									int iterations,
+									float threshold,
+									float damping,
+									float local_tol,
+									const std::vector<float> & out_coef,
+									size_t & edges,
+									adaptive_workspace & ws,
+									const pm_accel *accel = 0) {
+
+			if (N == 0) return 0;
+			if (iterations == 0 && threshold == 0.0)
+				throw std::runtime_error("prank error: iterations and threshold are set to zero!\n");
+			if (!iterations) iterations = std::numeric_limits<int>::max();
+
+			size_t V = out_coef.size();
+			std::vector<float> & r = ws.r;
+			std::vector<unsigned char> & queued = ws.queued;
+			// Initialize rank_map appropriately
+			init_ranks(rank_map, V, N, accel);
+
+			// initial residual (isolated vertices are never updated)
+			r.assign(V, 0.0f);
+			queued.assign(V, 0);
+			ws.active.clear();
+			update_pRank_coef(0, V, in, damping, ppv_V, out_coef, rank_map, &r[0]);
+			edges += in.edges();
+			double residual = 0.0;
+			for (size_t v = 0; v != V; ++v) {
+				if (-1.0 == out_coef[v]) continue;
+				r[v] -= rank_map[v];
+				residual += fabs(r[v]);
+				if (fabs(r[v]) >= local_tol) ws.active.push_back(v);
+			}
+
+			size_t iters = 1;
+			while(residual >= threshold && --iterations > 0) {
+				++iters;
+				if (ws.active.empty()) {
+					for (size_t v = 0; v != V; ++v)
+						if (r[v] != 0.0f) ws.active.push_back(v);
+				}
+				// move the residual of the active vertices to their rank
+				ws.delta.clear();
+				for (size_t k = 0, k_end = ws.active.size(); k != k_end; ++k) {
+					size_t u = ws.active[k];
+					rank_map[u] += r[u];
+					ws.delta.push_back(r[u]);
+					residual -= fabs(r[u]);
+					r[u] = 0.0f;
+					queued[u] = 0;
+				}
+				// propagate, collecting the vertices of the next sweep
+				ws.next.clear();
+				for (size_t k = 0, k_end = ws.active.size(); k != k_end; ++k) {
+					size_t u = ws.active[k];
+					if (0.0 == out_coef[u]) {
+						// dangling link
+						float old_r = r[u];
+						r[u] += damping * ws.delta[k] * ppv_V[u];
+						residual += fabs(r[u]) - fabs(old_r);
+						if (!queued[u] && fabs(r[u]) >= local_tol) {
+							queued[u] = 1;
+							ws.next.push_back(u);
+						}
+						continue;
+					}
+					float f = damping * ws.delta[k] * out_coef[u];
+					for(idx_t i = out_rowstart[u], i_end = out_rowstart[u + 1]; i != i_end; ++i) {
+						vertex_t v = out_column[i];
+						float old_r = r[v];
+						r[v] += f * out_w[i];
+						residual += fabs(r[v]) - fabs(old_r);
+						if (!queued[v] && fabs(r[v]) >= local_tol) {
+							queued[v] = 1;
+							ws.next.push_back(v);
+						}
+					}
+					edges += out_rowstart[u + 1] - out_rowstart[u];
+				}
+				ws.active.swap(ws.next);
+				if (residual < 0.0) residual = 0.0; // rounding
+			}
+			// the remaining residual is one more power method step
+			for (size_t v = 0; v != V; ++v) rank_map[v] += r[v];
+			return iters;
+		}
+
+		/////////////////////////////////////////////////////////////////
+		// Gauss-Seidel PageRank
+		//
+		// Same equation as do_pageRank_coef, but ranks are updated in place,
+		// so every vertex update already uses the new ranks of the vertices
+		// updated before it in the same sweep. It usually needs fewer sweeps
+		// to reach the threshold, and uses a single rank vector.
+		//
+		// If omega != 1, successive over-relaxation (SOR) is applied: the new
+		// rank is (1 - omega) * old_rank + omega * gauss_seidel_rank. omega
+		// must be in (0, 2).
+
+		template<typename idx_t, typename vertex_t>
+		float update_pRank_gs(size_t V,
+							  const in_csr<idx_t, vertex_t> & in,
+							  float damping,
+							  float omega,
+							  const float *ppv_V,
+							  const std::vector<float> & out_coef,
+							  float *rank_map) {
+
+			float norm = 0.0;
+			for (size_t v = 0; v != V; ++v) {
+				if (-1.0 == out_coef[v]) continue;
+				float rank = pull_ranks<true>(in, v, rank_map, static_cast<const float *>(0));
+				float old_rank = rank_map[v];
+				float dangling_factor = 0.0;
+				if (0.0 == out_coef[v]) {
+					// dangling link
+					dangling_factor = damping * old_rank;
+				}
+				float new_rank = damping * rank + (dangling_factor + 1.0 - damping ) * ppv_V[v];
+				if (omega != 1.0f)
+					new_rank = (1.0f - omega) * old_rank + omega * new_rank;
+				rank_map[v] = new_rank;
+				norm += fabs(new_rank - old_rank);
+			}
+			return norm;
+		}
+
+		// Returns the number of sweeps performed.
+
+		template<typename idx_t, typename vertex_t>
+		size_t do_pageRank_gs(size_t N,
+							  const in_csr<idx_t, vertex_t> & in,
+							  const float *ppv_V,
+							  float *rank_map,
+							  int iterations,
+							  float threshold,
+							  float damping,
+							  float omega,
+							  const std::vector<float> & out_coef,
+							  const pm_accel *accel = 0) {
+
+			if (N == 0) return 0;
+			if (iterations == 0 && threshold == 0.0)
+				throw std::runtime_error("prank error: iterations and threshold are set to zero!\n");
+			if (!iterations) iterations = std::numeric_limits<int>::max();
+
+			size_t V = out_coef.size();
+			// Initialize rank_map appropriately
+			init_ranks(rank_map, V, N, accel);
+
+			size_t iters = 0;
+			while(iterations--) {
+				++iters;
+				float residual = update_pRank_gs(V, in, damping, omega, ppv_V, out_coef, rank_map);
+				if (residual < threshold) break;
+			}
+			return iters;
+		}
+
+		/////////////////////////////////////////////////////////////////
+		// Multi-threaded PageRank
+		//
+		// The vertex range is split into consecutive chunks and every thread
+		// pulls the ranks of its own chunk (see update_pRank_spec). Threads
+		// synchronize once per iteration, after which each of them sums the
+		// per-thread residuals (always in the same order, so that all threads
+		// agree on when to stop).
+
+		//
+		// Split vertices in n_chunks consecutive chunks with (roughly) the same
+		// number of in-edges. Chunk i is [bounds[i], bounds[i+1]). Some chunks
+		// may be empty if the graph is too small.
+		//
+
+		template<typename idx_t, typename vertex_t>
+		void edge_balanced_chunks(const in_csr<idx_t, vertex_t> & in,
+								  size_t n_chunks,
+								  std::vector<size_t> & bounds) {
+
+			if (n_chunks == 0) n_chunks = 1;
+			std::vector<size_t>(n_chunks + 1, 0).swap(bounds);
+
+			size_t N = in.V;
+			// every vertex costs its in-edges plus one (the vertex update itself)
+			size_t total = 0;
+			for(size_t v = 0; v != N; ++v) {
+				total += in.degree(v) + 1;
+			}
+
+			size_t chunk = 1;
+			size_t acc = 0;
+			size_t i = 0;
+			for(size_t v = 0; v != N && chunk < n_chunks; ++v, ++i) {
+				acc += in.degree(v) + 1;
+				if (acc * n_chunks >= chunk * total) {
+					bounds[chunk++] = i + 1;
+				}
+			}
+			for(; chunk <= n_chunks; ++chunk) {
+				bounds[chunk] = N;
+			}
+		}
+
+		template<typename idx_t, typename vertex_t>
+		struct prank_mt_ctx {
+
+			const in_csr<idx_t, vertex_t> & in;
+			const float *ppv_V;
+			float *rank_map1;
+			float *rank_map2;
+			float *scaled1;               // scaled ranks (unweighted kernels)
+			float *scaled2;
+			int iterations;
+			float threshold;
+			float damping;
+			const std::vector<float> & out_coef;
+			const std::vector<size_t> & active;
+			const std::vector<size_t> & dangling;
+			bool weighted;
+			const std::vector<size_t> & bounds;
+			size_t n_threads;
+			std::vector<float> residuals; // per-thread residuals (double buffered)
+			boost::barrier sync;
+			bool to_map_2;                // parity after last iteration
+			size_t iters;                 // iterations performed
+
+			prank_mt_ctx(const in_csr<idx_t, vertex_t> & in_, const float *ppv_V_,
+						 float *rank_map1_, float *rank_map2_,
+						 float *scaled1_, float *scaled2_,
+						 int iterations_, float threshold_, float damping_,
+						 const std::vector<float> & out_coef_,
+						 const std::vector<size_t> & active_,
+						 const std::vector<size_t> & dangling_,
+						 bool weighted_,
+						 const std::vector<size_t> & bounds_)
+				: in(in_), ppv_V(ppv_V_),
+				  rank_map1(rank_map1_), rank_map2(rank_map2_),
+				  scaled1(scaled1_), scaled2(scaled2_),
+				  iterations(iterations_), threshold(threshold_), damping(damping_),
+				  out_coef(out_coef_), active(active_), dangling(dangling_), weighted(weighted_),
+				  bounds(bounds_),
+				  n_threads(bounds_.size() - 1),
+				  residuals(2 * (bounds_.size() - 1), 0.0f),
+				  sync(bounds_.size() - 1),
+				  to_map_2(true), iters(0) {}
+
+			// The part of list with vertices in [v_begin, v_end)
+
+			static void list_chunk(const std::vector<size_t> & list, size_t v_begin, size_t v_end,
+								   const size_t * & b, const size_t * & e) {
+				b = e = 0;
+				if (list.empty()) return;
+				const size_t *first = &list[0];
+				const size_t *last = first + list.size();
+				b = std::lower_bound(first, last, v_begin);
+				e = std::lower_bound(b, last, v_end);
+			}
+
+			// Main loop of thread t
+
+			void run(size_t t) {
+				if (weighted) {
+					if (dangling.size()) run_spec<true, true>(t);
+					else run_spec<true, false>(t);
+				} else {
+					if (dangling.size()) run_spec<false, true>(t);
+					else run_spec<false, false>(t);
+				}
+			}
+
+			template<bool w, bool has_dangling>
+			void run_spec(size_t t) {
+
+				const size_t *act, *act_end, *dng, *dng_end;
+				list_chunk(active, bounds[t], bounds[t + 1], act, act_end);
+				list_chunk(dangling, bounds[t], bounds[t + 1], dng, dng_end);
+				const float *oc = &out_coef[0];
+
+				bool to_map_2_t = true;
+				size_t buf = 0;
+				size_t iters_t = 0;
+				int iter = iterations;
+				while(iter--) {
+					++iters_t;
+					float r;
+					if (to_map_2_t)
+						r = update_pRank_spec<w, has_dangling>(act, act_end, dng, dng_end, in, damping,
+															   ppv_V, oc, rank_map1, scaled1, rank_map2, scaled2);
+					else
+						r = update_pRank_spec<w, has_dangling>(act, act_end, dng, dng_end, in, damping,
+															   ppv_V, oc, rank_map2, scaled2, rank_map1, scaled1);
+					residuals[buf * n_threads + t] = r;
+					to_map_2_t = !to_map_2_t;
+					sync.wait();
+					// per-thread residual reduction
+					float residual = 0.0;
+					for(size_t i = 0; i < n_threads; ++i)
+						residual += residuals[buf * n_threads + i];
+					buf ^= 1;
+					if (residual < threshold) break;
+				}
+				if (t == 0) {
+					to_map_2 = to_map_2_t;
+					iters = iters_t;
+				}
+			}
+		};
+
+		//
+		// Initialize rank and iterate using bounds.size() - 1 threads. The
+		// in-edges are given as an in_csr.
+		//
+
+		template<typename idx_t, typename vertex_t>
+		size_t do_pageRank_mt(size_t N,
+							  const in_csr<idx_t, vertex_t> & in,
+							  const float *ppv_V,
+							  float *rank_map1,
+							  float *rank_map2,
+							  int iterations,
+							  float threshold,
+							  float damping,
+							  const std::vector<float> & out_coef,
+							  const std::vector<size_t> & active,
+							  const std::vector<size_t> & dangling,
+							  bool weighted,
+							  const std::vector<size_t> & bounds,
+							  std::vector<float> & scaled_1,
+							  std::vector<float> & scaled_2,
+							  const float *init = 0) {
+
+			typedef prank_mt_ctx<idx_t, vertex_t> ctx_t;
+
+			pm_accel accel;
+			accel.init = init;
+			if (bounds.size() < 3) {
+				// just one chunk
+				std::vector<float> x2; // unused, Aitken extrapolation is off
+				return do_pageRank_coef(N, in, ppv_V, rank_map1, rank_map2, iterations, threshold, damping,
+										out_coef, active, dangling, weighted, scaled_1, scaled_2, x2, &accel);
+			}
+
+			if (N == 0) return 0;
+			if (iterations == 0 && threshold == 0.0)
+				throw std::runtime_error("prank error: iterations and threshold are set to zero!\n");
+			if (!iterations) iterations = std::numeric_limits<int>::max();
+
+			size_t V = out_coef.size();
+			// Initialize rank_map1 appropriately
+			init_ranks(rank_map1, V, N, &accel);
+
+			// scaled ranks (unweighted)
+			if (!weighted) {
+				scaled_1.assign(V, 0.0f);
+				scaled_2.assign(V, 0.0f);
+				scale_ranks(active, &out_coef[0], rank_map1, &scaled_1[0]);
+			}
+
+			ctx_t ctx(in, ppv_V, rank_map1, rank_map2,
+					  weighted ? 0 : &scaled_1[0], weighted ? 0 : &scaled_2[0],
+					  iterations, threshold, damping, out_coef, active, dangling, weighted, bounds);
+
+			boost::thread_group workers;
+			for(size_t t = 1; t < ctx.n_threads; ++t) {
+				workers.create_thread(boost::bind(&ctx_t::run, &ctx, t));
+			}
+			ctx.run(0); // calling thread takes the first chunk
+			workers.join_all();
+
+			// If we stopped after writing the latest results to rank_map2,
+			// copy the results back to rank_map1 for the caller
+			if (!ctx.to_map_2) {
+				std::copy(rank_map2, rank_map2 + V, rank_map1);
+			}
+			return ctx.iters;
+		}
+
+
+		/////////////////////////////////////////////////////////////////
+		// Batched PageRank
+		//
+		// Compute K personalized PageRank vectors at once. Personalization and
+		// rank vectors are interleaved (N x K layout), i.e., the value of vertex
+		// v for the k-th vector is at position v * K + k. This way, every in-edge
+		// is loaded just once per iteration for all K vectors.
+		//
+		// Every vector has its own residual, and it is frozen (not updated
+		// anymore) as soon as it converges, so the result is the same as
+		// running do_pageRank_coef over each vector independently. The graph is
+		// given as an in_csr.
+		//
+		// The rank vectors are always stored and accumulated in float. The
+		// ranks pulled through the in-edges (the random, bandwidth-bound reads)
+		// can be read instead from a bfloat16 copy of the previous iterates,
+		// which halves their memory traffic. Only those reads are rounded, so
+		// each iteration is perturbed by a relative error of at most 2^-9, and
+		// the result stays within damping/(1-damping) times that error of the
+		// float one.
+
+		// Scratch vectors of do_pageRank_batch. They are sized on first use
+		// and reused afterwards.
+
+		struct batch_workspace {
+			std::vector<float> rank;        // ranks pulled into a vertex
+			std::vector<float> norm;        // residuals of the current sweep
+			std::vector<float> prev_norm;   // residuals of the previous sweep
+			std::vector<float> x2;          // Aitken extrapolation
+			std::vector<char> active;       // vectors not converged yet
+			std::vector<char> in_map_2;     // where the latest results of each vector are
+		};
+
+		// Add to rank the K ranks pulled through [i, i_end) of column
+
+		template<typename idx_t, typename vertex_t, typename pull_t>
+		inline void pull_ranks_batch(idx_t i, idx_t i_end, idx_t pf_end,
+									 const vertex_t *column,
+									 const float *coef,
+									 size_t K,
+									 const pull_t *rank_map,
+									 float *rank) {
+			for(idx_t i_pf = prefetch_end(i, i_end, pf_end); i != i_pf; ++i) {
+				UKB_PREFETCH(rank_map + column[i + prefetch_distance] * K);
+				const float c = coef[i];
+				const pull_t *r1 = rank_map + column[i] * K;
+				for(size_t k = 0; k < K; ++k)
+					rank[k] += r1[k] * c;
+			}
+			for(; i != i_end; ++i) {
+				const float c = coef[i];
+				const pull_t *r1 = rank_map + column[i] * K;
+				for(size_t k = 0; k < K; ++k)
+					rank[k] += r1[k] * c;
+			}
+		}
+
+		// One iteration: pull the previous ranks from pulled, and write the new
+		// ranks of rank_map1 to rank_map2. Both may be the same vector (in-place
+		// update), as long as pulled is a copy of the previous ranks. rank is
+		// scratch space for K values.
+
+		template<typename idx_t, typename vertex_t, typename pull_t>
+		void update_pRank_batch(size_t V,
+								const in_csr<idx_t, vertex_t> & in,
+								size_t K,
+								float damping,
+								const float *ppv_V,
+								const std::vector<float> & out_coef,
+								const pull_t *pulled,
+								const float *rank_map1,
+								float *rank_map2,
+								const std::vector<char> & active,
+								std::vector<float> & norm,
+								float *rank) {
+
+			for (size_t v = 0; v != V; ++v) {
+				if (-1.0 == out_coef[v]) continue;
+				std::fill(rank, rank + K, 0.0f);
+				pull_ranks_batch(in.rowstart[v], in.sym_end[v], in.rowstart[V],
+								 in.column, in.coef, K, pulled, rank);
+				pull_ranks_batch(in.ovl_rowstart[v], in.ovl_rowstart[v + 1], in.ovl_rowstart[V],
+								 in.ovl_column, in.ovl_coef, K, pulled, rank);
+				const bool dangling = (0.0 == out_coef[v]);
+				const float *r1 = rank_map1 + v * K;
+				const float *pv = ppv_V + v * K;
+				float *r2 = rank_map2 + v * K;
+				for(size_t k = 0; k < K; ++k) {
+					if (!active[k]) continue;
+					float r1_k = r1[k];
+					float dangling_factor = dangling ? damping * r1_k : 0.0f;
+					r2[k] = damping * rank[k] + (dangling_factor + 1.0 - damping ) * pv[k];
+					norm[k] += fabs(r2[k] - r1_k);
+				}
+			}
+		}
+
+		// Returns the number of iterations performed, summed over all vectors.
+		//
+		// If pulled is not NULL (a vector of N * K values, usually bfloat16),
+		// rank_map2 is not used: rank_map1 is updated in place, and pulled
+		// keeps the lower precision copy of its previous values that is read
+		// through the in-edges. The rounding of those reads sets a floor to
+		// the residual, so these vectors also stop when their residual does
+		// not decrease anymore. Aitken extrapolation is not applied to them.
+		//
+		// The residuals and the other per-vector state are kept in ws.
+
+		template<typename idx_t, typename vertex_t, typename pull_t>
+		size_t do_pageRank_batch(size_t N,
+							     size_t K,
+							     const in_csr<idx_t, vertex_t> & in,
+							     const float *ppv_V,
+							     float *rank_map1,
+							     float *rank_map2,
+							     pull_t *pulled,
+							     int iterations,
+							     float threshold,
+							     float damping,
+							     const std::vector<float> & out_coef,
+							     batch_workspace & ws,
+							     pm_accel *accel = 0) {
+
+			if (N == 0 || K == 0) return 0;
+			if (iterations == 0 && threshold == 0.0)
+				throw std::runtime_error("prank error: iterations and threshold are set to zero!\n");
+			if (!iterations) iterations = std::numeric_limits<int>::max();
+
+			size_t V = out_coef.size();
+			size_t NK = V * K;
+
+			// Initialize rank_map1 appropriately. All vectors start from the
+			// same initial ranks.
+			if (accel && accel->init) {
+				for(size_t v = 0; v < V; ++v)
+					std::fill(rank_map1 + v * K, rank_map1 + (v + 1) * K, accel->init[v]);
+			} else {
+				std::fill(rank_map1, rank_map1 + NK, 1.0f/static_cast<float>(N));
+			}
+			if (pulled) std::copy(rank_map1, rank_map1 + NK, pulled);
+
+			size_t aitken_period = (accel && !pulled) ? accel->aitken_period : 0;
+			std::vector<float> & x2 = ws.x2;
+			if (aitken_period) x2.resize(NK);
+
+			std::vector<char> & active = ws.active;
+			std::vector<char> & in_map_2 = ws.in_map_2;
+			std::vector<float> & norm = ws.norm;
+			std::vector<float> & prev_norm = ws.prev_norm;
+			active.assign(K, 1);
+			in_map_2.assign(K, 0);
+			norm.resize(K);
+			prev_norm.assign(K, std::numeric_limits<float>::max());
+			ws.rank.resize(K);
+			float *rank = &ws.rank[0];
+			size_t active_n = K;
+
+			bool to_map_2 = true;
+			size_t iters = 0;
+			size_t sweeps = 0;
+			while(iterations-- && active_n) {
+				iters += active_n;
+				++sweeps;
+				std::fill(norm.begin(), norm.end(), 0.0f);
+				if (pulled) {
+					update_pRank_batch(V, in, K, damping, ppv_V, out_coef, pulled, rank_map1, rank_map1, active, norm, rank);
+				} else if (to_map_2) {
+					update_pRank_batch(V, in, K, damping, ppv_V, out_coef, rank_map1, rank_map1, rank_map2, active, norm, rank);
+				} else {
+					update_pRank_batch(V, in, K, damping, ppv_V, out_coef, rank_map2, rank_map2, rank_map1, active, norm, rank);
+				}
+				for(size_t k = 0; k < K; ++k) {
+					if (!active[k]) continue;
+					in_map_2[k] = to_map_2 && !pulled;
+					if (norm[k] < threshold || (pulled && norm[k] >= prev_norm[k])) {
+						active[k] = 0;
+						--active_n;
+					}
+					prev_norm[k] = norm[k];
+				}
+				if (pulled) {
+					if (active_n == K) {
+						std::copy(rank_map1, rank_map1 + NK, pulled);
+					} else if (active_n) {
+						for(size_t k = 0; k < K; ++k) {
+							if (!active[k]) continue;
+							for(size_t i = k; i < NK; i += K)
+								pulled[i] = rank_map1[i];
+						}
+					}
+					continue;
+				}
+				to_map_2 = !to_map_2;
+				if (aitken_period && active_n) {
+					float *x0 = to_map_2 ? rank_map1 : rank_map2; // newest iterates
+					float *x1 = to_map_2 ? rank_map2 : rank_map1;
+					size_t phase = sweeps % aitken_period;
+					if (phase == aitken_period - 2) {
+						std::copy(x0, x0 + NK, x2.begin());
+					} else if (phase == 0) {
+						for(size_t k = 0; k < K; ++k) {
+							if (!active[k]) continue;
+							aitken_extrapolate(&x2[k], x1 + k, x0 + k, V, K);
+							accel->aitken_n++;
+						}
+					}
+				}
+			}
+
+			// copy the results written to rank_map2 back to rank_map1
+			for(size_t k = 0; k < K; ++k) {
+				if (!in_map_2[k]) continue;
+				for(size_t i = k; i < NK; i += K)
+					rank_map1[i] = rank_map2[i];
+			}
+			return iters;
+		}
 
 		/////////////////////////////////////////////////////////////////
 		// PageRank iteration
@@ -404,6 +1460,204 @@ namespace ukb {
 
 		}
 
+		/////////////////////////////////////////////////////////////////
+		// Sparse forward push
+		//
+		// Same algorithm as pageRank_nibble_lazy, but the residual (r) and
+		// estimate (p) vectors live in a reusable workspace, so that the cost
+		// of computing a PPV depends on the vertices reached by the pushes,
+		// not on the size of the graph. Both the personalization vector and
+		// the result are sparse.
+		//
+		// The dense vector of the workspace is lazily reset: the values of a
+		// vertex are valid only if its stamp equals the current epoch. The
+		// vertices touched in the current run are kept in a list.
+
+		template<typename vertex_t>
+		struct push_workspace {
+
+			// values of a vertex (kept together for locality)
+			struct slot_t {
+				unsigned int stamp;
+				float r;
+				float p;
+				unsigned int in_q;
+			};
+
+			std::vector<slot_t> slot;
+			std::vector<vertex_t> touched;
+			std::vector<vertex_t> Q;
+			unsigned int epoch;
+
+			push_workspace() : epoch(0) {}
+
+			// Start a new run over a graph with N vertices
+
+			void reset(size_t N) {
+				if (slot.size() != N || ++epoch == 0) {
+					slot_t zero = {0, 0.0f, 0.0f, 0};
+					std::vector<slot_t>(N, zero).swap(slot);
+					epoch = 1;
+				}
+				touched.clear();
+				Q.clear();
+			}
+
+			slot_t & touch(vertex_t u) {
+				slot_t & s = slot[u];
+				if (s.stamp != epoch) {
+					s.stamp = epoch;
+					s.r = 0.0f;
+					s.p = 0.0f;
+					s.in_q = 0;
+					touched.push_back(u);
+				}
+				return s;
+			}
+		};
+
+		//
+		// ppv has (vertex, value) pairs sorted by vertex, with no repeated
+		// vertices. On output, p has the (vertex, rank) pairs of all vertices
+		// with non-zero rank, also sorted by vertex. The graph has N vertices
+		// and its out-edges are in the CSR arrays rowstart/column.
+		//
+
+		template<typename idx_t, typename vertex_t>
+		void pageRank_push(size_t N,
+						   const idx_t *rowstart,
+						   const vertex_t *column,
+						   const std::vector<std::pair<vertex_t, float> > & ppv,
+						   const std::vector<float> & out_coefs,
+						   float damping,
+						   float epsilon,
+						   push_workspace<vertex_t> & ws,
+						   std::vector<std::pair<vertex_t, float> > & p) {
+
+			typedef typename push_workspace<vertex_t>::slot_t slot_t;
+
+			ws.reset(N);
+			for(size_t i = 0, m = ppv.size(); i != m; ++i) {
+				vertex_t u = ppv[i].first;
+				slot_t & su = ws.touch(u);
+				su.r = ppv[i].second;
+				if (su.r * out_coefs[u] >= epsilon) {
+					su.in_q = 1; ws.Q.push_back(u);
+				}
+			}
+			size_t head = 0;
+			while(head != ws.Q.size()) {
+				vertex_t u = ws.Q[head++];
+				slot_t & su = ws.slot[u];
+				su.in_q = 0;
+				do {
+					// Push
+					float pushVal = su.r - 0.5 * epsilon;
+					float putVal = damping * (su.r - 0.5 * epsilon) * out_coefs[u];
+					su.p += (1.0 - damping) * pushVal;
+					su.r = 0.5 * epsilon;
+					for(idx_t i = rowstart[u], end = rowstart[u + 1]; i != end; ++i) {
+						vertex_t v = column[i];
+						slot_t & sv = ws.touch(v);
+						sv.r += putVal;
+						if (sv.r * out_coefs[v] >= epsilon && !sv.in_q) {
+							sv.in_q = 1; ws.Q.push_back(v);
+						}
+					}
+				} while(su.r * out_coefs[u] >= epsilon);
+			}
+
+			p.clear();
+			if (ws.touched.size() > N / 16) {
+				// many vertices touched: scanning them all is cheaper than sorting
+				for(size_t u = 0; u != N; ++u) {
+					const slot_t & su = ws.slot[u];
+					if (su.stamp == ws.epoch && su.p != 0.0f) p.push_back(std::make_pair(u, su.p));
+				}
+			} else {
+				std::sort(ws.touched.begin(), ws.touched.end());
+				for(size_t i = 0, m = ws.touched.size(); i != m; ++i) {
+					vertex_t u = ws.touched[i];
+					const slot_t & su = ws.slot[u];
+					if (su.p != 0.0f) p.push_back(std::make_pair(u, su.p));
+				}
+			}
+		}
+
+		/////////////////////////////////////////////////////////////////////////
+		// Monte-Carlo PageRank from random walk fingerprints (Fogaras et al.,
+		// 2005)
+		//
+		// A fingerprint of vertex u is the endpoint of a random walk that
+		// starts at u and, at each step, stops with probability (1 - damping)
+		// or else follows a random out-edge (proportionally to its weight if w
+		// is not NULL). Walks reaching a dangling vertex restart at u, and
+		// walks longer than max_len stop where they are. The endpoints of R
+		// such walks, stored at endpoints[u * R ... u * R + R - 1], are an
+		// unbiased sample of the PPV of u.
+		//
+
+		template<typename idx_t, typename vertex_t, typename fp_t, typename Rng>
+		void fingerprint_walks(size_t N,
+							   const idx_t *rowstart,
+							   const vertex_t *column,
+							   const float *w,
+							   float damping,
+							   size_t R,
+							   size_t max_len,
+							   Rng & rng,
+							   fp_t *endpoints) {
+
+			boost::random::uniform_01<float> U;
+			for(size_t u = 0; u != N; ++u) {
+				for(size_t k = 0; k != R; ++k) {
+					size_t v = u;
+					for(size_t len = 0; len != max_len && U(rng) < damping; ++len) {
+						idx_t e = rowstart[v], e_end = rowstart[v + 1];
+						if (e == e_end) {
+							v = u;
+							continue;
+						}
+						if (w) {
+							float total = 0.0f;
+							for(idx_t i = e; i != e_end; ++i) total += w[i];
+							float x = U(rng) * total;
+							for(--e_end; e != e_end && x >= w[e]; ++e) x -= w[e];
+						} else {
+							e += static_cast<idx_t>(U(rng) * (e_end - e));
+							if (e == e_end) --e;
+						}
+						v = column[e];
+					}
+					endpoints[u * R + k] = static_cast<fp_t>(v);
+				}
+			}
+		}
+
+		//
+		// Estimate the PPV of a sparse personalization vector (sorted
+		// (vertex, value) pairs) by adding value / R to the rank of each
+		// fingerprint of its vertices. The cost is proportional to the size
+		// of ppv times R. On output, p has (vertex, rank) pairs, unsorted and
+		// possibly with repeated vertices.
+		//
+
+		template<typename vertex_t, typename fp_t>
+		void pageRank_mc(const std::vector<std::pair<vertex_t, float> > & ppv,
+						 const fp_t *endpoints,
+						 size_t R,
+						 std::vector<std::pair<vertex_t, float> > & p) {
+
+			p.clear();
+			p.reserve(ppv.size() * R);
+			for(size_t i = 0, m = ppv.size(); i != m; ++i) {
+				const fp_t *fp = endpoints + ppv[i].first * R;
+				float val = ppv[i].second / static_cast<float>(R);
+				for(size_t k = 0; k != R; ++k)
+					p.push_back(std::make_pair(static_cast<vertex_t>(fp[k]), val));
+			}
+		}
+
 		/////////////////////////////////////////////////////////////////////////
 
 		template<typename G, typename coefmap_t>
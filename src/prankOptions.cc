@@ -0,0 +1,160 @@
+#include "prankOptions.h"
+#include "common.h"
+#include "globalVars.h"
+
+#include <string>
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+
+namespace ukb {
+
+	using namespace std;
+	using namespace boost::program_options;
+	using boost::lexical_cast;
+
+	void add_input_options(options_description & od) {
+		od.add_options()
+			("nopos", "Don't filter words by Part of Speech.")
+			("minput", "Do not die when dealing with malformed input.")
+			("ctx_noweight", "Do not use weights of input words (defaut is use context weights).")
+			;
+	}
+
+	void set_input_options(const variables_map & vm) {
+
+		if (vm.count("nopos")) {
+			glVars::input::filter_pos = false;
+		}
+
+		if (vm.count("minput")) {
+			glVars::input::swallow = true;
+		}
+
+		if (vm.count("ctx_noweight")) {
+			glVars::input::weight = false;
+		}
+	}
+
+	void add_prank_options(options_description & od) {
+		od.add_options()
+			("prank_nibble", "Use PageRank approximation (PageRank-nibble). See also nibble_epsilon.")
+			("prank_gs", "Use Gauss-Seidel for computing PageRank. See also prank_sor.")
+			("prank_sor", value<float>(), "Use Gauss-Seidel with successive over-relaxation, with the given relaxation factor (between 0 and 2).")
+			("prank_adaptive", "Use adaptive PageRank, which stops updating the vertices that have converged. See also prank_adaptive_tol.")
+			("prank_adaptive_tol", value<float>(), "Vertices changing less than this are frozen by adaptive PageRank. Default is the threshold divided by the number of vertices.")
+			("prank_mc", "Use Monte-Carlo PageRank approximation from random walk fingerprints (see compile_kb --fingerprints and fp_file). Ranks are estimates whose L1 error falls as 1/sqrt(R), for R fingerprints per vertex (about 0.3 with R = 1024 and 0.08 with R = 16384 on small KBs). Senses with closer ranks than that often swap, so the chosen sense differs from --ppr for many words, even with large R.")
+			("ppv_cache", value<string>(), "File of precomputed PPVs (see compile_kb --ppv_cache). The PPVs of contexts are composed from them when possible. Composed PPVs are approximate (stored PPVs are truncated, see compile_kb --ppv_topk), and close ranks may swap; -v reports their L1 error bound.")
+			("fp_file", value<string>(), "Fingerprint file for prank_mc. Default is the KB binfile name plus \".fp\". Required with --kb_shm.")
+			("prank_init", value<string>(), "Initial vector of PageRank iterations: uniform (default), prev (previous result) or static (static PageRank).")
+			("prank_aitken", value<size_t>(), "Apply Aitken extrapolation every given number of power method iterations (at least 3). Default is no extrapolation.")
+			("prank_weight,w", "Use weights in pageRank calculation. Serialized graph edges must have some weight.")
+			("prank_iter", value<size_t>(), "Number of iterations in pageRank. Default is 30.")
+			("prank_threshold", value<float>(), "Threshold for stopping PageRank. Default is 0.0001.")
+			("prank_damping", value<float>(), "Set damping factor in PageRank equation. Default is 0.85.")
+			("prank_threads", value<size_t>(), "Number of threads for computing PageRank with the power method. Default is 1.")
+			("prank_batch", value<size_t>(), "Number of PageRank vectors computed at once (with --ppr and --ppr_w2w in ukb_wsd). Default is 8.")
+			("prank_bf16", "In batched PageRank, read the ranks pulled through in-edges from a 16 bit bfloat16 copy, halving their memory traffic. Ranks are accumulated and returned as floats, within a relative error of about 1% of --prank_batch alone. No Aitken extrapolation.")
+			("nibble_epsilon", value<float>(), "Error for approximate pageRank as computed by the nibble algorithm.")
+			;
+	}
+
+	void set_prank_options(const variables_map & vm) {
+
+		if (vm.count("prank_weight")) {
+			glVars::prank::use_weight = true;
+		}
+
+		if (vm.count("prank_iter") || vm.count("prank_threshold")) {
+			size_t iterations = vm.count("prank_iter") ? vm["prank_iter"].as<size_t>() : 0;
+			float thresh = vm.count("prank_threshold") ? vm["prank_threshold"].as<float>() : 0.0f;
+			set_pr_convergence(iterations, thresh);
+		}
+
+		if (vm.count("prank_damping")) {
+			float dp = vm["prank_damping"].as<float>();
+			if (dp <= 0.0 || dp > 1.0)
+				throw runtime_error("Error: invalid prank_damping value " + lexical_cast<string>(dp));
+			glVars::prank::damping = dp;
+		}
+
+		if (vm.count("prank_threads")) {
+			size_t nt = vm["prank_threads"].as<size_t>();
+			if (nt == 0)
+				throw runtime_error("Error: invalid prank_threads value of zero");
+			glVars::prank::num_threads = nt;
+		}
+
+		if (vm.count("prank_batch")) {
+			size_t bs = vm["prank_batch"].as<size_t>();
+			if (bs == 0)
+				throw runtime_error("Error: invalid prank_batch value of zero");
+			glVars::prank::batch_size = bs;
+		}
+
+		if (vm.count("prank_nibble")) {
+			glVars::prank::impl = glVars::nibble;
+		}
+
+		if (vm.count("prank_gs")) {
+			glVars::prank::impl = glVars::gs;
+		}
+
+		if (vm.count("prank_sor")) {
+			float omega = vm["prank_sor"].as<float>();
+			if (omega <= 0.0 || omega >= 2.0)
+				throw runtime_error("Error: invalid prank_sor value " + lexical_cast<string>(omega));
+			glVars::prank::impl = glVars::gs;
+			glVars::prank::sor_omega = omega;
+		}
+
+		if (vm.count("prank_adaptive")) {
+			glVars::prank::impl = glVars::adaptive;
+		}
+
+		if (vm.count("prank_adaptive_tol")) {
+			float tol = vm["prank_adaptive_tol"].as<float>();
+			if (tol <= 0.0)
+				throw runtime_error("Error: invalid prank_adaptive_tol value " + lexical_cast<string>(tol));
+			glVars::prank::impl = glVars::adaptive;
+			glVars::prank::adaptive_tol = tol;
+		}
+
+		if (vm.count("prank_mc")) {
+			glVars::prank::impl = glVars::mc;
+		}
+
+		if (vm.count("fp_file")) {
+			glVars::prank::fp_fname = vm["fp_file"].as<string>();
+		}
+
+		if (vm.count("prank_bf16")) {
+			glVars::prank::bf16_ranks = true;
+		}
+
+		if (vm.count("ppv_cache")) {
+			glVars::prank::ppv_cache_fname = vm["ppv_cache"].as<string>();
+		}
+
+		if (vm.count("prank_init")) {
+			string init = vm["prank_init"].as<string>();
+			if (init == "uniform") glVars::prank::init = glVars::init_uniform;
+			else if (init == "prev") glVars::prank::init = glVars::init_prev;
+			else if (init == "static") glVars::prank::init = glVars::init_static;
+			else throw runtime_error("Error: invalid prank_init value " + init);
+		}
+
+		if (vm.count("prank_aitken")) {
+			size_t period = vm["prank_aitken"].as<size_t>();
+			if (period < 3)
+				throw runtime_error("Error: prank_aitken must be at least 3");
+			glVars::prank::aitken_period = period;
+		}
+
+		if (vm.count("nibble_epsilon")) {
+			float dp = vm["nibble_epsilon"].as<float>();
+			if (dp <= 0.0 || dp > 1.0)
+				throw runtime_error("Error: invalid nibble_epsilon value " + lexical_cast<string>(dp));
+			glVars::prank::nibble_epsilon = dp;
+		}
+	}
+}
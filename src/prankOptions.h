@@ -0,0 +1,26 @@
+// -*-C++-*-
+
+#ifndef PRANKOPTIONS_H
+#define PRANKOPTIONS_H
+
+#include <boost/program_options.hpp>
+
+// Command line options shared by ukb_wsd and ukb_ppv: how input contexts are
+// read, and how PageRank is computed. Each program adds them to its own
+// option groups, and sets the global variables from the parsed values.
+
+namespace ukb {
+
+	// Input options (glVars::input)
+
+	void add_input_options(boost::program_options::options_description & od);
+	void set_input_options(const boost::program_options::variables_map & vm);
+
+	// PageRank options (glVars::prank). set_prank_options throws
+	// runtime_error if any value is invalid.
+
+	void add_prank_options(boost::program_options::options_description & od);
+	void set_prank_options(const boost::program_options::variables_map & vm);
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "textScan.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <climits>
+
+namespace ukb {
+
+	using namespace std;
+
+	const size_t text_ref::npos;
+
+	size_t text_ref::rfind(char c) const {
+		for(const char *p = e; p != b; --p)
+			if (*(p - 1) == c) return p - 1 - b;
+		return npos;
+	}
+
+	static bool is_blank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	text_ref trim_blanks(text_ref s) {
+		while(s.b != s.e && is_blank(*s.b)) ++s.b;
+		while(s.b != s.e && is_blank(*(s.e - 1))) --s.e;
+		return s;
+	}
+
+	bool text_fields::is_delim(char c) const {
+		return c != '\0' && strchr(m_delims, c) != 0;
+	}
+
+	bool text_fields::next(text_ref & field) {
+		if (!m_keep_empty) {
+			while(m_p != m_e && is_delim(*m_p)) ++m_p;
+			if (m_p == m_e) return false;
+			const char *b = m_p;
+			while(m_p != m_e && !is_delim(*m_p)) ++m_p;
+			field = text_ref(b, m_p);
+			return true;
+		}
+		if (m_done) return false;
+		const char *b = m_p;
+		while(m_p != m_e && !is_delim(*m_p)) ++m_p;
+		field = text_ref(b, m_p);
+		if (m_p == m_e) m_done = true;
+		else ++m_p;
+		return true;
+	}
+
+	// Exponents, infinities, NaNs and long mantissas, through strtof, as
+	// lexical_cast does. It fails on overflow, but not on underflow.
+
+	static bool parse_float_strtof(text_ref s, float & f) {
+
+		if (s.empty() || is_blank(s[0]) || s[0] == '\n') return false;
+		for(const char *p = s.b; p != s.e; ++p)
+			if (*p == 'x' || *p == 'X') return false; // no hexadecimal floats
+		char buf[64];
+		string big;
+		const char *str = buf;
+		if (s.size() < sizeof(buf)) {
+			memcpy(buf, s.b, s.size());
+			buf[s.size()] = '\0';
+		} else {
+			s.assign_to(big);
+			str = big.c_str();
+		}
+		char *end;
+		errno = 0;
+		float v = strtof(str, &end);
+		if (end != str + s.size()) return false;
+		if (errno == ERANGE && (v == HUGE_VALF || v == -HUGE_VALF)) return false;
+		f = v;
+		return true;
+	}
+
+	bool parse_float(text_ref s, float & f) {
+
+		// Decimal numbers with a mantissa of at most 2^24 and at most 10
+		// decimals. Both the mantissa and the power of ten are exact
+		// floats, so the division is correctly rounded, as strtof.
+		static const float pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+									   1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+		static const unsigned long max_m = 1ul << 24;
+
+		const char *p = s.b;
+		bool neg = false;
+		if (p != s.e && (*p == '+' || *p == '-')) {
+			neg = *p == '-';
+			++p;
+		}
+		unsigned long m = 0;
+		size_t digits = 0;
+		int frac = -1;
+		for(; p != s.e; ++p) {
+			char c = *p;
+			if (c >= '0' && c <= '9') {
+				unsigned long d = c - '0';
+				if (m > (max_m - d) / 10 || frac >= 10) break;
+				m = m * 10 + d;
+				++digits;
+				if (frac >= 0) ++frac;
+			} else if (c == '.' && frac < 0) {
+				frac = 0;
+			} else {
+				break;
+			}
+		}
+		if (p != s.e || !digits) return parse_float_strtof(s, f);
+		float v = static_cast<float>(m);
+		if (frac > 0) v /= pow10[frac];
+		f = neg ? -v : v;
+		return true;
+	}
+
+	bool parse_int(text_ref s, int & i) {
+
+		const char *p = s.b;
+		bool neg = false;
+		if (p != s.e && (*p == '+' || *p == '-')) {
+			neg = *p == '-';
+			++p;
+		}
+		if (p == s.e) return false;
+		unsigned long max_v = neg ? static_cast<unsigned long>(INT_MAX) + 1 : INT_MAX;
+		unsigned long v = 0;
+		for(; p != s.e; ++p) {
+			if (*p < '0' || *p > '9') return false;
+			unsigned long d = *p - '0';
+			if (v > (max_v - d) / 10) return false;
+			v = v * 10 + d;
+		}
+		i = neg ? static_cast<int>(-static_cast<long>(v)) : static_cast<int>(v);
+		return true;
+	}
+
+	bool parse_bool(text_ref s, bool & b) {
+		int i;
+		if (!parse_int(s, i) || (i != 0 && i != 1)) return false;
+		b = i == 1;
+		return true;
+	}
+}
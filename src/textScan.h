@@ -0,0 +1,84 @@
+// -*-C++-*-
+
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <string>
+#include <cstddef>
+
+// Scanning of input text lines (KB relations, dictionary entries and
+// contexts) without allocating memory.
+//
+// A text_ref points to chars of a line, which must outlive it. Fields are
+// split in place, and numbers are parsed from them directly. The number
+// parsers accept the same strings as boost::lexical_cast, and give the
+// same values.
+
+namespace ukb {
+
+	struct text_ref {
+		const char *b;
+		const char *e;
+
+		static const size_t npos = static_cast<size_t>(-1);
+
+		text_ref() : b(0), e(0) {}
+		text_ref(const char *b_, const char *e_) : b(b_), e(e_) {}
+		text_ref(const std::string & s) : b(s.data()), e(s.data() + s.size()) {}
+
+		size_t size() const { return e - b; }
+		bool empty() const { return b == e; }
+		char operator[](size_t i) const { return b[i]; }
+
+		text_ref substr(size_t pos, size_t n = npos) const {
+			const char *p = b + pos;
+			return text_ref(p, (n == npos || n > size_t(e - p)) ? e : p + n);
+		}
+
+		// Position of the last c, or npos
+		size_t rfind(char c) const;
+
+		std::string str() const { return std::string(b, e); }
+
+		// Copy to s, reusing its memory
+		void assign_to(std::string & s) const { s.assign(b, e); }
+	};
+
+	// s without leading and trailing blanks (spaces, tabs and '\r')
+
+	text_ref trim_blanks(text_ref s);
+
+	// Fields of a line, separated by any of the chars of delims, as with
+	// boost::char_separator. Empty fields are skipped, unless keep_empty.
+
+	class text_fields {
+
+	public:
+
+		text_fields(text_ref line, const char *delims, bool keep_empty = false)
+			: m_p(line.b), m_e(line.e), m_delims(delims), m_keep_empty(keep_empty),
+			  m_done(line.empty()) {}
+
+		// Next field, if any
+		bool next(text_ref & field);
+
+	private:
+		bool is_delim(char c) const;
+
+		const char *m_p;
+		const char *m_e;
+		const char *m_delims;
+		bool m_keep_empty;
+		bool m_done;
+	};
+
+	// Numbers. They return false if s is not a number of the type, and
+	// lexical_cast would throw. parse_bool accepts integers equal to 0 or
+	// 1.
+
+	bool parse_float(text_ref s, float & f);
+	bool parse_int(text_ref s, int & i);
+	bool parse_bool(text_ref s, bool & b);
+}
+
+#endif
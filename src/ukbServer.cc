@@ -6,6 +6,7 @@
 #include <syslog.h>
 #include <unistd.h>
 #include <boost/asio/signal_set.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace ukb {
 
@@ -222,15 +223,20 @@ namespace ukb {
 
   void sServer::handle_accept(sSession *new_session,
 							  const boost::system::error_code& error) {
-	bool status = true;
-	if (!error) {
-	  status = new_session->start(); // false means finish
+	if (error) {
+	  delete new_session;
+	} else {
+	  boost::thread session_thread(boost::bind(&sServer::run_session, this, new_session));
+	  session_thread.detach();
 	}
-	delete new_session;
+	start_accept();
+  }
+
+  void sServer::run_session(sSession *session) {
+	bool status = session->start(); // false means finish
+	delete session;
 	if (!status)
 	  m_io.stop();
-	else
-	  start_accept();
   }
 
   //////////////////////////////////////////////////////////////
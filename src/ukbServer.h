@@ -97,7 +97,13 @@ namespace ukb {
   };
 
   // Server main class. Accept connections asyncronously, create a session and
-  // launch it.
+  // launch it in its own thread, so that many clients are served at once.
+  // Session callbacks must therefore be thread-safe.
+  //
+  // The number of sessions is not capped: every open connection keeps its
+  // (detached) thread, and whatever memory its callback holds, until the
+  // client closes it. The server is meant for a few trusted clients; put
+  // it behind a proxy that limits connections otherwise.
 
   class sServer {
 
@@ -109,6 +115,7 @@ namespace ukb {
 	void start_accept();
 	void handle_accept(sSession *new_session,
 					   const boost::system::error_code& error);
+	void run_session(sSession *session);
 
 	// Connection stuff
 	boost::asio::io_service & m_io; //main asio object
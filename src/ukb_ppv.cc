@@ -6,9 +6,11 @@
 #include "disambGraph.h"
 #include "wdict.h"
 #include "ukbServer.h"
+#include "prankOptions.h"
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <syslog.h>
 
 // Program options
@@ -122,12 +124,11 @@ static void post_process_ranks(vector<float> & theranks) {
 			// For top k calculation
 			//
 			//  - fill with zeros all values except top k
-			//  - set opt_nozero = 1 so only top k are printed
+			//  - opt_nozero is set, so only top k are printed
 			//
 			// * could be a problem if top k had zeros in it, as they
 			//   will not be properly printed.
 			top_k(theranks, lexical_cast<size_t>(trunc_ppv));
-			opt_nozero = true;
 		}
 	}
 }
@@ -153,6 +154,41 @@ static void write_ppv_stream(vector<float> & ranks, ostream & os) {
 	}
 }
 
+// write a sparse rank vector to an ostream. Vertices not in ranks have zero
+// rank.
+
+static void write_ppv_line(Kb_vertex_t u, float rank, ostream & os) {
+	string sname = Kb::instance().get_vertex_name(u);
+	os << sname << "\t" << rank;
+	if (output_variants_ppv) {
+		os << "\t" << WDict::instance().variant(sname);
+	}
+	os << "\n";
+}
+
+static void write_ppv_stream(const Kb_sparse_vector & ranks, ostream & os) {
+
+	if (output_control_line)
+		os << cmdline << "\n";
+	Kb_sparse_vector::const_iterator it = ranks.begin();
+	Kb_sparse_vector::const_iterator end = ranks.end();
+	if (opt_nozero) {
+		for(; it != end; ++it) {
+			if (it->second == 0.0) continue;
+			write_ppv_line(it->first, it->second, os);
+		}
+		return;
+	}
+	for(size_t i = 0, m = ranks.size(); i < m; ++i) {
+		float r = 0.0;
+		if (it != end && it->first == i) {
+			r = it->second;
+			++it;
+		}
+		write_ppv_line(i, r, os);
+	}
+}
+
 static void write_ppv_stream(const vector<float> & outranks, ostream & os) {
 	vector<float> newranks(outranks);
 	write_ppv_stream(newranks, os);
@@ -183,19 +219,57 @@ static void maybe_postproc_ranks(vector<float> & ranks) {
 
 // Compute ppv given a CSentence
 
-bool compute_cs_ppv(CSentence & cs, vector<float> & ranks) {
-	if (!calculate_kb_ppr(cs,ranks)) return false;
+bool compute_cs_ppv(CSentence & cs, vector<float> & ranks, PrankWorkspace & ws) {
+	if (!calculate_kb_ppr(cs, ranks, ws)) return false;
 	maybe_postproc_ranks(ranks);
 	return true;
 }
 
-// Get input from is, compute ppv and create output files under out_dir
+// Compute the ppvs of a batch of contexts and write them under fout
 
-void compute_sentence_vectors(istream & is, string & out_dir) {
+static void flush_ppv_batch(vector<CSentence> & css, File_elem & fout, PrankWorkspace & ws) {
+
+	if (!css.size()) return;
+	if (use_sparse_ppr() && trunc_ppv == 0.0f) {
+		// one (sparse) PPV at a time
+		Kb_sparse_vector ranks;
+		for(size_t i = 0, m = css.size(); i != m; ++i) {
+			if (!calculate_kb_ppr(css[i], ranks, ws)) {
+				cerr << "[W] Error when calculating ranks for csentence " << css[i].id() << endl;
+				continue;
+			}
+			boost::shared_ptr<ofstream> fo(output_ppv_fname(ppv_prefix + css[i].id(), fout));
+			write_ppv_stream(ranks, *fo);
+		}
+		vector<CSentence>().swap(css);
+		return;
+	}
+	vector<const CSentence *> pcs;
+	for(size_t i = 0, m = css.size(); i != m; ++i)
+		pcs.push_back(&css[i]);
+	vector<vector<float> > & ranks = ws.ranks;
+	vector<bool> ok;
+	calculate_kb_ppr_batch(pcs, ranks, ok, ws);
+	for(size_t i = 0, m = css.size(); i != m; ++i) {
+		if (!ok[i]) {
+			cerr << "[W] Error when calculating ranks for csentence " << css[i].id() << endl;
+			continue;
+		}
+		maybe_postproc_ranks(ranks[i]);
+		boost::shared_ptr<ofstream> fo(output_ppv_fname(ppv_prefix + css[i].id(), fout));
+		write_ppv_stream(ranks[i], *fo);
+	}
+	vector<CSentence>().swap(css);
+}
+
+// Get input from is, compute ppv and create output files under out_dir.
+// The ppvs of glVars::prank::batch_size contexts are computed at once.
+
+void compute_sentence_vectors(istream & is, string & out_dir, PrankWorkspace & ws) {
 
 	File_elem fout("lala", out_dir, ".ppv");
 
-	CSentence cs;
+	vector<CSentence> css;
 
 	// Read sentences and compute rank vectors
 	size_t l_n  = 0;
@@ -204,29 +278,29 @@ void compute_sentence_vectors(istream & is, string & out_dir) {
 		try {
 			CSentence cs(cid, ctx);
 			if(ctx.size()) {
-				vector<float> ranks;
-				// Initialize rank vector
-				if (!compute_cs_ppv(cs, ranks)) {
-					cerr << "[W] Error when calculating ranks for csentence " << cs.id() << endl;
-					continue;
-				}
-				boost::shared_ptr<ofstream> fo(output_ppv_fname(ppv_prefix + cs.id(), fout));
-				write_ppv_stream(ranks, *fo);
+				css.push_back(cs);
+				if (css.size() >= glVars::prank::batch_size)
+					flush_ppv_batch(css, fout, ws);
 			} else {
 				if (glVars::debug::warning) {
 					cerr << "[W] empty context " << cs.id() + " in line " + lexical_cast<string>(l_n) + "\n";
 				}
 			}
 		} catch (ukb::wdict_error & e) {
+			flush_ppv_batch(css, fout, ws);
 			throw e;
 		} catch (std::logic_error & e) {
 			string msg = "[E] Bad context in line " + lexical_cast<string>(l_n) + "\n" + e.what();
-			if (!glVars::input::swallow) throw std::runtime_error(msg);
+			if (!glVars::input::swallow) {
+				flush_ppv_batch(css, fout, ws);
+				throw std::runtime_error(msg);
+			}
 			if (glVars::debug::warning) {
 				cerr << msg << "\n";
 			}
 		}
 	}
+	flush_ppv_batch(css, fout, ws);
 }
 
 // Compute static PPV and write to standard output
@@ -235,6 +309,7 @@ void compute_static_ppv() {
 
 
 	// Calculate static (static) pageRank over KB
+	Kb::instance().init_static_prank();
 	const vector<float> & ranks = Kb::instance().static_prank();
 
 	write_ppv_stream(ranks, cout);
@@ -268,10 +343,14 @@ static void output_ppv_stream_socket(vector<float> & ranks,
 }
 
 // Return FALSE means kill server
+//
+// Each session runs in its own thread (see sServer), with its own PageRank
+// workspace.
 
 bool handle_server_read(sSession & session) {
 	string ctx_id;
 	string ctx;
+	PrankWorkspace ws;
 	try {
 		session.receive(ctx);
 		if (ctx == "stop") return false;
@@ -281,7 +360,7 @@ bool handle_server_read(sSession & session) {
 			if (!session.receive(ctx)) break;
 			CSentence cs(ctx_id, ctx);
 			vector<float> ranks;
-			if (!compute_cs_ppv(cs, ranks)) {
+			if (!compute_cs_ppv(cs, ranks, ws)) {
 				// throw "Error when calculating ranks for csentence " << cs.id() << endl;
 				// throw std::runtime_error(std::string("[E] when calculating ranks for csentence ") + cs.id() + ":" + this->error_str());
 				continue;
@@ -365,12 +444,29 @@ void load_kb_and_dict(bool from_daemon) {
 
 	if (from_daemon) {
 		string aux("Loading KB ");
-		aux += glVars::kb::fname;
+		aux += glVars::kb::shm_name.size() ? glVars::kb::shm_name : glVars::kb::fname;
 		syslog(LOG_INFO | LOG_USER,"%s", aux.c_str());
 	} else if (glVars::verbose) {
-		cout << "Loading KB " + glVars::kb::fname + "\n";
+		cout << "Loading KB " + (glVars::kb::shm_name.size() ? glVars::kb::shm_name : glVars::kb::fname) + "\n";
 	}
-	Kb::create_from_binfile(glVars::kb::fname);
+	if (glVars::kb::shm_name.size())
+		Kb::attach_shared(glVars::kb::shm_name);
+	else
+		Kb::create_from_binfile(glVars::kb::fname);
+	if (glVars::verbose) {
+		if (from_daemon) {
+			std::ostringstream load_stats;
+			Kb::instance().write_load_stats(load_stats);
+			syslog(LOG_INFO | LOG_USER, "%s", load_stats.str().c_str());
+		} else {
+			Kb::instance().write_load_stats(cerr);
+		}
+	}
+	if (glVars::prank::impl == glVars::mc) Kb::instance().load_fingerprints();
+	if (glVars::prank::ppv_cache_fname.size()) Kb::instance().load_ppv_cache(glVars::prank::ppv_cache_fname);
+	// computed once, before any session runs (see Kb::init_static_prank)
+	if (glVars::csentence::disamb_minus_static || glVars::prank::init == glVars::init_static)
+		Kb::instance().init_static_prank();
 	// Explicitly load dictionary only if:
 	// - there is a dictionary name (textual or binary)
 	// - from_daemon is set
@@ -384,6 +480,9 @@ void load_kb_and_dict(bool from_daemon) {
 	if (glVars::dict::altdict_fname.size()) {
 		WDict::instance().read_alternate_file(glVars::dict::altdict_fname);
 	}
+	// build the variant map now, as sessions share the dictionary
+	string fake_concept("kaka");
+	if (output_variants_ppv) WDict::instance().variant(fake_concept);
 }
 
 int main(int argc, char *argv[]) {
@@ -409,9 +508,6 @@ int main(int argc, char *argv[]) {
 #ifdef UKB_SERVER
 	unsigned int port = 10000;
 #endif
-	size_t iterations = 0;
-	float thresh = 0.0;
-	bool check_convergence = false;
 
 	const char desc_header[] = "ukb_ppv: get personalized PageRank vector if a KB\n"
 		"Usage examples:\n"
@@ -427,6 +523,7 @@ int main(int argc, char *argv[]) {
 		("help,h", "This help page.")
 		("version", "Show version.")
 		("kb_binfile,K", value<string>(), "Binary file of KB (see compile_kb).")
+		("kb_shm", value<string>(), "Use the KB placed in shared-memory segment arg (see compile_kb --shm_create), instead of a binary file.")
 		("out_dir,O", value<string>(), "Directory for leaving output PPV files. Default is current directory.")
 		("static,S", "Compute static PageRank ppv. Only -K option is needed. Output to STDOUT.")
 		("dict_file,D", value<string>(), "Word to synset map file.")
@@ -434,21 +531,10 @@ int main(int argc, char *argv[]) {
 		;
 
 	options_description po_desc_input("Input options");
-	po_desc_input.add_options()
-		("nopos", "Don't filter words by Part of Speech.")
-		("minput", "Do not die when dealing with malformed input.")
-		("ctx_noweight", "Do not use weights of input words (defaut is use context weights).")
-		;
+	add_input_options(po_desc_input);
 
 	options_description po_desc_prank("pageRank general options");
-	po_desc_prank.add_options()
-		("prank_nibble", "Use PageRank approximation (PageRank-nibble). See also nibble_epsilon.")
-		("prank_weight,w", "Use weights in pageRank calculation. Serialized graph edges must have some weight.")
-		("prank_iter", value<size_t>(), "Number of iterations in pageRank. Default is 30.")
-		("prank_threshold", value<float>(), "Threshold for pageRank convergence. Default is 0.0001.")
-		("prank_damping", value<float>(), "Set damping factor in PageRank equation. Default is 0.85.")
-		("nibble_epsilon", value<float>(), "Error for approximate pageRank as computed by the nibble algorithm.")
-		;
+	add_prank_options(po_desc_prank);
 
 	options_description po_desc_dict("Dictionary options");
 	po_desc_dict.add_options()
@@ -530,17 +616,11 @@ int main(int argc, char *argv[]) {
 			glVars::kb::fname = vm["kb_binfile"].as<string>();
 		}
 
-		if (vm.count("nopos")) {
-			glVars::input::filter_pos = false;
-		}
-
-		if (vm.count("minput")) {
-			glVars::input::swallow = true;
+		if (vm.count("kb_shm")) {
+			glVars::kb::shm_name = vm["kb_shm"].as<string>();
 		}
 
-		if (vm.count("ctx_noweight")) {
-			glVars::input::weight = false;
-		}
+		set_input_options(vm);
 
 		if (vm.count("variants")) {
 			output_variants_ppv = true;
@@ -566,10 +646,6 @@ int main(int argc, char *argv[]) {
 			glVars::dict::text_fname = vm["dict_file"].as<string>();
 		}
 
-		if (vm.count("prank_weight")) {
-			glVars::prank::use_weight = true;
-		}
-
 		if (vm.count("dict_strict")) {
 			glVars::dict::swallow = false;
 		}
@@ -594,37 +670,7 @@ int main(int argc, char *argv[]) {
 			glVars::csentence::disamb_minus_static = true;
 		}
 
-		if (vm.count("prank_iter")) {
-			iterations = vm["prank_iter"].as<size_t>();
-			check_convergence = true;
-		}
-
-		if (vm.count("prank_threshold")) {
-			thresh = vm["prank_threshold"].as<float>();
-			check_convergence = true;
-		}
-
-		if (vm.count("prank_damping")) {
-			float dp = vm["prank_damping"].as<float>();
-			if (dp <= 0.0 || dp > 1.0) {
-				cerr << "Error: invalid prank_damping value " << dp << "\n";
-				exit(1);
-			}
-			glVars::prank::damping = dp;
-		}
-
-		if (vm.count("prank_nibble")) {
-			glVars::prank::impl = glVars::nibble;
-		}
-
-		if (vm.count("nibble_epsilon")) {
-			float dp = vm["nibble_epsilon"].as<float>();
-			if (dp <= 0.0 || dp > 1.0) {
-				cerr << "Error: invalid nibble_epsilon value " << dp << "\n";
-				exit(1);
-			}
-			glVars::prank::nibble_epsilon = dp;
-		}
+		set_prank_options(vm);
 
 		if (vm.count("trunc_ppv")) {
 			trunc_ppv = vm["trunc_ppv"].as<float>();
@@ -639,6 +685,11 @@ int main(int argc, char *argv[]) {
 			trunc_ppv = topK;
 		}
 
+		if (trunc_ppv >= 1.0f) {
+			// only top k are printed (see post_process_ranks)
+			opt_nozero = true;
+		}
+
 		if (vm.count("nozero")) {
 			opt_nozero = true;
 		}
@@ -713,8 +764,6 @@ int main(int argc, char *argv[]) {
 		exit(-1);
 	}
 
-	if (check_convergence) set_pr_convergence(iterations, thresh);
-
 	// if --daemon, fork server process (has to be done before loading KB and dictionary)
 
 	if (opt_daemon) {
@@ -728,7 +777,7 @@ int main(int argc, char *argv[]) {
 			cerr << e.what() << "\n";
 			return 1;
 		}
-		if (!glVars::kb::fname.size()) {
+		if (!glVars::kb::fname.size() && !glVars::kb::shm_name.size()) {
 			cerr << "Error: no KB file\n";
 			return 1;
 		}
@@ -741,7 +790,7 @@ int main(int argc, char *argv[]) {
 
 	// if not --client, load KB
 	if (!opt_client) {
-		if (!glVars::kb::fname.size()) {
+		if (!glVars::kb::fname.size() && !glVars::kb::shm_name.size()) {
 			cerr << "Error: no KB file\n";
 			exit(1);
 		}
@@ -779,11 +828,16 @@ int main(int argc, char *argv[]) {
 #endif
 	}
 
-	try {
-		compute_sentence_vectors(std::cin, out_dir);
-	} catch(std::exception& e) {
-		cerr << "Errore reading " << fullname_in << "\n" << e.what() << "\n";
-		exit(-1);
+	{
+		PrankWorkspace ws;
+		try {
+			compute_sentence_vectors(std::cin, out_dir, ws);
+		} catch(std::exception& e) {
+			cerr << "Errore reading " << fullname_in << "\n" << e.what() << "\n";
+			exit(-1);
+		}
+
+		if (glVars::verbose) Kb::instance().write_prank_stats(cerr, ws);
 	}
 
  END:
@@ -41,6 +41,7 @@ static void print_ctx(const vector<string> & emited_words) {
 int main(int argc, char *argv[]) {
 
 	string kb_binfile("");
+	string kb_shm("");
 
 	string cmdline("!! -v ");
 	cmdline += glVars::ukb_version;
@@ -81,6 +82,7 @@ int main(int argc, char *argv[]) {
 		("version", "Show version.")
 		("verbose,v", "Be verbose.")
 		("kb_binfile,K", value<string>(), "Binary file of KB (see compile_kb).")
+		("kb_shm", value<string>(), "Use the KB placed in shared-memory segment arg (see compile_kb --shm_create), instead of a binary file.")
 		("dict_file,D", value<string>(), "Dictionary text file.")
 		;
 
@@ -240,6 +242,10 @@ int main(int argc, char *argv[]) {
 			kb_binfile = vm["kb_binfile"].as<string>();
 		}
 
+		if (vm.count("kb_shm")) {
+			kb_shm = vm["kb_shm"].as<string>();
+		}
+
 		if (vm.count("seed_word")) {
 			seed_word = vm["seed_word"].as<string>();
 		}
@@ -274,13 +280,16 @@ int main(int argc, char *argv[]) {
 	vector<string> ctx;
 
 	try {
-		if (!kb_binfile.size()) {
+		if (!kb_binfile.size() && !kb_shm.size()) {
 			cout << po_visible << endl;
 			cout << "Error: no KB file\n";
 			goto END;
 		}
 
-		Kb::create_from_binfile(kb_binfile);
+		if (kb_shm.size())
+			Kb::attach_shared(kb_shm);
+		else
+			Kb::create_from_binfile(kb_binfile);
 		cout << cmdline << "\n";
 
 		if(opt_deepwalk) {
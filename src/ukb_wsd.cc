@@ -7,9 +7,11 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <syslog.h>
 
 #include "ukbServer.h"
+#include "prankOptions.h"
 
 // Basename & friends
 #include <boost/filesystem/operations.hpp>
@@ -181,10 +183,21 @@ void dgraph_csent(CSentence & cs) {
 	}
 }
 
-void ppr_csent(CSentence & cs) {
+void ppr_csent(CSentence & cs, PrankWorkspace & ws) {
+
+	if (use_sparse_ppr()) {
+		Kb_sparse_vector ranks;
+		bool ok = calculate_kb_ppr(cs, ranks, ws);
+		if (!ok && glVars::debug::warning) {
+			std::cerr << "ppr_csent: [W] Error in sentence " << cs.id() << "\n";
+			return;
+		}
+		disamb_csentence_kb(cs, ranks);
+		return;
+	}
 
 	vector<float> ranks;
-	bool ok = calculate_kb_ppr(cs,ranks);
+	bool ok = calculate_kb_ppr(cs, ranks, ws);
 	if (!ok && glVars::debug::warning) {
 		std::cerr << "ppr_csent: [W] Error in sentence " << cs.id() << "\n";
 		return;
@@ -192,28 +205,81 @@ void ppr_csent(CSentence & cs) {
 	disamb_csentence_kb(cs, ranks);
 }
 
+// Disambiguate a batch of contexts using ppr. The PPVs of all contexts are
+// computed at once.
+
+void ppr_csent_batch(vector<CSentence> & css, PrankWorkspace & ws) {
+
+	vector<const CSentence *> pcs;
+	for(size_t i = 0, m = css.size(); i != m; ++i)
+		pcs.push_back(&css[i]);
+
+	vector<vector<float> > & ranks = ws.ranks;
+	vector<bool> ok;
+	calculate_kb_ppr_batch(pcs, ranks, ok, ws);
+	for(size_t i = 0, m = css.size(); i != m; ++i) {
+		if (!ok[i] && glVars::debug::warning) {
+			std::cerr << "ppr_csent: [W] Error in sentence " << css[i].id() << "\n";
+			continue;
+		}
+		disamb_csentence_kb(css[i], ranks[i]);
+	}
+}
+
 // w2w approach
 // for each target word
 //   1. init pv with the synsets of the rest of words
 //   2. run Personalized Pagerank
 //   3. use rank for disambiguating word
+//
+// The PPVs of glVars::prank::batch_size target words are computed at once,
+// unless they are sparse (see use_sparse_ppr).
 
-void ppr_w2w_csent(CSentence & cs) {
+void ppr_w2w_csent(CSentence & cs, PrankWorkspace & ws) {
 
-	vector<float> ranks;
 	int success_n = 0;
 
+	vector<CSentence::const_iterator> tgtws;
 	vector<CWord>::iterator cw_it = cs.ubegin();
 	vector<CWord>::iterator cw_end = cs.uend();
 	for(; cw_it != cw_end; ++cw_it) {
 		// Target word must be distinguished.
 		if(!cw_it->is_tgtword()) continue;
-		if (!cw_it->is_monosemous() &&
-			calculate_kb_ppr_by_word(cs, cw_it, ranks)) {
-			success_n++;
-			cw_it->rank_synsets(ranks, glVars::csentence::mult_priors);
+		if (cw_it->is_monosemous()) {
+			cw_it->disamb_cword();
+			continue;
+		}
+		tgtws.push_back(cw_it);
+	}
+
+	if (use_sparse_ppr()) {
+		// one (sparse) PPV at a time
+		Kb_sparse_vector ranks;
+		for(size_t i = 0, m = tgtws.size(); i != m; ++i) {
+			CWord & cw = *(cs.ubegin() + (tgtws[i] - cs.ubegin()));
+			if (calculate_kb_ppr_by_word(cs, tgtws[i], ranks, ws)) {
+				success_n++;
+				cw.rank_synsets<const Kb_sparse_vector &>(ranks, glVars::csentence::mult_priors);
+			}
+			cw.disamb_cword();
+		}
+	} else {
+		size_t batch_size = glVars::prank::batch_size;
+		for(size_t b = 0, m = tgtws.size(); b < m; b += batch_size) {
+			vector<CSentence::const_iterator> batch(tgtws.begin() + b,
+													tgtws.begin() + std::min(b + batch_size, m));
+			vector<vector<float> > & ranks = ws.ranks;
+			vector<bool> ok;
+			calculate_kb_ppr_by_word_batch(cs, batch, ranks, ok, ws);
+			for(size_t i = 0; i != batch.size(); ++i) {
+				CWord & cw = *(cs.ubegin() + (batch[i] - cs.ubegin()));
+				if (ok[i]) {
+					success_n++;
+					cw.rank_synsets(ranks[i], glVars::csentence::mult_priors);
+				}
+				cw.disamb_cword();
+			}
 		}
-		cw_it->disamb_cword();
 	}
 	if (!success_n && glVars::debug::warning) {
 		std::cerr << "ppr_w2w_csent: [W] Error in sentence " << cs.id() << "\n";
@@ -223,15 +289,15 @@ void ppr_w2w_csent(CSentence & cs) {
 
 void static_csent(CSentence &cs) {
 
-	static vector<float> ranks;
-	if (!ranks.size()) {
-		ranks = Kb::instance().static_prank();
-	}
+	const vector<float> & ranks = Kb::instance().static_prank();
 	disamb_csentence_kb(cs, ranks);
 }
 
+// Disambiguate a context. PageRank vectors are computed in ws, so that many
+// threads can disambiguate at once, each one with its own workspace (see
+// handle_server_read).
 
-void dispatch_run_cs(CSentence & cs) {
+void dispatch_run_cs(CSentence & cs, PrankWorkspace & ws) {
 
 	switch(opt_dmethod) {
 	case m_bfs:
@@ -239,10 +305,10 @@ void dispatch_run_cs(CSentence & cs) {
 		dgraph_csent(cs);
 		break;
 	case m_ppr:
-		ppr_csent(cs);
+		ppr_csent(cs, ws);
 		break;
 	case m_ppr_w2w:
-		ppr_w2w_csent(cs);
+		ppr_w2w_csent(cs, ws);
 		break;
 	case m_static:
 		static_csent(cs);
@@ -250,15 +316,68 @@ void dispatch_run_cs(CSentence & cs) {
 	};
 }
 
-void dispatch_run(istream & is, ostream & os) {
+// Disambiguate and print a batch of contexts using ppr
+
+static void flush_ppr_batch(vector<CSentence> & css, ostream & os, PrankWorkspace & ws) {
+
+	if (!css.size()) return;
+	ppr_csent_batch(css, ws);
+	for(size_t i = 0, m = css.size(); i != m; ++i)
+		css[i].print_csent(os);
+	vector<CSentence>().swap(css);
+}
+
+// Same as dispatch_run, but contexts are disambiguated in batches of
+// glVars::prank::batch_size contexts
+
+void dispatch_run_ppr_batch(istream & is, ostream & os, PrankWorkspace & ws) {
 
 	size_t l_n = 0;
 	string cid, ctx;
+	vector<CSentence> css;
 	while (read_ukb_ctx(is, l_n, cid, ctx)) {
 		try {
 			CSentence cs(cid, ctx);
 			if(ctx.size()) {
-				dispatch_run_cs(cs);
+				css.push_back(cs);
+				if (css.size() >= glVars::prank::batch_size)
+					flush_ppr_batch(css, os, ws);
+			} else {
+				if (glVars::debug::warning) {
+					cerr << "[W] empty context " << cs.id() + " in line " + lexical_cast<string>(l_n) + "\n";
+				}
+			}
+		} catch (ukb::wdict_error & e) {
+			flush_ppr_batch(css, os, ws);
+			throw e;
+		} catch (std::logic_error & e) {
+			string msg = "[E] Bad context in line " + lexical_cast<string>(l_n) + "\n" + e.what();
+			if (!glVars::input::swallow) {
+				flush_ppr_batch(css, os, ws);
+				throw std::runtime_error(msg);
+			}
+			if (glVars::debug::warning) {
+				cerr << msg << "\n";
+			}
+		}
+	}
+	flush_ppr_batch(css, os, ws);
+}
+
+void dispatch_run(istream & is, ostream & os, PrankWorkspace & ws) {
+
+	if (opt_dmethod == m_ppr && glVars::prank::batch_size > 1 && !use_sparse_ppr()) {
+		dispatch_run_ppr_batch(is, os, ws);
+		return;
+	}
+
+	size_t l_n = 0;
+	string cid, ctx;
+	while (read_ukb_ctx(is, l_n, cid, ctx)) {
+		try {
+			CSentence cs(cid, ctx);
+			if(ctx.size()) {
+				dispatch_run_cs(cs, ws);
 				cs.print_csent(os);
 			} else {
 				if (glVars::debug::warning) {
@@ -281,11 +400,16 @@ void dispatch_run(istream & is, ostream & os) {
 // Server/clien functions
 
 // Return FALSE means kill server
+//
+// Each session runs in its own thread (see sServer), with its own PageRank
+// workspace. There is no cap on the number of sessions, and each workspace
+// holds a few vectors of the size of the KB.
 
 #ifdef UKB_SERVER
 bool handle_server_read(sSession & session) {
 	string ctx_id;
 	string ctx;
+	PrankWorkspace ws;
 	try {
 		session.receive(ctx);
 		if (ctx == "stop") return false;
@@ -294,7 +418,7 @@ bool handle_server_read(sSession & session) {
 			if (!session.receive(ctx_id)) break;
 			if (!session.receive(ctx)) break;
 			CSentence cs(ctx_id, ctx);
-			dispatch_run_cs(cs);
+			dispatch_run_cs(cs, ws);
 			ostringstream oss;
 			cs.print_csent(oss);
 			string oss_str(oss.str());
@@ -359,16 +483,41 @@ bool client_stop_server(unsigned int port) {
 }
 #endif
 
+// Whether contexts may need the static PageRank vector. It is then
+// computed once the KB is loaded, before any session runs (see
+// Kb::init_static_prank). dgraph methods fall back to it for one word
+// contexts.
+
+static bool need_static_prank() {
+	return opt_dmethod == m_static || opt_dmethod == m_bfs || opt_dmethod == m_dfs ||
+		glVars::csentence::disamb_minus_static || glVars::prank::init == glVars::init_static;
+}
+
 void load_kb_and_dict(bool from_daemon) {
 
 	if (from_daemon) {
 		string aux("Loading KB ");
-		aux += glVars::kb::fname;
+		aux += glVars::kb::shm_name.size() ? glVars::kb::shm_name : glVars::kb::fname;
 		syslog(LOG_INFO | LOG_USER, "%s", aux.c_str());
 	} else if (glVars::verbose) {
-		cout << "Loading KB " + glVars::kb::fname + "\n";
+		cout << "Loading KB " + (glVars::kb::shm_name.size() ? glVars::kb::shm_name : glVars::kb::fname) + "\n";
 	}
-	Kb::create_from_binfile(glVars::kb::fname);
+	if (glVars::kb::shm_name.size())
+		Kb::attach_shared(glVars::kb::shm_name);
+	else
+		Kb::create_from_binfile(glVars::kb::fname);
+	if (glVars::verbose) {
+		if (from_daemon) {
+			std::ostringstream load_stats;
+			Kb::instance().write_load_stats(load_stats);
+			syslog(LOG_INFO | LOG_USER, "%s", load_stats.str().c_str());
+		} else {
+			Kb::instance().write_load_stats(cerr);
+		}
+	}
+	if (glVars::prank::impl == glVars::mc) Kb::instance().load_fingerprints();
+	if (glVars::prank::ppv_cache_fname.size()) Kb::instance().load_ppv_cache(glVars::prank::ppv_cache_fname);
+	if (need_static_prank()) Kb::instance().init_static_prank();
 	// Explicitly load dictionary only if:
 	// - there is a dictionary name (textual or binary)
 	// - from_daemon is set
@@ -423,9 +572,6 @@ int main(int argc, char *argv[]) {
 #ifdef UKB_SERVER
 	unsigned int port = 10000;
 #endif
-	size_t iterations = 0;
-	float thresh = 0.0;
-	bool check_convergence = false;
 
 	using namespace boost::program_options;
 
@@ -443,6 +589,7 @@ int main(int argc, char *argv[]) {
 		("help,h", "This page")
 		("version", "Show version.")
 		("kb_binfile,K", value<string>(), "Binary file of KB (see compile_kb).")
+		("kb_shm", value<string>(), "Use the KB placed in shared-memory segment arg (see compile_kb --shm_create), instead of a binary file.")
 		("dict_file,D", value<string>(), "Dictionary text file.")
 		("dict_binfile", value<string>(), "Dictionary binary file.")
 		;
@@ -459,23 +606,14 @@ int main(int argc, char *argv[]) {
 		;
 
 	options_description po_desc_input("Input options");
-	po_desc_input.add_options()
-		("nopos", "Don't filter words by Part of Speech.")
-		("minput", "Do not die when dealing with malformed input.")
-		("ctx_noweight", "Do not use weights of input words (defaut is use context weights).")
-		;
+	add_input_options(po_desc_input);
 
 	options_description po_desc_prank("pageRank general options");
+	add_prank_options(po_desc_prank);
 	po_desc_prank.add_options()
-		("prank_nibble", "Use PageRank approximation (PageRank-nibble). See also nibble_epsilon.")
-		("prank_weight,w", "Use weights in pageRank calculation. Serialized graph edges must have some weight.")
-		("prank_iter", value<size_t>(), "Number of iterations in pageRank. Default is 30.")
-		("prank_threshold", value<float>(), "Threshold for stopping PageRank. Default is zero. Good value is 0.0001.")
-		("prank_damping", value<float>(), "Set damping factor in PageRank equation. Default is 0.85.")
 		("dgraph_rank", value<string>(), "Set disambiguation method for dgraphs. Options are: ppr(default), ppr_w2w, coherence, static, degree.")
 		("dgraph_maxdepth", value<size_t>(), "If --dgraph_dfs is set, specify the maximum depth (default is 6).")
 		("dgraph_nocosenses", "If --dgraph_dfs, stop DFS when finding one co-sense of target word in path.")
-		("nibble_epsilon", value<float>(), "Error for approximate pageRank as computed by the nibble algorithm.")
 		;
 
 	options_description po_desc_dict("Dictionary options");
@@ -547,17 +685,7 @@ int main(int argc, char *argv[]) {
 			exit(0);
 		}
 
-		if (vm.count("nopos")) {
-			glVars::input::filter_pos = false;
-		}
-
-		if (vm.count("minput")) {
-			glVars::input::swallow = true;
-		}
-
-		if (vm.count("ctx_noweight")) {
-			glVars::input::weight = false;
-		}
+		set_input_options(vm);
 
 		if (vm.count("ppr")) {
 			opt_dmethod = m_ppr;
@@ -583,37 +711,7 @@ int main(int argc, char *argv[]) {
 			opt_dmethod = m_dfs;
 		}
 
-		if (vm.count("prank_iter")) {
-			iterations = vm["prank_iter"].as<size_t>();
-			check_convergence = true;
-		}
-
-		if (vm.count("prank_threshold")) {
-			thresh = vm["prank_threshold"].as<float>();
-			check_convergence = true;
-		}
-
-		if (vm.count("prank_damping")) {
-			float dp = vm["prank_damping"].as<float>();
-			if (dp <= 0.0 || dp > 1.0) {
-				cerr << "Error: invalid prank_damping value " << dp << "\n";
-				exit(-1);
-			}
-			glVars::prank::damping = dp;
-		}
-
-		if (vm.count("prank_nibble")) {
-			glVars::prank::impl = glVars::nibble;
-		}
-
-		if (vm.count("nibble_epsilon")) {
-			float dp = vm["nibble_epsilon"].as<float>();
-			if (dp <= 0.0 || dp > 1.0) {
-				cerr << "Error: invalid nibble_epsilon value " << dp << "\n";
-				exit(-1);
-			}
-			glVars::prank::nibble_epsilon = dp;
-		}
+		set_prank_options(vm);
 
 		if (vm.count("dgraph_maxdepth")) {
 			size_t md = vm["dgraph_maxdepth"].as<size_t>();
@@ -686,6 +784,10 @@ int main(int argc, char *argv[]) {
 			glVars::kb::fname = vm["kb_binfile"].as<string>();
 		}
 
+		if (vm.count("kb_shm")) {
+			glVars::kb::shm_name = vm["kb_shm"].as<string>();
+		}
+
 		if (vm.count("rank_alg")) {
 			glVars::RankAlg alg = glVars::get_algEnum(vm["rank_alg"].as<string>());
 			if (alg == glVars::no_alg) {
@@ -695,10 +797,6 @@ int main(int argc, char *argv[]) {
 			glVars::rAlg = alg;
 		}
 
-		if (vm.count("prank_weight")) {
-			glVars::prank::use_weight = true;
-		}
-
 		if (vm.count("input-file")) {
 			fullname_in = vm["input-file"].as<string>();
 		}
@@ -796,8 +894,6 @@ int main(int argc, char *argv[]) {
 		exit(-1);
 	}
 
-	if (check_convergence) set_pr_convergence(iterations, thresh);
-
 	// if --daemon, fork server process (has to be done before loading KB and dictionary)
 	if (opt_daemon) {
 #ifdef UKB_SERVER
@@ -810,7 +906,7 @@ int main(int argc, char *argv[]) {
 			cerr << e.what() << "\n";
 			return 1;
 		}
-		if (!glVars::kb::fname.size()) {
+		if (!glVars::kb::fname.size() && !glVars::kb::shm_name.size()) {
 			cerr << "Error: no KB file\n";
 			return 1;
 		}
@@ -823,7 +919,7 @@ int main(int argc, char *argv[]) {
 
 	// if not --client, load KB
 	if (!opt_client) {
-		if (!glVars::kb::fname.size()) {
+		if (!glVars::kb::fname.size() && !glVars::kb::shm_name.size()) {
 			cerr << "Error: no KB file\n";
 			exit(1);
 		}
@@ -866,12 +962,15 @@ int main(int argc, char *argv[]) {
 
 	cout << cmdline << "\n";
 
+	PrankWorkspace ws;
 	try {
-		dispatch_run(std::cin, std::cout);
+		dispatch_run(std::cin, std::cout, ws);
 	} catch (std::exception & e) {
 		cerr << "[E] Error reading " << fullname_in << "\n" << e.what() << "\n";
 		return 0;
 	}
 
+	if (glVars::verbose) Kb::instance().write_prank_stats(cerr, ws);
+
 	return 0;
 }
@@ -81,6 +81,7 @@ namespace ukb {
 	vsampling_t::vsampling_t(size_t buckets) :
 		m_N( Kb::instance().size() ), m_bucket_N(buckets) {
 		if (!m_bucket_N) return ;
+		Kb::instance().init_static_prank();
 		init(Kb::instance().static_prank());
 	}
 
@@ -380,7 +381,6 @@ namespace ukb {
 										  vector<float> & vertex_out_tweight) {
 
 		Kb & kb = Kb::instance();
-		KbGraph & G = kb.graph();
 		Kb_vertex_t previous = current;
 
 		Kb_out_edge_iter_t out_it, out_end;
@@ -391,7 +391,7 @@ namespace ukb {
 			float T = 0.0f;
 			for(Kb_out_edge_iter_t auxit = out_it; auxit < out_end; ++auxit) {
 				Kb_vertex_t uu = kb.edge_target(*auxit);
-				T += in_degree(uu, G);
+				T += kb.in_degree(uu);
 			}
 			total_weight = T;
 		}
@@ -400,7 +400,7 @@ namespace ukb {
 		float w_accum = 0.0f;
 		for(; out_it < out_end; ++out_it) {
 			Kb_vertex_t uu = kb.edge_target(*out_it);
-			w_accum += in_degree(uu, G);
+			w_accum += kb.in_degree(uu);
 			current = uu;
 			if (rand_value < w_accum) break;
 		}
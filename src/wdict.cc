@@ -1,14 +1,13 @@
 #include "wdict.h"
 #include "globalVars.h"
 #include "common.h"
+#include "textScan.h"
 
 #include <fstream>
 #include <iostream>
 
 #include<boost/tuple/tuple.hpp> // for "tie"
 
-// Tokenizer
-#include <boost/tokenizer.hpp>
 #include <boost/lexical_cast.hpp>
 
 namespace ukb {
@@ -63,34 +62,18 @@ namespace ukb {
 	static size_t line_number; // global variable, used by many parsing functions
 
 	// given a string with "concept_id:weight", extract "concept_id" and "weight"
-	static pair<string, float> wdict_parse_weight(const string & str) {
+	static pair<text_ref, float> wdict_parse_weight(text_ref str) {
 
 		float weight = 0.0f; // default weight is zero
-		string concept_id(str);
-
-		char_separator<char> sf_sep("", ":"); // keep delimiters
-		tokenizer<char_separator<char> > sf_tok(str, sf_sep);
-		vector<string> syn_freq;
-		copy(sf_tok.begin(), sf_tok.end(), back_inserter(syn_freq));
-
-		size_t m = syn_freq.size();
-
-		if (m > 2 ) {
-			// Warning. concept-id can have ":" characters in. So, just
-			// take the last field as weight, and join the rest.
-			try {
-				float tmp = lexical_cast<float>(syn_freq[m - 1]);
-				weight = tmp;
-				// reconstruct concept_id without the weight
-				if (m == 3)
-					concept_id = syn_freq[0];
-				else
-					concept_id = join("", syn_freq.begin(), syn_freq.end() - 2);
-			} catch (boost::bad_lexical_cast &) {
-				// last field wasn't a float. Do nothing.
-			}
-		}
-		return make_pair(concept_id, weight);
+
+		// Warning. concept-id can have ":" characters in. So, just
+		// take the last field as weight, and leave the rest.
+		size_t idx = str.rfind(':');
+		if (idx == text_ref::npos || idx == 0 || idx + 1 == str.size())
+			return make_pair(str, weight);
+		if (!parse_float(str.substr(idx + 1), weight))
+			return make_pair(str, 0.0f); // last field wasn't a float
+		return make_pair(str.substr(0, idx), weight);
 	}
 
 	// given a concept id "concept-pos", extract pos
@@ -129,11 +112,12 @@ namespace ukb {
 	// 2   Error: parsing error (zero weight)
 
 
-	static size_t parse_concept(const string & cstr,
+	static size_t parse_concept(text_ref cstr,
 								concept_parse_t & cp) {
-		string pos_str("");
 		bool aux;
-		tie(cp.str, cp.w) = wdict_parse_weight(cstr);
+		text_ref cid;
+		tie(cid, cp.w) = wdict_parse_weight(cstr);
+		cid.assign_to(cp.str);
 
 		//  See if concept is in KB
 		tie(cp.u, aux) = Kb::instance().get_vertex_by_name(cp.str);
@@ -161,16 +145,19 @@ namespace ukb {
 	// 1 -> OK
 	// -1 -> blank line
 	// -2 -> ERROR: malformed line
+	//
+	// fields point to line, and both keep their memory across calls.
 
 	static int read_wdict_line(istream & fh,
-							   vector<string> & fields) {
+							   string & line,
+							   vector<text_ref> & fields) {
 
-		string line;
-		bool res = read_line_noblank(fh, line, line_number);
+		fields.clear();
+		bool res = static_cast<bool>(read_line_noblank(fh, line, line_number));
 		if (!res) return 0; // EOF
-		char_separator<char> sep(" \t");
-		tokenizer<char_separator<char> > tok(line, sep);
-		copy(tok.begin(), tok.end(), back_inserter(fields));
+		text_fields tok(line, " \t");
+		text_ref field;
+		while(tok.next(field)) fields.push_back(field);
 		if (fields.size() == 0) return -1; // blank line
 		if (fields.size() < 2) {
 			return -2; // malformed line
@@ -181,16 +168,16 @@ namespace ukb {
 	// Fill the concept vector associated with headword hw
 
 	static size_t fill_concepts(const string & hw,
-								vector<string>::const_iterator fields_it,
-								vector<string>::const_iterator fields_end,
+								vector<text_ref>::const_iterator fields_it,
+								vector<text_ref>::const_iterator fields_end,
 								ccache_map_t & ccache) {
 
 		static const char *concept_err_msg[] = { "(concept not in KB)",
 												 "(concept with zero weight)" };
 		bool aux;
 
+		concept_parse_t cp;
 		for(; fields_it != fields_end; ++fields_it) {
-			concept_parse_t cp;
 			int pc_err_status = parse_concept(*fields_it, cp);
 			if (pc_err_status != 0) {
 				// deal with error
@@ -267,13 +254,14 @@ namespace ukb {
 		// abandon 04135348-n:4 06081672-n:0 01663408-v:10 00451308-v:7
 
 		string line;
+		string hw;
+		vector<text_ref> fields;
 		line_number = 0;
 		bool insertedP;
 
 		try {
 			while(true) {
-				vector<string> fields;
-				int rwl_res = read_wdict_line(fh, fields);
+				int rwl_res = read_wdict_line(fh, line, fields);
 				if (rwl_res == 0) break; // EOF
 				if (rwl_res == -1) continue; // blank line
 				if (rwl_res == -2) {
@@ -282,8 +270,8 @@ namespace ukb {
 					cerr << "[W] read_dictfile_1pass: line" << line_number <<  " is malformed (ignoring).\n" ;
 					continue;
 				}
-				vector<string>::const_iterator fields_it = fields.begin();
-				const string & hw = *fields_it;
+				vector<text_ref>::const_iterator fields_it = fields.begin();
+				fields_it->assign_to(hw);
 				++fields_it;
 				map<string, ccache_map_t>::iterator cache_map_it;
 				tie(cache_map_it, insertedP) = concept_cache.insert(make_pair(hw, ccache_map_t()));
@@ -295,7 +283,7 @@ namespace ukb {
 					// we have a headword but all the associated concepts are erroneous
 					// Erase the headword from the map
 					if (glVars::debug::warning) {
-						cerr << "[W]: line " << lexical_cast<string>(line_number) << ". Ignoring headword " << fields[0] << endl;
+						cerr << "[W]: line " << lexical_cast<string>(line_number) << ". Ignoring headword " << hw << endl;
 					}
 					N--;
 					concept_cache.erase(cache_map_it);
@@ -601,7 +589,7 @@ namespace ukb {
 		return m_rhs.m_items[i + m_left].m_syn;
 	}
 
-	const std::string & WDict_entries::get_entry_str(size_t i) const {
+	std::string WDict_entries::get_entry_str(size_t i) const {
 		return Kb::instance().get_vertex_name(this->get_entry(i));
 	}
 
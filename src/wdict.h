@@ -77,7 +77,7 @@ namespace ukb {
 		const wdict_item_t *end() const;
 		size_t size() const;
 		Kb_vertex_t get_entry(size_t i) const;
-		const std::string & get_entry_str(size_t i) const;
+		std::string get_entry_str(size_t i) const;
 		float get_freq(size_t i) const;
 		const std::string & get_pos(size_t i) const;
 		size_t dist_pos() const;